@@ -0,0 +1,398 @@
+/*
+ *  Created on: 12 Mar 2015
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2015 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+#include <skivvy/factoid-manager.h>
+#include <skivvy/factoid-command.h>
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <sookee/str.h>
+#include <sookee/types/stream.h>
+
+using namespace skivvy::factoid;
+using namespace sookee::utils;
+
+// Benchmark: build a synthetic fact database and time the main
+// FactoidManager operations on it. Results are written as JSON
+// so runs from different releases can be compared.
+//
+// bench [--keys n] [--groups n] [--fanout n] [--alias-depth n]
+//       [--ops n] [--snapshot] [--journal] [--compress] [--cache n]
+//       [--out file]
+//
+// Run it with and without --compress to weigh the memory the facts
+// take (rss_kb, snapshot_bytes) against the time to look them up.
+
+using clk = std::chrono::steady_clock;
+
+struct options
+{
+	siz keys = 10000;
+	siz groups = 100; // distinct groups
+	siz fanout = 2; // groups per key
+	siz alias_depth = 3; // longest alias chain
+	siz ops = 10000; // lookups of each kind
+	bool snapshot = false;
+	bool journal = false;
+	bool compress = false;
+	siz cache = 1024; // keys kept decompressed
+	str out; // default stdout
+};
+
+// latencies of one operation in nanoseconds
+struct timings
+{
+	str name;
+	std::vector<double> ns;
+	double total = 0; // seconds
+};
+
+class bench
+{
+	std::vector<timings> results;
+
+	// while the lookups were timed
+	long rss_kb = 0;
+	siz snapshot_bytes = 0;
+
+public:
+	void memory(long rss, siz snapshot)
+	{
+		rss_kb = rss;
+		snapshot_bytes = snapshot;
+	}
+
+	template<typename Func>
+	void time(const str& name, siz n, Func func)
+	{
+		timings t;
+		t.name = name;
+		t.ns.reserve(n);
+
+		const auto start = clk::now();
+		for(siz i = 0; i < n; ++i)
+		{
+			const auto b = clk::now();
+			func(i);
+			t.ns.push_back(std::chrono::duration<double, std::nano>(clk::now() - b).count());
+		}
+		t.total = std::chrono::duration<double>(clk::now() - start).count();
+
+		results.push_back(std::move(t));
+	}
+
+	void write(std::ostream& os, const options& o) const;
+};
+
+static double percentile(std::vector<double>& v, double p)
+{
+	if(v.empty())
+		return 0;
+	siz i = siz(p * (v.size() - 1));
+	std::nth_element(v.begin(), v.begin() + i, v.end());
+	return v[i];
+}
+
+static long peak_rss_kb()
+{
+	rusage ru;
+	if(::getrusage(RUSAGE_SELF, &ru))
+		return 0;
+	return ru.ru_maxrss;
+}
+
+static long current_rss_kb()
+{
+	std::ifstream ifs("/proc/self/statm");
+	long size, resident;
+	if(!(ifs >> size >> resident))
+		return 0;
+	return resident * (::sysconf(_SC_PAGESIZE) / 1024);
+}
+
+void bench::write(std::ostream& os, const options& o) const
+{
+	os << std::fixed << std::setprecision(1);
+	os << "{\n";
+	os << "\t\"config\": {\"keys\": " << o.keys << ", \"groups\": " << o.groups
+		<< ", \"fanout\": " << o.fanout << ", \"alias_depth\": " << o.alias_depth
+		<< ", \"ops\": " << o.ops << ", \"snapshot\": " << std::boolalpha << o.snapshot
+		<< ", \"journal\": " << o.journal << ", \"compress\": " << o.compress
+		<< ", \"cache\": " << o.cache << "},\n";
+	os << "\t\"results\": [\n";
+
+	str sep;
+	for(auto t: results) // a copy as percentile() reorders
+	{
+		os << sep << "\t\t{\"op\": \"" << t.name << "\", \"count\": " << t.ns.size()
+			<< ", \"ops_per_sec\": " << (t.total > 0 ? t.ns.size() / t.total : 0)
+			<< ", \"p50_ns\": " << percentile(t.ns, 0.50)
+			<< ", \"p99_ns\": " << percentile(t.ns, 0.99)
+			<< ", \"max_ns\": " << percentile(t.ns, 1.0) << "}";
+		sep = ",\n";
+	}
+
+	os << "\n\t],\n";
+	os << "\t\"rss_kb\": " << rss_kb << ",\n";
+	os << "\t\"snapshot_bytes\": " << snapshot_bytes << ",\n";
+	os << "\t\"peak_rss_kb\": " << peak_rss_kb() << "\n";
+	os << "}\n";
+}
+
+static str key_name(siz k)
+{
+	return "key-" + std::to_string(k);
+}
+
+static str group_name(siz g)
+{
+	return "grp-" + std::to_string(g);
+}
+
+// how !fact used to read its parameters, for comparison
+static siz parse_stream(const str& params)
+{
+	siss iss(params);
+
+	str_set groups;
+	if(iss.peek() == '[') // groups
+	{
+		iss.ignore();
+		str list; // groups
+		sgl(iss, list, ']');
+		siss iss(list);
+		str group;
+		while(sgl(iss, group, ','))
+			groups.insert(trim(group));
+	}
+
+	str_vec keys;
+	str key;
+	while(iss >> key)
+		keys.push_back(key);
+
+	return groups.size() + keys.size();
+}
+
+static siz parse_views(const str& params)
+{
+	fact_command cmd;
+	parse_command(params, command_syntax::keys, cmd);
+	return cmd.groups.size() + cmd.keys.size();
+}
+
+static bool parse(int argc, char* argv[], options& o)
+{
+	for(int i = 1; i < argc; ++i)
+	{
+		const str arg = argv[i];
+		const bool more = i + 1 < argc;
+
+		if(arg == "--snapshot")
+			o.snapshot = true;
+		else if(arg == "--journal")
+			o.journal = true;
+		else if(arg == "--compress")
+			o.compress = true;
+		else if(arg == "--cache" && more)
+			o.cache = std::stoul(argv[++i]);
+		else if(arg == "--out" && more)
+			o.out = argv[++i];
+		else if(arg == "--keys" && more)
+			o.keys = std::stoul(argv[++i]);
+		else if(arg == "--groups" && more)
+			o.groups = std::stoul(argv[++i]);
+		else if(arg == "--fanout" && more)
+			o.fanout = std::stoul(argv[++i]);
+		else if(arg == "--alias-depth" && more)
+			o.alias_depth = std::stoul(argv[++i]);
+		else if(arg == "--ops" && more)
+			o.ops = std::stoul(argv[++i]);
+		else
+			return false;
+	}
+
+	return o.keys && o.groups;
+}
+
+int main(int argc, char* argv[])
+{
+	options o;
+
+	if(!parse(argc, argv, o))
+	{
+		std::cerr << "usage: " << argv[0] << " [--keys n] [--groups n] [--fanout n]"
+			<< " [--alias-depth n] [--ops n] [--snapshot] [--journal] [--compress] [--cache n]"
+			<< " [--out file]\n";
+		return EXIT_FAILURE;
+	}
+
+	char tmp[] = "/tmp/skivvy-factoid-bench-XXXXXX";
+	if(!::mkdtemp(tmp))
+	{
+		std::cerr << "can not make temp dir" << '\n';
+		return EXIT_FAILURE;
+	}
+
+	const str store = str(tmp) + "/store.txt";
+	const str index = str(tmp) + "/index.txt";
+	const str snap = str(tmp) + "/snapshot.bin";
+	const str log = str(tmp) + "/journal.txt";
+
+	std::mt19937 rng(1);
+	bench b;
+
+	{
+		FactoidManager fm(store, index, o.snapshot ? snap : "", o.compress, o.cache);
+
+		if(o.journal && !fm.open_journal(log, std::chrono::milliseconds(500), std::chrono::seconds(60)))
+		{
+			std::cerr << fm.error << '\n';
+			return EXIT_FAILURE;
+		}
+
+		// every key goes in fanout groups and each block of ten
+		// keys starts with an alias chain alias_depth long
+		b.time("add_fact", o.keys, [&](siz k)
+		{
+			str_set groups;
+			for(siz g = 0; g < o.fanout; ++g)
+				groups.insert(group_name(rng() % o.groups));
+
+			const str key = key_name(k);
+
+			if(k % 10 < std::min<siz>(o.alias_depth, 9) && k + 1 < o.keys)
+				fm.add_fact(key, "= " + key_name(k + 1), groups);
+			else
+				fm.add_fact(key, "fact number " + std::to_string(k)
+					+ " says something mildly useful about " + key, groups);
+		});
+
+		b.time("add_fact_line", o.ops, [&](siz)
+		{
+			fm.add_fact(key_name(rng() % o.keys), "another line of text", {});
+		});
+
+		fm.sync();
+
+		// so the lookups read the (compressed) snapshot
+		// as they would after a restart
+		b.time("save_snapshot", 1, [&](siz)
+		{
+			fm.save_snapshot();
+		});
+
+		b.time("get_fact", o.ops, [&](siz)
+		{
+			fm.get_fact(key_name(rng() % o.keys), {});
+		});
+
+		// a few popular keys, which the body cache keeps
+		b.time("get_fact_hot", o.ops, [&](siz)
+		{
+			fm.get_fact(key_name(rng() % std::min<siz>(o.keys, 100)), {});
+		});
+
+		b.time("get_fact_groups", o.ops, [&](siz)
+		{
+			fm.get_fact(key_name(rng() % o.keys), {group_name(rng() % o.groups)});
+		});
+
+		b.time("get_resolved_fact", o.ops, [&](siz)
+		{
+			fm.get_resolved_fact(key_name(rng() % o.keys), {});
+		});
+
+		// the same limit as !findfact
+		b.time("find_fact_prefix", o.ops, [&](siz)
+		{
+			fm.find_fact(key_name(rng() % o.keys) + "*", {}, 21);
+		});
+
+		b.time("find_fact_infix", std::max<siz>(o.ops / 10, 1), [&](siz)
+		{
+			fm.find_fact("*-" + std::to_string(rng() % 1000) + "*", {}, 21);
+		});
+
+		b.time("find_group", std::max<siz>(o.ops / 10, 1), [&](siz)
+		{
+			fm.find_group(group_name(rng() % o.groups) + "*");
+		});
+
+		b.memory(current_rss_kb(), fm.get_stats().get_size("fm.snapshot_bytes"));
+
+		b.time("reload", 3, [&](siz)
+		{
+			fm.reload();
+		});
+
+		b.time("del_fact", std::min(o.ops, o.keys), [&](siz i)
+		{
+			fm.del_fact(key_name(i));
+		});
+	}
+
+	// per message cost of reading !fact parameters
+	const str params = "[" + group_name(1) + ", " + group_name(2) + "] "
+		+ key_name(1) + " " + key_name(2) + " " + key_name(3);
+
+	siz parsed = 0;
+	b.time("parse_stream", o.ops, [&](siz){ parsed += parse_stream(params); });
+	b.time("parse_command", o.ops, [&](siz){ parsed += parse_views(params); });
+
+	if(parsed != 10 * o.ops)
+		std::cerr << "parsers disagree" << '\n';
+
+	if(o.out.empty())
+		b.write(std::cout, o);
+	else
+	{
+		std::ofstream ofs(o.out);
+		b.write(ofs, o);
+		if(!ofs)
+		{
+			std::cerr << "can not write: " << o.out << '\n';
+			return EXIT_FAILURE;
+		}
+	}
+
+	for(auto&& f: {store, index, snap, log})
+		::unlink(f.c_str());
+	::rmdir(tmp);
+
+	return EXIT_SUCCESS;
+}
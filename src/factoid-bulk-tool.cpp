@@ -0,0 +1,174 @@
+/*
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <skivvy/factoid-shards.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+using namespace skivvy::factoid;
+
+// Bulk import and export of the fact database, for seeding a new
+// bot, moving facts between bots or changing factoid.shards. Stop
+// the bot first.
+//
+// skivvy-factoid-bulk (import|export) --store file --index file
+//     [--snapshot file] [--shards n] [--format tsv|jsonl] [file]
+//
+// The file defaults to stdin (import) or stdout (export). With
+// --shards the files are those of that many shards (as the plugin
+// names them) and imported keys are spread over them by hash.
+
+struct options
+{
+	str command;
+	str store;
+	str index;
+	str snapshot;
+	siz shards = 1;
+	bulk_format format = bulk_format::tsv;
+	str file = "-";
+};
+
+static bool parse(int argc, char* argv[], options& o)
+{
+	for(int i = 1; i < argc; ++i)
+	{
+		const str arg = argv[i];
+		const bool more = i + 1 < argc;
+
+		if(arg == "--store" && more)
+			o.store = argv[++i];
+		else if(arg == "--index" && more)
+			o.index = argv[++i];
+		else if(arg == "--snapshot" && more)
+			o.snapshot = argv[++i];
+		else if(arg == "--shards" && more)
+		{
+			const str n = argv[++i];
+			if(n.empty() || n.size() > 4 || n.find_first_not_of("0123456789") != str::npos || !std::stoul(n))
+				return false;
+			o.shards = std::stoul(n);
+		}
+		else if(arg == "--format" && more)
+		{
+			if(!get_bulk_format(argv[++i], o.format))
+				return false;
+		}
+		else if(o.command.empty() && (arg == "import" || arg == "export"))
+			o.command = arg;
+		else if(!o.command.empty() && (arg == "-" || arg[0] != '-'))
+			o.file = arg;
+		else
+			return false;
+	}
+
+	return !o.command.empty() && !o.store.empty() && !o.index.empty();
+}
+
+int main(int argc, char* argv[])
+{
+	options o;
+
+	if(!parse(argc, argv, o))
+	{
+		std::cerr << "usage: " << argv[0] << " (import|export) --store file --index file"
+			<< " [--snapshot file] [--shards n] [--format tsv|jsonl] [file]\n";
+		return EXIT_FAILURE;
+	}
+
+	FactoidShards fm(o.store, o.index, o.snapshot, o.shards);
+
+	// facts in files for another number of shards would be
+	// left out of an export or never seen after an import
+	if(!fm.check_files())
+	{
+		std::cerr << fm.error << '\n';
+		return EXIT_FAILURE;
+	}
+
+	if(o.command == "export")
+	{
+		std::ofstream ofs;
+		if(o.file != "-")
+			ofs.open(o.file, std::ios::trunc);
+		std::ostream& os = o.file == "-" ? std::cout : ofs;
+
+		if(!fm.export_facts(os, o.format) || !os.flush())
+		{
+			std::cerr << "export failed: " << (fm.error.empty() ? o.file : fm.error) << '\n';
+			return EXIT_FAILURE;
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	std::ifstream ifs;
+	if(o.file != "-")
+	{
+		ifs.open(o.file);
+		if(!ifs)
+		{
+			std::cerr << "can not read: " << o.file << '\n';
+			return EXIT_FAILURE;
+		}
+	}
+	std::istream& is = o.file == "-" ? std::cin : ifs;
+
+	// the journal gathers every edit up so the store
+	// files are written once, when it is compacted
+	const str journal = o.store + ".import-journal";
+	if(!fm.open_journal(journal, std::chrono::seconds(1), std::chrono::hours(24)))
+	{
+		std::cerr << fm.error << '\n';
+		return EXIT_FAILURE;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+
+	siz added = 0;
+	const bool ok = fm.import_facts(is, o.format, added);
+
+	fm.sync();
+	for(siz i = 0; i < o.shards; ++i)
+		std::remove((o.shards == 1 ? journal : journal + "." + std::to_string(i)).c_str());
+
+	if(!ok)
+	{
+		std::cerr << "import failed: " << fm.error << '\n';
+		return EXIT_FAILURE;
+	}
+
+	const auto secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << "imported " << added << " facts in " << secs << "s\n";
+
+	return EXIT_SUCCESS;
+}
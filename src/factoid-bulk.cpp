@@ -0,0 +1,717 @@
+/*
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <skivvy/factoid-bulk.h>
+
+#include <cstdio>
+#include <cctype>
+#include <fstream>
+#include <algorithm>
+
+namespace skivvy { namespace factoid {
+
+bool get_bulk_format(const str& name, bulk_format& format)
+{
+	if(name == "tsv")
+		format = bulk_format::tsv;
+	else if(name == "jsonl")
+		format = bulk_format::jsonl;
+	else
+		return false;
+	return true;
+}
+
+// TSV
+
+static void escape(str& out, const str& s)
+{
+	for(char c: s)
+	{
+		switch(c)
+		{
+			case '\\': out += "\\\\"; break;
+			case '\t': out += "\\t"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			default: out += c;
+		}
+	}
+}
+
+static str_vec unescape_fields(const str& line)
+{
+	str_vec fields(1);
+
+	for(siz i = 0; i < line.size(); ++i)
+	{
+		if(line[i] == '\t')
+			fields.emplace_back();
+		else if(line[i] == '\\' && i + 1 < line.size())
+		{
+			switch(line[++i])
+			{
+				case 't': fields.back() += '\t'; break;
+				case 'n': fields.back() += '\n'; break;
+				case 'r': fields.back() += '\r'; break;
+				default: fields.back() += line[i];
+			}
+		}
+		else
+			fields.back() += line[i];
+	}
+
+	return fields;
+}
+
+static bool is_key(const str& key)
+{
+	return !key.empty() && std::none_of(key.begin(), key.end(), [](char c)
+	{
+		return std::isspace((unsigned char)c);
+	});
+}
+
+static str trim(const str& s)
+{
+	const auto b = s.find_first_not_of(" \t");
+	if(b == str::npos)
+		return {};
+	return s.substr(b, s.find_last_not_of(" \t") + 1 - b);
+}
+
+// JSON, just enough for one flat object per line
+
+static void json_escape(str& out, const str& s)
+{
+	static const char* const hex = "0123456789abcdef";
+
+	out += '"';
+	for(char c: s)
+	{
+		switch(c)
+		{
+			case '"': out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				if((unsigned char)c < 0x20)
+				{
+					out += "\\u00";
+					out += hex[(unsigned char)c >> 4];
+					out += hex[c & 0xF];
+				}
+				else
+					out += c;
+		}
+	}
+	out += '"';
+}
+
+class json_parser
+{
+	const str& s;
+	siz i = 0;
+
+	static void put_utf8(str& out, unsigned long cp)
+	{
+		if(cp < 0x80)
+			out += char(cp);
+		else if(cp < 0x800)
+		{
+			out += char(0xC0 | (cp >> 6));
+			out += char(0x80 | (cp & 0x3F));
+		}
+		else if(cp < 0x10000)
+		{
+			out += char(0xE0 | (cp >> 12));
+			out += char(0x80 | ((cp >> 6) & 0x3F));
+			out += char(0x80 | (cp & 0x3F));
+		}
+		else
+		{
+			out += char(0xF0 | (cp >> 18));
+			out += char(0x80 | ((cp >> 12) & 0x3F));
+			out += char(0x80 | ((cp >> 6) & 0x3F));
+			out += char(0x80 | (cp & 0x3F));
+		}
+	}
+
+	bool hex4(unsigned long& v)
+	{
+		if(i + 4 > s.size())
+			return false;
+		v = 0;
+		for(siz n = 0; n < 4; ++n)
+		{
+			const char c = s[i++];
+			v <<= 4;
+			if(c >= '0' && c <= '9')
+				v |= c - '0';
+			else if(c >= 'a' && c <= 'f')
+				v |= c - 'a' + 10;
+			else if(c >= 'A' && c <= 'F')
+				v |= c - 'A' + 10;
+			else
+				return false;
+		}
+		return true;
+	}
+
+public:
+	str error;
+
+	explicit json_parser(const str& s): s(s) {}
+
+	void ws()
+	{
+		while(i < s.size() && std::isspace((unsigned char)s[i]))
+			++i;
+	}
+
+	bool at_end() { ws(); return i == s.size(); }
+
+	bool expect(char c)
+	{
+		ws();
+		if(i < s.size() && s[i] == c)
+		{
+			++i;
+			return true;
+		}
+		error = str("expected '") + c + "'";
+		return false;
+	}
+
+	bool peek(char c) { ws(); return i < s.size() && s[i] == c; }
+
+	bool string(str& out)
+	{
+		out.clear();
+
+		if(!expect('"'))
+			return false;
+
+		while(i < s.size() && s[i] != '"')
+		{
+			if(s[i] != '\\')
+			{
+				out += s[i++];
+				continue;
+			}
+
+			if(++i == s.size())
+				break;
+
+			switch(s[i++])
+			{
+				case '"': out += '"'; break;
+				case '\\': out += '\\'; break;
+				case '/': out += '/'; break;
+				case 'b': out += '\b'; break;
+				case 'f': out += '\f'; break;
+				case 'n': out += '\n'; break;
+				case 'r': out += '\r'; break;
+				case 't': out += '\t'; break;
+				case 'u':
+				{
+					unsigned long cp;
+					if(!hex4(cp))
+						return (error = "bad \\u escape").empty();
+					// a surrogate pair is one code point
+					if(cp >= 0xD800 && cp < 0xDC00 && s.compare(i, 2, "\\u") == 0)
+					{
+						unsigned long lo;
+						i += 2;
+						if(!hex4(lo) || lo < 0xDC00 || lo >= 0xE000)
+							return (error = "bad surrogate pair").empty();
+						cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+					}
+					put_utf8(out, cp);
+					break;
+				}
+				default:
+					return (error = "bad escape").empty();
+			}
+		}
+
+		if(i == s.size())
+			return (error = "unterminated string").empty();
+
+		++i;
+		return true;
+	}
+
+	bool strings(str_vec& out)
+	{
+		if(!expect('['))
+			return false;
+		if(peek(']'))
+			return expect(']');
+		do
+		{
+			out.emplace_back();
+			if(!string(out.back()))
+				return false;
+		}
+		while(peek(',') && expect(','));
+		return expect(']');
+	}
+
+	// anything we don't use
+	bool skip()
+	{
+		ws();
+		if(i == s.size())
+			return (error = "expected a value").empty();
+
+		if(s[i] == '"')
+		{
+			str ignore;
+			return string(ignore);
+		}
+
+		if(s[i] == '[' || s[i] == '{')
+		{
+			const char close = s[i] == '[' ? ']' : '}';
+			++i;
+			if(peek(close))
+				return expect(close);
+			do
+			{
+				if(close == '}')
+				{
+					str ignore;
+					if(!string(ignore) || !expect(':'))
+						return false;
+				}
+				if(!skip())
+					return false;
+			}
+			while(peek(',') && expect(','));
+			return expect(close);
+		}
+
+		// number, true, false or null
+		const siz start = i;
+		while(i < s.size() && (std::isalnum((unsigned char)s[i]) || s[i] == '-' || s[i] == '+' || s[i] == '.'))
+			++i;
+		if(i == start)
+			return (error = "bad value").empty();
+		return true;
+	}
+};
+
+BulkReader::BulkReader(std::istream& is, bulk_format format)
+: is(is), format(format)
+{
+}
+
+bool BulkReader::parse_tsv(const str& line, bulk_record& rec)
+{
+	str_vec fields = unescape_fields(line);
+
+	if(fields.size() < 2 || fields.size() > 3)
+		return (error = "expected <key> TAB <fact> (TAB <groups>)?").empty();
+
+	rec.key = fields[0];
+
+	if(!fields[1].empty())
+		rec.facts.push_back(fields[1]);
+
+	if(fields.size() == 3)
+	{
+		siz pos = 0;
+		for(siz end; pos <= fields[2].size(); pos = end + 1)
+		{
+			end = std::min(fields[2].find(',', pos), fields[2].size());
+			str group = trim(fields[2].substr(pos, end - pos));
+			if(!group.empty())
+				rec.groups.insert(group);
+		}
+	}
+
+	return true;
+}
+
+bool BulkReader::parse_jsonl(const str& line, bulk_record& rec)
+{
+	json_parser json(line);
+
+	auto fail = [&]
+	{
+		error = json.error;
+		return false;
+	};
+
+	if(!json.expect('{'))
+		return fail();
+
+	if(!json.peek('}'))
+	{
+		do
+		{
+			str name;
+			if(!json.string(name) || !json.expect(':'))
+				return fail();
+
+			if(name == "key")
+			{
+				if(!json.string(rec.key))
+					return fail();
+			}
+			else if(name == "fact")
+			{
+				rec.facts.emplace_back();
+				if(!json.string(rec.facts.back()))
+					return fail();
+			}
+			else if(name == "facts")
+			{
+				if(!json.strings(rec.facts))
+					return fail();
+			}
+			else if(name == "groups")
+			{
+				str_vec groups;
+				if(!json.strings(groups))
+					return fail();
+				rec.groups.insert(groups.begin(), groups.end());
+			}
+			else if(!json.skip())
+				return fail();
+		}
+		while(json.peek(',') && json.expect(','));
+	}
+
+	if(!json.expect('}'))
+		return fail();
+
+	if(!json.at_end())
+		return (error = "text after the object").empty();
+
+	// as !addfact would have them
+	rec.facts.erase(std::remove_if(rec.facts.begin(), rec.facts.end(), [](const str& fact)
+	{
+		return trim(fact).empty();
+	}), rec.facts.end());
+
+	return true;
+}
+
+bool BulkReader::next(bulk_record& rec)
+{
+	str line;
+
+	while(std::getline(is, line))
+	{
+		++line_number;
+
+		if(!line.empty() && line.back() == '\r')
+			line.pop_back();
+
+		if(trim(line).empty() || (format == bulk_format::tsv && line[0] == '#'))
+			continue;
+
+		rec.key.clear();
+		rec.facts.clear();
+		rec.groups.clear();
+
+		if(!(format == bulk_format::tsv ? parse_tsv(line, rec) : parse_jsonl(line, rec)))
+		{
+			error = "line " + std::to_string(line_number) + ": " + error;
+			return false;
+		}
+
+		if(!is_key(rec.key))
+		{
+			error = "line " + std::to_string(line_number) + ": bad key: '" + rec.key + "'";
+			return false;
+		}
+
+		return true;
+	}
+
+	if(is.bad())
+		error = "error reading line " + std::to_string(line_number + 1);
+
+	return false;
+}
+
+BulkWriter::BulkWriter(std::ostream& os, bulk_format format)
+: os(os), format(format)
+{
+}
+
+void BulkWriter::write(const str& key, const str_vec& facts, const str_set& groups)
+{
+	str out;
+
+	if(format == bulk_format::jsonl)
+	{
+		out += "{\"key\": ";
+		json_escape(out, key);
+
+		str sep;
+		out += ", \"facts\": [";
+		for(auto&& fact: facts)
+		{
+			out += sep;
+			json_escape(out, fact);
+			sep = ", ";
+		}
+
+		sep.clear();
+		out += "], \"groups\": [";
+		for(auto&& group: groups)
+		{
+			out += sep;
+			json_escape(out, group);
+			sep = ", ";
+		}
+		out += "]}\n";
+	}
+	else
+	{
+		str group_list, sep;
+		for(auto&& group: groups)
+		{
+			group_list += sep;
+			escape(group_list, group);
+			sep = ",";
+		}
+
+		str k;
+		escape(k, key);
+
+		// the groups go with the first line
+		if(facts.empty() && !groups.empty())
+			out += k + "\t\t" + group_list + "\n";
+
+		for(siz i = 0; i < facts.size(); ++i)
+		{
+			out += k;
+			out += '\t';
+			escape(out, facts[i]);
+			if(!i && !groups.empty())
+				out += '\t' + group_list;
+			out += '\n';
+		}
+	}
+
+	os << out;
+}
+
+BulkSorter::BulkSorter(const str& prefix, siz max_facts)
+: prefix(prefix), max_facts(std::max<siz>(max_facts, 1))
+{
+}
+
+BulkSorter::~BulkSorter()
+{
+	for(auto&& run: runs)
+		std::remove(run.c_str());
+}
+
+// sort records by key, joining the records of each key in order
+static void sort_records(std::vector<bulk_record>& records)
+{
+	std::stable_sort(records.begin(), records.end(), [](const bulk_record& a, const bulk_record& b)
+	{
+		return a.key < b.key;
+	});
+
+	siz out = 0;
+	for(siz i = 0; i < records.size(); ++i)
+	{
+		if(out && records[out - 1].key == records[i].key)
+		{
+			auto& rec = records[out - 1];
+			rec.facts.insert(rec.facts.end()
+				, std::make_move_iterator(records[i].facts.begin())
+				, std::make_move_iterator(records[i].facts.end()));
+			rec.groups.insert(records[i].groups.begin(), records[i].groups.end());
+		}
+		else if(out++ != i)
+			records[out - 1] = std::move(records[i]);
+	}
+
+	records.resize(out);
+}
+
+bool BulkSorter::spill()
+{
+	sort_records(records);
+
+	const str file = prefix + "." + std::to_string(runs.size());
+	runs.push_back(file);
+
+	std::ofstream ofs(file, std::ios::trunc);
+	BulkWriter writer(ofs, bulk_format::tsv);
+
+	for(auto&& rec: records)
+		writer.write(rec.key, rec.facts, rec.groups);
+
+	if(!ofs.flush())
+	{
+		error = "can not write: " + file;
+		return false;
+	}
+
+	records.clear();
+	facts = 0;
+
+	return true;
+}
+
+bool BulkSorter::add(bulk_record&& rec)
+{
+	facts += std::max<siz>(rec.facts.size(), 1);
+	records.push_back(std::move(rec));
+
+	if(facts >= max_facts)
+		return spill();
+
+	return true;
+}
+
+namespace {
+
+// a sorted run on disk, one record per key
+struct run_file
+{
+	std::ifstream ifs;
+	BulkReader reader;
+	bulk_record line; // read ahead
+	bool have_line = false;
+	bulk_record rec;
+	bool have_rec = false;
+
+	explicit run_file(const str& file)
+	: ifs(file), reader(ifs, bulk_format::tsv)
+	{
+		have_line = reader.next(line);
+	}
+
+	// join the lines of the next key
+	bool next()
+	{
+		have_rec = have_line;
+		if(!have_rec)
+			return reader.error.empty();
+
+		rec = std::move(line);
+		while((have_line = reader.next(line)) && line.key == rec.key)
+		{
+			rec.facts.insert(rec.facts.end(), line.facts.begin(), line.facts.end());
+			rec.groups.insert(line.groups.begin(), line.groups.end());
+		}
+
+		return reader.error.empty();
+	}
+};
+
+} // anonymous
+
+bool BulkSorter::merge(const visitor& visit)
+{
+	sort_records(records);
+
+	if(runs.empty())
+	{
+		for(auto&& rec: records)
+			if(!visit(rec))
+				break;
+		return true;
+	}
+
+	std::vector<std::unique_ptr<run_file>> files;
+	for(auto&& run: runs)
+	{
+		files.emplace_back(new run_file(run));
+		if(!files.back()->ifs || !files.back()->next())
+		{
+			error = "can not read: " + run + ": " + files.back()->reader.error;
+			return false;
+		}
+	}
+
+	auto mem = records.begin(); // the newest run
+
+	bulk_record rec;
+
+	for(;;)
+	{
+		const str* key = nullptr;
+
+		for(auto&& f: files)
+			if(f->have_rec && (!key || f->rec.key < *key))
+				key = &f->rec.key;
+		if(mem != records.end() && (!key || mem->key < *key))
+			key = &mem->key;
+
+		if(!key)
+			break;
+
+		rec.key = *key;
+		rec.facts.clear();
+		rec.groups.clear();
+
+		// oldest first so the facts keep their input order
+		for(siz i = 0; i < files.size(); ++i)
+		{
+			auto& f = *files[i];
+			if(!f.have_rec || f.rec.key != rec.key)
+				continue;
+
+			rec.facts.insert(rec.facts.end(), f.rec.facts.begin(), f.rec.facts.end());
+			rec.groups.insert(f.rec.groups.begin(), f.rec.groups.end());
+
+			if(!f.next())
+			{
+				error = "can not read: " + runs[i] + ": " + f.reader.error;
+				return false;
+			}
+		}
+
+		if(mem != records.end() && mem->key == rec.key)
+		{
+			rec.facts.insert(rec.facts.end(), mem->facts.begin(), mem->facts.end());
+			rec.groups.insert(mem->groups.begin(), mem->groups.end());
+			++mem;
+		}
+
+		if(!visit(rec))
+			break;
+	}
+
+	return true;
+}
+
+}} // skivvy::factoid
@@ -0,0 +1,351 @@
+/*
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+
+#include <skivvy/factoid-codec.h>
+
+#include <cstring>
+#include <algorithm>
+
+namespace skivvy { namespace factoid {
+
+const siz FactCodec::max_dict;
+
+static const siz min_match = 4;
+static const siz max_offset = 0xFFFF;
+static const unsigned dict_bits = 15; // of the dictionary's hash table
+static const unsigned text_bits = 12; // at most, of the text's
+
+static std::uint32_t read32(const char* p)
+{
+	std::uint32_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static std::uint32_t hash4(const char* p, unsigned bits)
+{
+	return (read32(p) * 2654435761U) >> (32 - bits);
+}
+
+static siz common(const char* a, const char* b, siz max)
+{
+	siz n = 0;
+	while(n < max && a[n] == b[n])
+		++n;
+	return n;
+}
+
+static void put_varint(str& out, std::uint64_t v)
+{
+	for(; v >= 0x80; v >>= 7)
+		out += char(v | 0x80);
+	out += char(v);
+}
+
+static bool get_varint(const char*& p, const char* end, std::uint64_t& v)
+{
+	v = 0;
+	for(unsigned shift = 0; p != end && shift < 64; shift += 7)
+	{
+		const unsigned char b = *p++;
+		v |= std::uint64_t(b & 0x7F) << shift;
+		if(!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+// the part of a length that does not fit in the token
+static void put_length(str& out, siz n)
+{
+	for(; n >= 255; n -= 255)
+		out += char(255);
+	out += char(n);
+}
+
+static bool get_length(const char*& p, const char* end, siz& n)
+{
+	unsigned char b;
+	do
+	{
+		if(p == end)
+			return false;
+		b = *p++;
+		n += b;
+	}
+	while(b == 255);
+
+	return true;
+}
+
+/**
+ * Literals followed by a match (unless match_len is 0).
+ */
+static void put_sequence(str& out, const char* lit, siz lit_len, siz match_len, siz offset)
+{
+	const siz extra = match_len ? match_len - min_match : 0;
+
+	out += char((std::min<siz>(lit_len, 15) << 4) | std::min<siz>(extra, 15));
+	if(lit_len >= 15)
+		put_length(out, lit_len - 15);
+	out.append(lit, lit_len);
+
+	if(!match_len)
+		return;
+
+	out += char(offset & 0xFF);
+	out += char(offset >> 8);
+	if(extra >= 15)
+		put_length(out, extra - 15);
+}
+
+FactCodec::FactCodec(str_view dict)
+: dict(dict.substr(0, max_dict).to_string())
+, dict_table(siz(1) << dict_bits)
+{
+	for(siz i = 0; i + min_match <= this->dict.size(); ++i)
+		dict_table[hash4(this->dict.data() + i, dict_bits)] = std::uint32_t(i + 1);
+}
+
+str FactCodec::train(const std::vector<str_view>& samples, siz size)
+{
+	size = std::min(size, max_dict);
+
+	const unsigned bits = 16;
+	const siz gram = 8;
+	const siz piece = 64; // the dictionary is made of pieces this long
+	const siz budget = siz(1) << 23; // bytes of samples to look at
+
+	siz total = 0;
+	for(auto&& s: samples)
+		total += s.size();
+
+	const siz stride = std::max<siz>(1, total / budget);
+
+	auto hash = [](const char* p)
+	{
+		std::uint64_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return siz((v * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+	};
+
+	// how often each run of gram bytes turns up
+	std::vector<std::uint32_t> counts(siz(1) << bits);
+	std::vector<str_view> pieces;
+
+	for(siz s = 0; s < samples.size(); s += stride)
+	{
+		const str_view text = samples[s];
+		for(siz i = 0; i + gram <= text.size(); ++i)
+			++counts[hash(text.data() + i)];
+		for(siz i = 0; i < text.size(); i += piece)
+			pieces.push_back(text.substr(i, piece));
+	}
+
+	// roughly the bytes a piece would save
+	auto score = [&](str_view v)
+	{
+		siz sc = 0;
+		for(siz i = 0; i + gram <= v.size(); ++i)
+		{
+			const std::uint32_t c = counts[hash(v.data() + i)];
+			sc += c > 1 ? c - 1 : 0;
+		}
+		return sc;
+	};
+
+	std::vector<std::pair<siz, str_view>> ranked;
+	for(auto&& p: pieces)
+		if(siz sc = score(p))
+			ranked.emplace_back(sc, p);
+
+	std::sort(ranked.begin(), ranked.end(), [](const std::pair<siz, str_view>& a
+		, const std::pair<siz, str_view>& b){ return a.first > b.first; });
+
+	str dict;
+
+	for(auto&& r: ranked)
+	{
+		if(dict.size() >= size)
+			break;
+
+		// text already taken no longer counts, and
+		// each run must be worth having twice over
+		const str_view p = r.second.substr(0, size - dict.size());
+		if(p.size() < gram || score(p) < p.size() - gram + 1)
+			continue;
+
+		dict.append(p.data(), p.size());
+
+		for(siz i = 0; i + gram <= p.size(); ++i)
+			counts[hash(p.data() + i)] = 0;
+	}
+
+	return dict;
+}
+
+void FactCodec::compress(str_view text, str& out) const
+{
+	const char* p = text.data();
+	const siz n = text.size();
+
+	put_varint(out, n);
+
+	// short texts get a small table
+	unsigned bits = 4;
+	while(bits < text_bits && (siz(1) << bits) < n)
+		++bits;
+
+	std::uint32_t table[1 << text_bits]; // hash of 4 bytes -> position + 1
+	std::fill(table, table + (1 << bits), 0);
+
+	siz anchor = 0; // literals start here
+
+	for(siz i = 0; i + min_match <= n;)
+	{
+		siz best = 0;
+		siz offset = 0;
+
+		std::uint32_t& slot = table[hash4(p + i, bits)];
+		if(slot)
+		{
+			const siz c = slot - 1;
+			if(i - c <= max_offset && read32(p + c) == read32(p + i))
+			{
+				best = min_match + common(p + c + min_match, p + i + min_match, n - i - min_match);
+				offset = i - c;
+			}
+		}
+		slot = std::uint32_t(i + 1);
+
+		if(!dict_table.empty())
+		{
+			const std::uint32_t d = dict_table[hash4(p + i, dict_bits)];
+			const siz c = d - 1;
+			if(d && i + dict.size() - c <= max_offset && read32(dict.data() + c) == read32(p + i))
+			{
+				// matches stop at the end of the dictionary
+				const siz len = min_match + common(dict.data() + c + min_match, p + i + min_match
+					, std::min(dict.size() - c, n - i) - min_match);
+				if(len > best)
+				{
+					best = len;
+					offset = i + dict.size() - c;
+				}
+			}
+		}
+
+		if(!best)
+		{
+			++i;
+			continue;
+		}
+
+		put_sequence(out, p + anchor, i - anchor, best, offset);
+		i += best;
+		anchor = i;
+	}
+
+	if(anchor < n)
+		put_sequence(out, p + anchor, n - anchor, 0, 0);
+}
+
+bool FactCodec::decompress(str_view data, str& out) const
+{
+	const char* p = data.data();
+	const char* end = p + data.size();
+
+	std::uint64_t len;
+	if(!get_varint(p, end, len) || len > (std::uint64_t(1) << 31))
+		return false;
+
+	const siz base = out.size();
+	out.resize(base + len);
+
+	auto fail = [&]
+	{
+		out.resize(base);
+		return false;
+	};
+
+	char* o = &out[0] + base;
+	siz done = 0;
+
+	while(done < len)
+	{
+		if(p == end)
+			return fail();
+
+		const unsigned char token = *p++;
+
+		siz lit = token >> 4;
+		if(lit == 15 && !get_length(p, end, lit))
+			return fail();
+		if(lit > siz(end - p) || lit > len - done)
+			return fail();
+
+		std::memcpy(o + done, p, lit);
+		p += lit;
+		done += lit;
+
+		if(done == len)
+			break;
+
+		if(end - p < 2)
+			return fail();
+
+		const siz offset = siz((unsigned char)p[0]) | siz((unsigned char)p[1]) << 8;
+		p += 2;
+
+		siz match = token & 15;
+		if(match == 15 && !get_length(p, end, match))
+			return fail();
+		match += min_match;
+
+		if(!offset || offset > done + dict.size() || match > len - done)
+			return fail();
+
+		// the part of the match in the dictionary
+		if(offset > done)
+		{
+			const siz n = std::min(match, offset - done);
+			std::memcpy(o + done, dict.data() + dict.size() - (offset - done), n);
+			done += n;
+			match -= n;
+		}
+
+		// byte by byte as it may overlap itself
+		for(; match; --match, ++done)
+			o[done] = o[done - offset];
+	}
+
+	return p == end ? true : fail();
+}
+
+}} // skivvy::factoid
@@ -0,0 +1,215 @@
+/*
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <skivvy/factoid-command.h>
+
+namespace skivvy { namespace factoid {
+
+const siz view_list::room;
+const uns fact_command::noline;
+
+static bool is_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static str_view trim(str_view v)
+{
+	while(!v.empty() && is_space(v.front()))
+		v.remove_prefix(1);
+	while(!v.empty() && is_space(v.back()))
+		v.remove_suffix(1);
+	return v;
+}
+
+void view_list::push_back(str_view v)
+{
+	if(count < room)
+	{
+		first[count++] = v;
+		return;
+	}
+
+	if(count == room)
+		more.assign(first, first + room);
+
+	more.push_back(v);
+	++count;
+}
+
+void CommandParser::skip_space()
+{
+	while(!rest.empty() && is_space(rest.front()))
+		rest.remove_prefix(1);
+}
+
+bool CommandParser::done()
+{
+	skip_space();
+	return rest.empty();
+}
+
+str_view CommandParser::word()
+{
+	skip_space();
+
+	siz n = 0;
+	while(n < rest.size() && !is_space(rest[n]))
+		++n;
+
+	str_view w = rest.substr(0, n);
+	rest.remove_prefix(n);
+	return w;
+}
+
+static void split(str_view list, view_list& groups)
+{
+	while(!list.empty())
+	{
+		siz comma = list.find(',');
+		str_view group = trim(list.substr(0, comma));
+		if(!group.empty())
+			groups.push_back(group);
+		list.remove_prefix(comma == str_view::npos ? list.size() : comma + 1);
+	}
+}
+
+bool CommandParser::group_list(view_list& groups)
+{
+	skip_space();
+
+	if(rest.empty() || rest.front() != '[')
+		return true;
+
+	siz close = rest.find(']');
+	if(close == str_view::npos)
+		return false;
+
+	split(rest.substr(1, close - 1), groups);
+	rest.remove_prefix(close + 1);
+
+	return true;
+}
+
+void CommandParser::comma_list(view_list& groups)
+{
+	split(rest, groups);
+	rest = {};
+}
+
+str_view CommandParser::tail()
+{
+	str_view t = trim(rest);
+	rest = {};
+	return t;
+}
+
+bool parse_command(str_view params, command_syntax syntax, fact_command& cmd)
+{
+	CommandParser p(params);
+
+	if(syntax == command_syntax::nick_keys && (cmd.nick = p.word()).empty())
+		return false;
+
+	switch(syntax)
+	{
+		case command_syntax::key_groups:
+		case command_syntax::bare_text:
+			break;
+		default:
+			if(!p.group_list(cmd.groups))
+				return false;
+	}
+
+	switch(syntax)
+	{
+		case command_syntax::key_text:
+			cmd.keys.push_back(p.word());
+			cmd.text = p.tail();
+			return !cmd.keys[0].empty() && !cmd.text.empty();
+
+		case command_syntax::key_groups:
+			cmd.keys.push_back(p.word());
+			p.comma_list(cmd.groups);
+			return !cmd.keys[0].empty() && !cmd.groups.empty();
+
+		case command_syntax::key_line:
+		{
+			cmd.keys.push_back(p.word());
+			if(cmd.keys[0].empty())
+				return false;
+
+			// #n where n > 0
+			str_view idx = p.word();
+			if(idx.empty())
+				return true;
+
+			cmd.text = idx;
+
+			if(idx.size() < 2 || idx.size() > 10 || idx[0] != '#')
+				return false;
+
+			std::uint64_t n = 0;
+			for(siz i = 1; i < idx.size(); ++i)
+			{
+				if(idx[i] < '0' || idx[i] > '9')
+					return false;
+				n = n * 10 + (idx[i] - '0');
+			}
+
+			if(!n || n >= fact_command::noline)
+				return false;
+
+			cmd.line = uns(n);
+			return true;
+		}
+
+		case command_syntax::text:
+		case command_syntax::bare_text:
+			cmd.text = p.tail();
+			return !cmd.text.empty();
+
+		case command_syntax::keys:
+		case command_syntax::nick_keys:
+			for(str_view key; !(key = p.word()).empty();)
+				cmd.keys.push_back(key);
+			return !cmd.keys.empty();
+	}
+
+	return false;
+}
+
+str_set to_set(const view_list& views)
+{
+	str_set set;
+	for(auto&& v: views)
+		set.insert(v.to_string());
+	return set;
+}
+
+}} // skivvy::factoid
@@ -0,0 +1,92 @@
+/*
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <skivvy/factoid-history.h>
+
+namespace skivvy { namespace factoid {
+
+void FactHistory::trim(clock::time_point now)
+{
+	while(!entries.empty() && (entries.size() > max_entries || entries.front().when + max_age < now))
+	{
+		// the state before it went with it
+		since = entries.front().when;
+		entries.pop_front();
+	}
+
+	if(since + max_age < now)
+		since = now - max_age;
+}
+
+void FactHistory::set_limits(siz max_entries, std::chrono::seconds max_age)
+{
+	this->max_entries = max_entries;
+	this->max_age = max_age;
+	trim(clock::now());
+}
+
+void FactHistory::record(const str& key, std::shared_ptr<const str_vec> facts, const str_set& groups
+	, clock::time_point when)
+{
+	entries.push_back({when, key, std::move(facts), groups});
+	trim(when);
+}
+
+bool FactHistory::undo(const str& key, std::shared_ptr<const str_vec> facts, const str_set& groups
+	, entry& e, clock::time_point when)
+{
+	auto found = entries.rbegin();
+	for(; found != entries.rend(); ++found)
+		if(!found->undone && found->key == key)
+			break;
+
+	if(found == entries.rend())
+		return false;
+
+	found->undone = true;
+	e = *found;
+
+	// recorded so the history still says what key was until now
+	entries.push_back({when, key, std::move(facts), groups, true});
+	trim(when);
+
+	return true;
+}
+
+const FactHistory::entry* FactHistory::find_after(const str& key, clock::time_point when) const
+{
+	// the wall clock may have been put back so the edits
+	// are in the order made but not always in time order
+	for(auto&& e: entries)
+		if(e.key == key && e.when > when)
+			return &e;
+
+	return nullptr;
+}
+
+}} // skivvy::factoid
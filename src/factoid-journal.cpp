@@ -0,0 +1,289 @@
+/*
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <skivvy/factoid-journal.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <sookee/log.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::log;
+
+static void escape(str& out, const str& s)
+{
+	for(char c: s)
+	{
+		switch(c)
+		{
+			case '\\': out += "\\\\"; break;
+			case '\t': out += "\\t"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			default: out += c;
+		}
+	}
+}
+
+// split one record line into its unescaped fields
+static str_vec unescape_fields(const str& line)
+{
+	str_vec fields(1);
+
+	for(siz i = 0; i < line.size(); ++i)
+	{
+		if(line[i] == '\t')
+			fields.emplace_back();
+		else if(line[i] == '\\' && i + 1 < line.size())
+		{
+			switch(line[++i])
+			{
+				case 't': fields.back() += '\t'; break;
+				case 'n': fields.back() += '\n'; break;
+				case 'r': fields.back() += '\r'; break;
+				default: fields.back() += line[i];
+			}
+		}
+		else
+			fields.back() += line[i];
+	}
+
+	return fields;
+}
+
+static bool write_all(int fd, const str& data)
+{
+	for(siz done = 0; done < data.size();)
+	{
+		ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		done += siz(n);
+	}
+	return true;
+}
+
+FactoidJournal::FactoidJournal(const str& file, std::chrono::milliseconds sync_interval
+	, std::chrono::seconds compact_interval, compactor compact)
+: file(file)
+, sync_interval(sync_interval)
+, compact_interval(compact_interval)
+, compact(compact)
+{
+}
+
+FactoidJournal::~FactoidJournal()
+{
+	if(thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			done = true;
+		}
+		cv.notify_all();
+		thread.join();
+	}
+
+	if(fd != -1)
+		::close(fd);
+}
+
+bool FactoidJournal::open(const applier& apply)
+{
+	fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+	if(fd == -1)
+	{
+		error = "can not open journal: " + file + ": " + std::strerror(errno);
+		return false;
+	}
+
+	str data;
+	char buf[65536];
+	for(ssize_t n; (n = ::read(fd, buf, sizeof(buf))) != 0;)
+	{
+		if(n < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			error = "can not read journal: " + file + ": " + std::strerror(errno);
+			return false;
+		}
+		data.append(buf, siz(n));
+	}
+
+	siz good = 0; // end of the last complete record
+	for(siz end; (end = data.find('\n', good)) != str::npos; good = end + 1)
+	{
+		str_vec fields = unescape_fields(data.substr(good, end - good));
+
+		if(fields.size() < 2 || fields[0].size() != 1 || !std::strchr("FG", fields[0][0]))
+		{
+			log("WARN: skipping bad journal record in: " + file);
+			continue;
+		}
+
+		const char type = fields[0][0];
+		const str key = fields[1];
+		fields.erase(fields.begin(), fields.begin() + 2);
+
+		apply(type, key, fields);
+		(type == 'F' ? dirty_facts : dirty_groups)[key] = std::move(fields);
+	}
+
+	if(good < data.size())
+	{
+		log("WARN: dropping torn journal record in: " + file);
+		if(::ftruncate(fd, off_t(good)) == -1)
+		{
+			error = "can not truncate journal: " + file + ": " + std::strerror(errno);
+			return false;
+		}
+	}
+
+	thread = std::thread([this]{ run(); });
+
+	return true;
+}
+
+void FactoidJournal::record(char type, const str& key, const str_vec& values)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	pending += type;
+	pending += '\t';
+	escape(pending, key);
+	for(auto&& v: values)
+	{
+		pending += '\t';
+		escape(pending, v);
+	}
+	pending += '\n';
+
+	(type == 'F' ? dirty_facts : dirty_groups)[key] = values;
+}
+
+void FactoidJournal::set_facts(const str& key, const str_vec& facts)
+{
+	record('F', key, facts);
+}
+
+void FactoidJournal::set_groups(const str& key, const str_set& groups)
+{
+	record('G', key, str_vec(groups.begin(), groups.end()));
+}
+
+void FactoidJournal::sync()
+{
+	if(!thread.joinable())
+		return;
+
+	std::unique_lock<std::mutex> lock(mtx);
+	const auto wanted = ++sync_requests;
+	cv.notify_all();
+	synced_cv.wait(lock, [&]{ return syncs_done >= wanted; });
+}
+
+void FactoidJournal::run()
+{
+	auto last_compact = clock::now();
+
+	std::unique_lock<std::mutex> lock(mtx);
+
+	while(!done)
+	{
+		cv.wait_for(lock, sync_interval, [&]{ return done || sync_requests > syncs_done; });
+
+		const auto requests = sync_requests;
+		const bool compact_now = done || requests > syncs_done
+			|| clock::now() - last_compact >= compact_interval;
+
+		flush(lock, compact_now);
+
+		if(compact_now)
+			last_compact = clock::now();
+
+		syncs_done = requests;
+		synced_cv.notify_all();
+	}
+}
+
+// called with lock held, releases it while doing I/O
+void FactoidJournal::flush(std::unique_lock<std::mutex>& lock, bool compact_now)
+{
+	str records;
+	records.swap(pending);
+
+	key_values facts;
+	key_values groups;
+
+	if(compact_now)
+	{
+		facts.swap(dirty_facts);
+		groups.swap(dirty_groups);
+	}
+
+	lock.unlock();
+
+	// one fsync for the whole batch
+	if(!records.empty() && (!write_all(fd, records) || ::fdatasync(fd) == -1))
+		log("ERROR: writing journal: " + file + ": " + std::strerror(errno));
+
+	bool compacted = true;
+
+	// the log can only go once everything in it is in the store
+	if(!facts.empty() || !groups.empty())
+	{
+		if(!(compacted = compact(facts, groups)))
+			log("ERROR: compacting journal: " + file);
+		else if(::ftruncate(fd, 0) == -1)
+			log("ERROR: truncating journal: " + file + ": " + std::strerror(errno));
+	}
+
+	lock.lock();
+
+	// still only in the log so try again with the next
+	// compaction, unless the key has been edited since
+	if(!compacted)
+	{
+		dirty_facts.insert(facts.begin(), facts.end());
+		dirty_groups.insert(groups.begin(), groups.end());
+	}
+}
+
+}} // skivvy::factoid
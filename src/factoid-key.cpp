@@ -0,0 +1,335 @@
+/*
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+
+#include <skivvy/factoid-key.h>
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace skivvy { namespace factoid {
+
+/**
+ * The simple case folding of code point c. Every letter
+ * folds to one that takes as many bytes in UTF-8.
+ */
+static char32_t fold_char(char32_t c)
+{
+	if(c < 0x80)
+		return c >= 'A' && c <= 'Z' ? c + 0x20 : c;
+
+	// Latin-1 (the micro sign folds to mu)
+	if(c < 0x100)
+	{
+		if(c == 0xB5)
+			return 0x3BC;
+		return c >= 0xC0 && c <= 0xDE && c != 0xD7 ? c + 0x20 : c;
+	}
+
+	// Latin Extended-A, mostly upper and lower in pairs (U+0130
+	// folds to two characters and U+017F to one byte so they
+	// stay as they are)
+	if(c < 0x180)
+	{
+		if(c < 0x130 || (c >= 0x132 && c < 0x138) || (c >= 0x14A && c < 0x178))
+			return c % 2 ? c : c + 1;
+		if((c >= 0x139 && c < 0x149) || (c >= 0x179 && c < 0x17F))
+			return c % 2 ? c + 1 : c;
+		return c == 0x178 ? 0xFF : c;
+	}
+
+	// Greek and Coptic
+	if(c >= 0x370 && c < 0x400)
+	{
+		if(c >= 0x391 && c <= 0x3AB && c != 0x3A2)
+			return c + 0x20;
+		if(c < 0x374 || c == 0x376 || (c >= 0x3D8 && c < 0x3F0))
+			return c % 2 ? c : c + 1;
+		if(c == 0x386)
+			return 0x3AC;
+		if(c >= 0x388 && c <= 0x38A)
+			return c + 0x25;
+		if(c == 0x38C)
+			return 0x3CC;
+		if(c == 0x38E || c == 0x38F)
+			return c + 0x3F;
+		if(c >= 0x3FD)
+			return c - 0x82;
+		switch(c)
+		{
+			case 0x37F: return 0x3F3;
+			case 0x3C2: return 0x3C3; // final sigma
+			case 0x3CF: return 0x3D7;
+			// letter variants fold to the letter
+			case 0x3D0: return 0x3B2;
+			case 0x3D1: return 0x3B8;
+			case 0x3D5: return 0x3C6;
+			case 0x3D6: return 0x3C0;
+			case 0x3F0: return 0x3BA;
+			case 0x3F1: return 0x3C1;
+			case 0x3F4: return 0x3B8;
+			case 0x3F5: return 0x3B5;
+			case 0x3F7: return 0x3F8;
+			case 0x3F9: return 0x3F2;
+			case 0x3FA: return 0x3FB;
+		}
+		return c;
+	}
+
+	// combining ypogegrammeni folds to iota
+	if(c == 0x345)
+		return 0x3B9;
+
+	// Cyrillic
+	if(c >= 0x400 && c < 0x530)
+	{
+		if(c < 0x410)
+			return c + 0x50;
+		if(c < 0x430)
+			return c + 0x20;
+		if((c >= 0x460 && c < 0x482) || (c >= 0x48A && c < 0x4C0) || (c >= 0x4D0 && c < 0x530))
+			return c % 2 ? c : c + 1;
+		if(c >= 0x4C1 && c < 0x4CF)
+			return c % 2 ? c + 1 : c;
+		return c == 0x4C0 ? 0x4CF : c;
+	}
+
+	// Armenian
+	if(c >= 0x531 && c <= 0x556)
+		return c + 0x30;
+
+	// Latin Extended Additional
+	if((c >= 0x1E00 && c < 0x1E96) || (c >= 0x1EA0 && c < 0x1F00))
+		return c % 2 ? c : c + 1;
+	if(c == 0x1E9B) // long s with dot above (U+1E9E folds to two bytes)
+		return 0x1E61;
+
+	// Greek Extended, capitals are 8 after their small letters
+	// (U+1FBE folds to a two byte iota so stays as it is)
+	if(c >= 0x1F00 && c < 0x2000)
+	{
+		if(c < 0x1F70 || (c >= 0x1F80 && c < 0x1FB0))
+		{
+			if((c & 0xF) < 8)
+				return c;
+			const char32_t f = c - 8;
+			// small letters with no capitals
+			if((c >= 0x1F18 && c < 0x1F20) || (c >= 0x1F48 && c < 0x1F50))
+				return (c & 0xF) < 0xE ? f : c;
+			if(c >= 0x1F58 && c < 0x1F60)
+				return c % 2 ? f : c;
+			return f;
+		}
+		switch(c)
+		{
+			case 0x1FB8: case 0x1FB9: case 0x1FD8: case 0x1FD9: case 0x1FE8: case 0x1FE9:
+				return c - 8;
+			case 0x1FBA: case 0x1FBB: return c - 0x4A;
+			case 0x1FC8: case 0x1FC9: case 0x1FCA: case 0x1FCB: return c - 0x56;
+			case 0x1FDA: case 0x1FDB: return c - 0x64;
+			case 0x1FEA: case 0x1FEB: return c - 0x70;
+			case 0x1FF8: case 0x1FF9: return c - 0x80;
+			case 0x1FFA: case 0x1FFB: return c - 0x7E;
+			case 0x1FEC: return 0x1FE5;
+			case 0x1FBC: case 0x1FCC: case 0x1FFC: return c - 9;
+		}
+		return c;
+	}
+
+	// fullwidth A-Z
+	if(c >= 0xFF21 && c <= 0xFF3A)
+		return c + 0x20;
+
+	return c;
+}
+
+/**
+ * Fold the UTF-8 character at p, with n bytes left, into out
+ * (which may be p). A byte that does not start a valid
+ * character is copied as it is.
+ * @return The length of the character.
+ */
+static siz fold_at(const char* p, siz n, char* out)
+{
+	const unsigned char c = p[0];
+
+	if(c < 0x80)
+	{
+		out[0] = c >= 'A' && c <= 'Z' ? char(c + 0x20) : char(c);
+		return 1;
+	}
+
+	const siz len = c >= 0xF8 ? 1 : c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+
+	bool valid = len > 1 && len <= n;
+	for(siz i = 1; valid && i < len; ++i)
+		valid = (p[i] & 0xC0) == 0x80;
+
+	if(!valid)
+	{
+		out[0] = p[0];
+		return 1;
+	}
+
+	// nothing past the BMP folds
+	if(len == 4)
+	{
+		std::memmove(out, p, 4);
+		return 4;
+	}
+
+	if(len == 2)
+	{
+		const char32_t f = fold_char(((c & 0x1F) << 6) | (p[1] & 0x3F));
+		out[0] = char(0xC0 | (f >> 6));
+		out[1] = char(0x80 | (f & 0x3F));
+		return 2;
+	}
+
+	const char32_t f = fold_char(((c & 0x0F) << 12) | ((p[1] & 0x3F) << 6) | (p[2] & 0x3F));
+	out[0] = char(0xE0 | (f >> 12));
+	out[1] = char(0x80 | ((f >> 6) & 0x3F));
+	out[2] = char(0x80 | (f & 0x3F));
+	return 3;
+}
+
+#ifdef __SSE2__
+/**
+ * 0xFF in every byte of v that is 'A' to 'Z', 0 elsewhere.
+ * Bytes from 0x80 up compare as negative so are never picked.
+ */
+static __m128i upper_bytes(__m128i v)
+{
+	return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1))
+		, _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+}
+#endif
+
+/**
+ * Fold the n bytes at p in place.
+ */
+static void fold_chars(char* p, siz n)
+{
+	for(siz i = 0; i < n;)
+	{
+#ifdef __SSE2__
+		// a run of 16 ASCII bytes at once
+		if(n - i >= 16)
+		{
+			const __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+			if(!_mm_movemask_epi8(v))
+			{
+				const __m128i lower = _mm_or_si128(v, _mm_and_si128(upper_bytes(v), _mm_set1_epi8(0x20)));
+				_mm_storeu_si128((__m128i*)(p + i), lower);
+				i += 16;
+				continue;
+			}
+		}
+#endif
+		i += fold_at(p + i, n - i, p + i);
+	}
+}
+
+bool is_folded(str_view key)
+{
+	const char* p = key.data();
+	const siz n = key.size();
+
+	char buf[4];
+
+	for(siz i = 0; i < n;)
+	{
+#ifdef __SSE2__
+		if(n - i >= 16)
+		{
+			const __m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+			if(!_mm_movemask_epi8(v))
+			{
+				if(_mm_movemask_epi8(upper_bytes(v)))
+					return false;
+				i += 16;
+				continue;
+			}
+		}
+#endif
+		const siz len = fold_at(p + i, n - i, buf);
+		if(std::memcmp(buf, p + i, len))
+			return false;
+		i += len;
+	}
+
+	return true;
+}
+
+void fold_key(str_view key, str& folded)
+{
+	folded.assign(key.data(), key.size());
+	if(!folded.empty())
+		fold_chars(&folded[0], folded.size());
+}
+
+str fold_key(str_view key)
+{
+	str folded;
+	fold_key(key, folded);
+	return folded;
+}
+
+bool fold_key_in_place(str& key)
+{
+	if(is_folded(key))
+		return false;
+	fold_chars(&key[0], key.size());
+	return true;
+}
+
+std::uint64_t key_hash(str_view key)
+{
+	const char* p = key.data();
+	const siz n = key.size();
+
+	char buf[4];
+
+	// FNV-1a so keys hash alike whatever the build
+	std::uint64_t h = 14695981039346656037ULL;
+
+	for(siz i = 0; i < n;)
+	{
+		const siz len = fold_at(p + i, n - i, buf);
+		for(siz j = 0; j < len; ++j)
+			h = (h ^ (unsigned char)buf[j]) * 1099511628211ULL;
+		i += len;
+	}
+
+	return h;
+}
+
+}} // skivvy::factoid
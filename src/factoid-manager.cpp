@@ -0,0 +1,1770 @@
+/*
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <skivvy/factoid-manager.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include <sookee/str.h>
+#include <sookee/types/basic.h>
+#include <sookee/types/stream.h>
+
+#include <sookee/bug.h>
+#include <sookee/log.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::bug;
+using namespace sookee::log;
+using namespace sookee::types;
+
+using read_lock = std::shared_lock<std::shared_timed_mutex>;
+using data_lock = std::lock_guard<std::shared_timed_mutex>;
+using write_lock = std::lock_guard<std::mutex>;
+
+thread_local str FactoidManager::error;
+
+/**
+ * given as it is if it is already case folded,
+ * otherwise folded into buf.
+ */
+static const str& folded(const str& given, str& buf)
+{
+	if(is_folded(given))
+		return given;
+	fold_key(given, buf);
+	return buf;
+}
+
+str alias_of(str_view fact)
+{
+	str alias;
+	sgl(siss(fact.to_string()).ignore() >> std::ws, alias);
+	fold_key_in_place(alias);
+	return alias;
+}
+
+fact_lines::fact_lines(str_vec given)
+{
+	auto owned = std::make_shared<const str_vec>(std::move(given));
+	lines.assign(owned->begin(), owned->end());
+	pin = std::move(owned);
+}
+
+str_vec fact_lines::to_vec() const
+{
+	str_vec v;
+	v.reserve(lines.size());
+	for(auto&& line: lines)
+		v.emplace_back(line.data(), line.size());
+	return v;
+}
+
+void resolved_lines::resolve(const str& key, const lookup& find, siz max_depth)
+{
+	str_vec chain;
+	resolve(key, find, max_depth, 0, chain);
+}
+
+void resolved_lines::resolve(const str& key, const lookup& find, siz max_depth, siz depth, str_vec& chain)
+{
+	deps.insert(key);
+
+	fact_lines key_facts;
+	if(!find(key, key_facts))
+		return;
+
+	pins.push_back(key_facts.pin);
+
+	chain.push_back(key);
+
+	for(auto&& fact: key_facts)
+	{
+		if(fact.empty() || fact[0] != '=')
+		{
+			lines.push_back({key, fact, depth, false});
+			continue;
+		}
+
+		// follow a fact alias link: <fact2>: = <fact1>
+		const str alias = alias_of(fact);
+
+		if(std::find(chain.begin(), chain.end(), alias) != chain.end())
+		{
+			log("WARN: fact alias loop: " + key + " -> " + alias);
+			continue;
+		}
+
+		if(depth + 1 > max_depth)
+		{
+			log("WARN: fact alias too deep: " + key + " -> " + alias);
+			continue;
+		}
+
+		lines.push_back({alias, {}, depth, true});
+		resolve(alias, find, max_depth, depth + 1, chain);
+	}
+
+	chain.pop_back();
+}
+
+fact_lines resolved_lines::flatten(const std::shared_ptr<const resolved_lines>& r
+	, const std::function<bool(const str& key)>& in)
+{
+	fact_lines facts;
+	facts.pin = r;
+
+	// lines deeper than skip belong to an aliased
+	// key that in has said no to
+	siz skip = siz(-1);
+
+	for(auto&& line: r->lines)
+	{
+		if(line.depth > skip)
+			continue;
+
+		skip = siz(-1);
+
+		if(!line.alias)
+			facts.lines.push_back(line.fact);
+		else if(!in(line.key))
+			skip = line.depth;
+	}
+
+	return facts;
+}
+
+AliasCache::entry AliasCache::find(const str& key) const
+{
+	auto found = entries.find(key);
+	return found == entries.end() ? nullptr : found->second;
+}
+
+void AliasCache::insert(const str& key, entry lines)
+{
+	for(auto&& dep: lines->deps)
+		dependents[dep].insert(key);
+	entries[key] = std::move(lines);
+}
+
+void AliasCache::invalidate(const str& key)
+{
+	auto found = dependents.find(key);
+
+	if(found == dependents.end())
+		return;
+
+	for(auto&& k: found->second)
+		entries.erase(k);
+
+	dependents.erase(found);
+}
+
+void AliasCache::clear()
+{
+	entries.clear();
+	dependents.clear();
+}
+
+template<typename Write>
+void FactoidManager::write_files(Write write)
+{
+	const auto stamp = FactoidSnapshot::get_stamp(store_file, index_file);
+
+	if(stamp != files_stamp)
+		files_changed = true;
+
+	write();
+
+	files_stamp = FactoidSnapshot::get_stamp(store_file, index_file);
+}
+
+FactoidManager::timings::timings(FactoidStats& stats)
+: add_fact(stats.latency("fm.add_fact"))
+, del_fact(stats.latency("fm.del_fact"))
+, add_to_groups(stats.latency("fm.add_to_groups"))
+, del_from_groups(stats.latency("fm.del_from_groups"))
+, find_fact(stats.latency("fm.find_fact"))
+, find_group(stats.latency("fm.find_group"))
+, search_fact(stats.latency("fm.search_fact"))
+, suggest_fact(stats.latency("fm.suggest_fact"))
+, get_fact(stats.latency("fm.get_fact"))
+, get_resolved_fact(stats.latency("fm.get_resolved_fact"))
+, get_facts(stats.latency("fm.get_facts"))
+, reload(stats.latency("fm.reload"))
+, save_snapshot(stats.latency("fm.save_snapshot"))
+, sync(stats.latency("fm.sync"))
+, import_facts(stats.latency("fm.import_facts"))
+, export_facts(stats.latency("fm.export_facts"))
+, backup_facts(stats.latency("fm.backup_facts"))
+, undo_fact(stats.latency("fm.undo_fact"))
+, get_fact_at(stats.latency("fm.get_fact_at"))
+, alias_cache(stats.cache("fm.alias_cache"))
+, body_cache(stats.cache("fm.body_cache"))
+{
+}
+
+FactoidManager::FactoidManager(const str& store_file, const str& index_file, const str& snapshot_file
+	, bool compress, siz body_cache, std::shared_ptr<FactoidStats> shared_stats, const str& gauge_prefix)
+: stats_owner(shared_stats ? shared_stats : std::make_shared<FactoidStats>())
+, stats(*stats_owner)
+, timed(stats)
+, store_file(store_file)
+, index_file(index_file)
+, snapshot_file(snapshot_file)
+, compress(compress)
+, body_cache(body_cache)
+, store(store_file)
+, index(index_file)
+{
+	{
+		write_lock lock(write_mtx);
+		load();
+		fold_keys();
+	}
+
+	auto locked_size = [&](const str& name, std::function<siz()> get)
+	{
+		gauges.push_back(name);
+		stats.size(gauge_prefix + name, [this, get]{ read_lock lock(data_mtx); return get(); });
+	};
+
+	locked_size("keys", [this]{ return keys.size(); });
+	locked_size("words", [this]{ return text.word_count(); });
+	locked_size("groups", [this]{ return key_groups.group_count(); });
+	locked_size("grouped_keys", [this]{ return key_groups.key_count(); });
+	locked_size("edited_keys", [this]{ return facts.size(); });
+	locked_size("history", [this]{ return history.size(); });
+	locked_size("snapshot_keys", [this]{ return snapshot ? snapshot->size() : 0; });
+	locked_size("snapshot_bytes", [this]{ return snapshot ? snapshot->bytes() : 0; });
+	locked_size("alias_cache_entries", [this]
+	{
+		std::lock_guard<std::mutex> alias_lock(alias_mtx);
+		return aliases.size();
+	});
+}
+
+FactoidManager::~FactoidManager()
+{
+	unwatch_files();
+
+	// the size gauges look at our members
+	stats.stop_dump();
+
+	// write out anything still in the journal
+	journal.reset();
+}
+
+siz FactoidManager::size() const
+{
+	read_lock lock(data_mtx);
+	return keys.size();
+}
+
+bool FactoidManager::open_journal(const str& file, std::chrono::milliseconds sync_interval
+	, std::chrono::seconds compact_interval)
+{
+	write_lock lock(write_mtx);
+
+	journal.reset(new FactoidJournal(file, sync_interval, compact_interval
+		, [this](const FactoidJournal::key_values& facts, const FactoidJournal::key_values& groups)
+	{
+		std::lock_guard<std::mutex> store_lock(store_mtx);
+
+		write_files([&]
+		{
+			for(auto&& f: facts)
+			{
+				store.clear(f.first);
+				if(!f.second.empty())
+					store.set_from(f.first, f.second);
+			}
+
+			for(auto&& g: groups)
+			{
+				if(g.second.empty())
+					index.clear(g.first);
+				else
+					index.set_from(g.first, g.second);
+			}
+		});
+
+		// the stores do not report write errors so read them back
+		// before the journal is allowed to drop its only copy
+		for(auto&& f: facts)
+			if(store.get_vec(f.first) != f.second)
+				return false;
+
+		for(auto&& g: groups)
+			if(index.get_set(g.first) != str_set(g.second.begin(), g.second.end()))
+				return false;
+
+		return true;
+	}));
+
+	bool ok;
+
+	{
+		data_lock update(data_mtx);
+
+		ok = journal->open([this](char type, const str& key, const str_vec& values)
+		{
+			if(type == 'F')
+				set_facts(key, values);
+			else
+				index_groups(key, str_set(values.begin(), values.end()));
+		});
+	}
+
+	if(!ok)
+	{
+		error = journal->error;
+		journal.reset();
+	}
+	else
+		fold_keys(); // records from before keys were folded
+
+	return ok;
+}
+
+void FactoidManager::sync()
+{
+	LatencyTimer timer(timed.sync);
+
+	if(journal)
+		journal->sync();
+}
+
+bool FactoidManager::reload()
+{
+	LatencyTimer timer(timed.reload);
+
+	write_lock lock(write_mtx);
+
+	// make sure the store has every edit before rereading it
+	sync();
+
+	if(!files_changed_outside())
+		return true;
+
+	{
+		std::lock_guard<std::mutex> store_lock(store_mtx);
+		store.reload();
+		index.reload();
+	}
+
+	load_changes();
+	fold_keys();
+
+	return true;
+}
+
+bool FactoidManager::files_changed_outside()
+{
+	std::lock_guard<std::mutex> store_lock(store_mtx);
+	return files_changed || FactoidSnapshot::get_stamp(store_file, index_file) != files_stamp;
+}
+
+void FactoidManager::load_changes()
+{
+	std::vector<std::pair<str, str_vec>> fact_changes; // no facts = deleted
+	std::vector<std::pair<str, str_set>> group_changes; // no groups = none
+
+	auto sorted_keys = [](str_vec v)
+	{
+		std::sort(v.begin(), v.end());
+		v.erase(std::unique(v.begin(), v.end()), v.end());
+		return v;
+	};
+
+	{
+		std::lock_guard<std::mutex> store_lock(store_mtx);
+
+		// walk the keys on file and in memory together
+		auto k = keys.get_keys().begin();
+		for(auto&& key: sorted_keys(store.get_keys()))
+		{
+			for(; k != keys.get_keys().end() && *k < key; ++k)
+				fact_changes.emplace_back(*k, str_vec());
+			if(k != keys.get_keys().end() && *k == key)
+				++k;
+
+			str_vec lines = store.get_vec(key);
+
+			fact_lines current;
+			find_facts(key, current);
+
+			if(current.size() != lines.size()
+				|| !std::equal(lines.begin(), lines.end(), current.begin()
+					, [](const str& a, const str_view& b){ return a == b; }))
+				fact_changes.emplace_back(key, std::move(lines));
+		}
+		for(; k != keys.get_keys().end(); ++k)
+			fact_changes.emplace_back(*k, str_vec());
+
+		auto g = key_groups.begin();
+		for(auto&& key: sorted_keys(index.get_keys()))
+		{
+			for(; g != key_groups.end() && g->first < key; ++g)
+				group_changes.emplace_back(g->first, str_set());
+
+			str_set groups = index.get_set(key);
+
+			if(g != key_groups.end() && g->first == key)
+			{
+				if(key_groups.get_names(g->second) != groups)
+					group_changes.emplace_back(key, std::move(groups));
+				++g;
+			}
+			else if(!groups.empty())
+				group_changes.emplace_back(key, std::move(groups));
+		}
+		for(; g != key_groups.end(); ++g)
+			group_changes.emplace_back(g->first, str_set());
+
+		files_stamp = FactoidSnapshot::get_stamp(store_file, index_file);
+		files_changed = false;
+	}
+
+	// with that much changed it is quicker to start again
+	if(fact_changes.size() + group_changes.size() > keys.size() / 4 + 1024)
+	{
+		log("INFO: reloading everything: " + std::to_string(fact_changes.size())
+			+ " facts and " + std::to_string(group_changes.size()) + " groups changed");
+		load();
+		return;
+	}
+
+	// a batch at a time so lookups are not held up for long
+	const siz batch = 1024;
+
+	for(siz i = 0; i < fact_changes.size(); i += batch)
+	{
+		data_lock update(data_mtx);
+		for(siz j = i; j < std::min(i + batch, fact_changes.size()); ++j)
+			set_facts(fact_changes[j].first, fact_changes[j].second);
+	}
+
+	for(siz i = 0; i < group_changes.size(); i += batch)
+	{
+		data_lock update(data_mtx);
+		for(siz j = i; j < std::min(i + batch, group_changes.size()); ++j)
+			index_groups(group_changes[j].first, group_changes[j].second);
+	}
+
+	if(!fact_changes.empty() || !group_changes.empty())
+		log("INFO: reloaded " + std::to_string(fact_changes.size()) + " facts and "
+			+ std::to_string(group_changes.size()) + " groups");
+}
+
+void FactoidManager::fold_keys()
+{
+	// folded key -> the keys that fold to it
+	std::map<str, str_set> merges;
+
+	auto note = [&](const str& key)
+	{
+		if(!is_folded(key))
+			merges[fold_key(key)].insert(key);
+	};
+
+	for(auto&& key: keys.get_keys())
+		note(key);
+	for(auto&& g: key_groups)
+		note(g.first);
+
+	if(merges.empty())
+		return;
+
+	siz merged = 0;
+
+	for(auto&& m: merges)
+	{
+		const str& key = m.first;
+
+		str_vec lines;
+		find_facts(key, lines);
+		str_set groups = get_groups(key);
+
+		for(auto&& from: m.second)
+		{
+			str_vec more;
+			find_facts(from, more);
+			lines.insert(lines.end(), more.begin(), more.end());
+
+			const str_set more_groups = get_groups(from);
+			groups.insert(more_groups.begin(), more_groups.end());
+		}
+
+		{
+			data_lock update(data_mtx);
+			for(auto&& from: m.second)
+			{
+				set_facts(from, {});
+				index_groups(from, {});
+			}
+			set_facts(key, lines);
+			index_groups(key, groups);
+		}
+
+		for(auto&& from: m.second)
+		{
+			persist_facts(from, {});
+			persist_groups(from, {});
+		}
+		persist_facts(key, lines);
+		persist_groups(key, groups);
+
+		merged += m.second.size();
+		merged_keys.push_back(key);
+	}
+
+	log("INFO: merged " + std::to_string(merged) + " mixed case keys into "
+		+ std::to_string(merges.size()) + " keys");
+
+	if(!snapshot_file.empty() && !write_snapshot())
+		log("ERROR: " + error);
+}
+
+bool FactoidManager::watch_files(std::chrono::milliseconds settle)
+{
+	unwatch_files();
+
+	int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if(fd == -1)
+	{
+		error = str("can not watch the store files: ") + std::strerror(errno);
+		return false;
+	}
+
+	auto dir_of = [](const str& file)
+	{
+		const auto slash = file.rfind('/');
+		return slash == str::npos ? str(".") : slash ? file.substr(0, slash) : str("/");
+	};
+
+	auto name_of = [](const str& file)
+	{
+		const auto slash = file.rfind('/');
+		return slash == str::npos ? file : file.substr(slash + 1);
+	};
+
+	// editors often replace a file rather than write to
+	// it so watch the directories they are in
+	for(auto&& dir: str_set{dir_of(store_file), dir_of(index_file)})
+	{
+		if(::inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE) == -1)
+		{
+			error = "can not watch: " + dir + ": " + std::strerror(errno);
+			::close(fd);
+			return false;
+		}
+	}
+
+	const str_set names = {name_of(store_file), name_of(index_file)};
+
+	watch_done = false;
+	watch_thread = std::thread([=]
+	{
+		alignas(inotify_event) char buf[4096];
+
+		pollfd pfd = {fd, POLLIN, 0};
+		bool pending = false;
+
+		while(!watch_done)
+		{
+			// wait for the files to settle before reloading
+			const int n = ::poll(&pfd, 1, pending ? int(settle.count()) : 250);
+
+			if(n > 0)
+			{
+				ssize_t len;
+				while((len = ::read(fd, buf, sizeof(buf))) > 0)
+				{
+					for(char* p = buf; p < buf + len; p += sizeof(inotify_event) + ((inotify_event*)p)->len)
+					{
+						const inotify_event* e = (const inotify_event*)p;
+						if(e->len && names.count(e->name))
+							pending = true;
+					}
+				}
+				continue;
+			}
+
+			// our own writes are seen too but leave the files as we expect
+			if(n == 0 && pending)
+			{
+				pending = false;
+				if(files_changed_outside() && !reload())
+					log("ERROR: " + error);
+			}
+		}
+
+		::close(fd);
+	});
+
+	return true;
+}
+
+void FactoidManager::unwatch_files()
+{
+	if(!watch_thread.joinable())
+		return;
+
+	watch_done = true;
+	watch_thread.join();
+}
+
+void FactoidManager::load()
+{
+	auto snap = std::make_shared<FactoidSnapshot>();
+	bool current = false;
+
+	if(!snapshot_file.empty())
+	{
+		if(!snap->open(snapshot_file))
+			log("WARN: " + snap->error);
+		else if(snap->stamp() != FactoidSnapshot::get_stamp(store_file, index_file))
+			log("INFO: snapshot is out of date: " + snapshot_file);
+		else
+			current = true;
+	}
+
+	FactoidSnapshot::stamp_type stamp = current ? snap->stamp() : FactoidSnapshot::get_stamp(store_file, index_file);
+
+	if(!current)
+	{
+		// pack the store files into one block rather than
+		// giving every key and fact an allocation of its own
+		snap = std::make_shared<FactoidSnapshot>();
+
+		std::lock_guard<std::mutex> store_lock(store_mtx);
+
+		str_vec fact_keys = store.get_keys();
+		str_vec group_keys = index.get_keys();
+
+		for(auto v: {&fact_keys, &group_keys})
+		{
+			std::sort(v->begin(), v->end());
+			v->erase(std::unique(v->begin(), v->end()), v->end());
+		}
+
+		auto k = fact_keys.begin();
+		auto g = group_keys.begin();
+
+		auto next = [&](str& key, str_vec& lines, str_set& groups)
+		{
+			const bool more_k = k != fact_keys.end();
+			const bool more_g = g != group_keys.end();
+
+			if(!more_k && !more_g)
+				return false;
+
+			if(more_k && (!more_g || *k <= *g))
+				key = *k++;
+			else
+				key = *g;
+
+			if(more_g && *g == key)
+				groups = index.get_set(*g++);
+
+			lines = store.get_vec(key);
+
+			return true;
+		};
+
+		if(!snap->build(stamp, next, compress))
+		{
+			log("ERROR: " + snap->error);
+			snap.reset();
+		}
+	}
+
+	if(snap)
+		snap->set_cache(body_cache, &timed.body_cache);
+
+	// the indexes are built aside so lookups carry on
+	// meanwhile, we hold write_mtx so nothing changes
+	KeySearch new_keys;
+	TextSearch new_text;
+	KeySuggest new_similar;
+	GroupIndex new_groups;
+
+	str_vec fact_keys; // in order
+
+	// fact bodies stay in the mapping (or arena)
+	for(siz i = 0; snap && i < snap->size(); ++i)
+	{
+		str key = snap->key(i);
+		if(snap->fact_count(i))
+		{
+			new_text.set(key, snap->get_facts(i));
+			new_similar.insert(key);
+			fact_keys.push_back(key);
+		}
+		new_groups.set(key, snap->get_groups(i));
+	}
+
+	new_keys.assign(fact_keys);
+	fact_keys = str_vec();
+
+	{
+		std::lock_guard<std::mutex> store_lock(store_mtx);
+		files_stamp = stamp;
+		files_changed = false;
+	}
+
+	{
+		// the old arena goes in one piece once the
+		// last fact_lines viewing it are done with
+		data_lock update(data_mtx);
+
+		snapshot = snap;
+		facts.clear();
+		group_edits.clear();
+		keys = std::move(new_keys);
+		text = std::move(new_text);
+		similar = std::move(new_similar);
+		key_groups = std::move(new_groups);
+		aliases.clear();
+		if(changed)
+			changed("");
+		++generation;
+	}
+
+	if(!current && !snapshot_file.empty() && !write_snapshot())
+		log("ERROR: " + error);
+}
+
+bool FactoidManager::save_snapshot()
+{
+	// compressed facts are kept in the (in memory) snapshot
+	if(snapshot_file.empty() && !compress)
+		return true;
+
+	LatencyTimer timer(timed.save_snapshot);
+
+	write_lock lock(write_mtx);
+	return write_snapshot();
+}
+
+bool FactoidManager::write_snapshot()
+{
+	// the store files must match what goes in the snapshot
+	sync();
+
+	auto snap = std::make_shared<FactoidSnapshot>();
+
+	{
+		// no edits can happen while we hold write_mtx
+		// so lookups can carry on while this is written
+		read_lock lock(data_mtx);
+		std::lock_guard<std::mutex> store_lock(store_mtx);
+
+		// walk the keys with facts and the keys with groups together
+		auto k = keys.get_keys().begin();
+		auto g = key_groups.begin();
+
+		auto next = [&](str& key, str_vec& lines, str_set& groups)
+		{
+			const bool more_k = k != keys.get_keys().end();
+			const bool more_g = g != key_groups.end();
+
+			if(!more_k && !more_g)
+				return false;
+
+			if(more_k && (!more_g || *k <= g->first))
+				key = *k++;
+			else
+				key = g->first;
+
+			if(more_g && g->first == key)
+				groups = key_groups.get_names((g++)->second);
+
+			find_facts(key, lines);
+
+			return true;
+		};
+
+		const auto stamp = FactoidSnapshot::get_stamp(store_file, index_file);
+
+		// without a snapshot file the edits are
+		// folded into a fresh arena instead
+		if(snapshot_file.empty())
+		{
+			if(!snap->build(stamp, next, compress))
+			{
+				error = snap->error;
+				return false;
+			}
+		}
+		else if(!FactoidSnapshot::write(snapshot_file, stamp, next, error, compress))
+			return false;
+	}
+
+	if(!snapshot_file.empty() && !snap->open(snapshot_file))
+	{
+		error = snap->error;
+		return false;
+	}
+
+	snap->set_cache(body_cache, &timed.body_cache);
+
+	// the snapshot holds everything now
+	data_lock update(data_mtx);
+	snapshot = snap;
+	facts.clear();
+	group_edits.clear();
+
+	return true;
+}
+
+bool FactoidManager::find_facts(const str& key, fact_lines& lines) const
+{
+	if(auto found = facts.find(key))
+	{
+		if(!*found)
+			return false;
+		lines.pin = *found;
+		for(auto&& fact: **found)
+			lines.lines.emplace_back(fact);
+	}
+	else if(snapshot)
+	{
+		siz i = snapshot->find(key);
+		if(i == FactoidSnapshot::npos)
+			return false;
+		// compressed facts are viewed in a block of their own
+		lines.pin = snapshot->get_facts(i, lines.lines);
+		if(!lines.pin)
+			lines.pin = snapshot;
+	}
+
+	return !lines.empty();
+}
+
+bool FactoidManager::find_facts(const str& key, str_vec& lines) const
+{
+	if(auto found = facts.find(key))
+	{
+		if(*found)
+			lines = **found;
+	}
+	else if(snapshot)
+	{
+		siz i = snapshot->find(key);
+		if(i != FactoidSnapshot::npos)
+			lines = snapshot->get_facts(i);
+	}
+
+	return !lines.empty();
+}
+
+std::shared_ptr<const str_vec> FactoidManager::share_facts(const str& key) const
+{
+	if(auto found = facts.find(key))
+		return *found;
+
+	str_vec lines;
+	if(!find_facts(key, lines))
+		return nullptr;
+
+	return std::make_shared<const str_vec>(std::move(lines));
+}
+
+void FactoidManager::set_facts(const str& key, const str_vec& lines)
+{
+	++generation;
+	aliases.invalidate(key);
+	if(changed)
+		changed(key);
+
+	if(lines.empty())
+	{
+		keys.erase(key);
+		text.erase(key);
+		similar.erase(key);
+		if(snapshot && snapshot->find(key) != FactoidSnapshot::npos)
+			facts.set(key, nullptr);
+		else
+			facts.erase(key);
+		return;
+	}
+
+	// replaced rather than changed in place as
+	// lookups may still be viewing the old facts
+	facts.set(key, std::make_shared<const str_vec>(lines));
+	keys.insert(key);
+	text.set(key, lines);
+	similar.insert(key);
+}
+
+void FactoidManager::persist_facts(const str& key, const str_vec& lines)
+{
+	if(journal)
+	{
+		journal->set_facts(key, lines);
+		return;
+	}
+
+	std::lock_guard<std::mutex> store_lock(store_mtx);
+
+	write_files([&]
+	{
+		store.clear(key);
+		if(!lines.empty())
+			store.set_from(key, lines);
+	});
+}
+
+void FactoidManager::persist_groups(const str& key, const str_set& groups)
+{
+	if(journal)
+	{
+		journal->set_groups(key, groups);
+		return;
+	}
+
+	std::lock_guard<std::mutex> store_lock(store_mtx);
+
+	write_files([&]
+	{
+		if(groups.empty())
+			index.clear(key);
+		else
+			index.set_from(key, groups);
+	});
+}
+
+void FactoidManager::index_groups(const str& key, const str_set& groups)
+{
+	++generation;
+	key_groups.set(key, groups);
+	group_edits.set(key, std::make_shared<const str_set>(groups));
+}
+
+str_set FactoidManager::get_groups(const str& key) const
+{
+	return key_groups.get(key);
+}
+
+bool FactoidManager::in_groups(const str& key, const str_set& groups) const
+{
+	return key_groups.in_groups(key, key_groups.get_filter(groups));
+}
+
+// Edits hold write_mtx throughout, so they can read the in
+// memory data without data_mtx as nobody else can change it.
+
+bool FactoidManager::import_facts(std::istream& is, bulk_format format, siz& added)
+{
+	LatencyTimer timer(timed.import_facts);
+
+	write_lock lock(write_mtx);
+
+	added = 0;
+
+	// all the input is read before anything changes
+	BulkSorter sorter(store_file + ".import");
+
+	BulkReader reader(is, format);
+	for(bulk_record rec; reader.next(rec);)
+	{
+		fold_key_in_place(rec.key);
+		if(!sorter.add(std::move(rec)))
+		{
+			error = sorter.error;
+			return false;
+		}
+	}
+
+	if(!reader.error.empty())
+	{
+		error = reader.error;
+		return false;
+	}
+
+	struct change
+	{
+		str key;
+		str_vec lines; // empty if the facts are unchanged
+		str_set groups; // empty if the groups are unchanged
+	};
+
+	std::vector<change> batch;
+
+	// a batch at a time so lookups are not held up for long
+	auto apply = [&]
+	{
+		{
+			data_lock update(data_mtx);
+			for(auto&& u: batch)
+			{
+				if(!u.lines.empty())
+					set_facts(u.key, u.lines);
+				if(!u.groups.empty())
+					index_groups(u.key, u.groups);
+			}
+		}
+
+		for(auto&& u: batch)
+		{
+			if(!u.lines.empty())
+				persist_facts(u.key, u.lines);
+			if(!u.groups.empty())
+				persist_groups(u.key, u.groups);
+		}
+
+		batch.clear();
+	};
+
+	// each key comes once with all its facts
+	const bool merged = sorter.merge([&](const bulk_record& rec)
+	{
+		batch.emplace_back();
+		auto& u = batch.back();
+		u.key = rec.key;
+
+		if(!rec.facts.empty())
+		{
+			find_facts(rec.key, u.lines);
+			u.lines.insert(u.lines.end(), rec.facts.begin(), rec.facts.end());
+			added += rec.facts.size();
+		}
+
+		if(!rec.groups.empty())
+		{
+			u.groups = get_groups(rec.key);
+			u.groups.insert(rec.groups.begin(), rec.groups.end());
+		}
+
+		if(batch.size() == 1024)
+			apply();
+
+		return true;
+	});
+
+	apply();
+
+	if(!merged)
+	{
+		error = sorter.error;
+		log("ERROR: import stopped part way: " + error);
+		return false;
+	}
+
+	return write_snapshot();
+}
+
+FactoidManager::frozen FactoidManager::freeze() const
+{
+	read_lock lock(data_mtx);
+	return {snapshot, facts, group_edits};
+}
+
+bool FactoidManager::write_frozen(const frozen& db, std::ostream& os, bulk_format format)
+{
+	BulkWriter writer(os, format);
+
+	const siz size = db.snapshot ? db.snapshot->size() : 0;
+
+	// walk the snapshot and both lots of edits together
+	siz i = 0;
+	const auto fs = db.facts.sorted();
+	const auto gs = db.groups.sorted();
+	auto f = fs.begin();
+	auto g = gs.begin();
+
+	str snap_key = i < size ? db.snapshot->key(i) : str();
+
+	str key;
+	str_vec lines;
+	str_set groups;
+
+	while(i < size || f != fs.end() || g != gs.end())
+	{
+		const str* least = nullptr;
+		if(i < size)
+			least = &snap_key;
+		if(f != fs.end() && (!least || (*f)->first < *least))
+			least = &(*f)->first;
+		if(g != gs.end() && (!least || (*g)->first < *least))
+			least = &(*g)->first;
+		key = *least;
+
+		siz found = FactoidSnapshot::npos;
+		if(i < size && snap_key == key)
+		{
+			found = i++;
+			snap_key = i < size ? db.snapshot->key(i) : str();
+		}
+
+		lines.clear();
+		if(f != fs.end() && (*f)->first == key)
+		{
+			if((*f)->second)
+				lines = *(*f)->second;
+			++f;
+		}
+		else if(found != FactoidSnapshot::npos)
+			lines = db.snapshot->get_facts(found);
+
+		groups.clear();
+		if(g != gs.end() && (*g)->first == key)
+			groups = *(*g++)->second;
+		else if(found != FactoidSnapshot::npos)
+			groups = db.snapshot->get_groups(found);
+
+		// deleted since the snapshot
+		if(lines.empty() && groups.empty())
+			continue;
+
+		writer.write(key, lines, groups);
+
+		if(!os)
+		{
+			error = "can not write the export";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool FactoidManager::export_facts(std::ostream& os, bulk_format format)
+{
+	LatencyTimer timer(timed.export_facts);
+
+	// written from a copy so nothing waits for it
+	return write_frozen(freeze(), os, format);
+}
+
+bool FactoidManager::backup_facts(const str& file, bulk_format format)
+{
+	LatencyTimer timer(timed.backup_facts);
+
+	const frozen db = freeze();
+
+	const str tmp = file + ".tmp";
+
+	std::ofstream ofs(tmp, std::ios::trunc);
+	if(!ofs)
+	{
+		error = "can not write backup: " + tmp + ": " + std::strerror(errno);
+		return false;
+	}
+
+	if(!write_frozen(db, ofs, format))
+	{
+		std::remove(tmp.c_str());
+		return false;
+	}
+
+	if(!ofs.flush())
+	{
+		error = "can not write backup: " + tmp;
+		std::remove(tmp.c_str());
+		return false;
+	}
+
+	ofs.close();
+
+	if(std::rename(tmp.c_str(), file.c_str()))
+	{
+		error = "can not rename backup: " + file + ": " + std::strerror(errno);
+		std::remove(tmp.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void FactoidManager::set_history(siz max_edits, std::chrono::seconds max_age)
+{
+	data_lock update(data_mtx);
+	history.set_limits(max_edits, max_age);
+}
+
+bool FactoidManager::undo_fact(const str& given)
+{
+	LatencyTimer timer(timed.undo_fact);
+
+	str buf;
+	const str& key = folded(given, buf);
+
+	write_lock lock(write_mtx);
+
+	auto now_facts = share_facts(key);
+	const str_set now_groups = get_groups(key);
+
+	str_vec lines;
+	str_set groups;
+
+	{
+		data_lock update(data_mtx);
+
+		FactHistory::entry e;
+		if(!history.undo(key, std::move(now_facts), now_groups, e))
+		{
+			error = "no edits of '" + key + "' to undo";
+			return false;
+		}
+
+		if(e.facts)
+			lines = *e.facts;
+		groups = std::move(e.groups);
+
+		set_facts(key, lines);
+		index_groups(key, groups);
+	}
+
+	persist_facts(key, lines);
+	persist_groups(key, groups);
+
+	return true;
+}
+
+/**
+ * Is a key with key_groups in any of groups (or groups empty)?
+ */
+static bool in_any(const str_set& key_groups, const str_set& groups)
+{
+	return groups.empty() || std::any_of(groups.begin(), groups.end()
+		, [&](const str& g){ return key_groups.count(g); });
+}
+
+void FactoidManager::find_facts_at(const str& key, FactHistory::clock::time_point when
+	, str_vec& lines, str_set& groups) const
+{
+	if(auto e = history.find_after(key, when))
+	{
+		if(e->facts)
+			lines = *e->facts;
+		groups = e->groups;
+	}
+	else
+	{
+		find_facts(key, lines);
+		groups = get_groups(key);
+	}
+}
+
+bool FactoidManager::get_fact_at(const str& given, FactHistory::clock::time_point when, str_vec& lines
+	, const str_set& groups, bool resolve)
+{
+	LatencyTimer timer(timed.get_fact_at);
+
+	str buf;
+	const str& key = folded(given, buf);
+
+	read_lock lock(data_mtx);
+
+	if(when < history.get_since())
+	{
+		const auto ago = std::chrono::duration_cast<std::chrono::minutes>(
+			FactHistory::clock::now() - history.get_since());
+		error = "edits are only remembered for the last " + std::to_string(ago.count()) + " minutes";
+		return false;
+	}
+
+	str_vec facts_then;
+	str_set groups_then;
+	find_facts_at(key, when, facts_then, groups_then);
+
+	if(!in_any(groups_then, groups))
+	{
+		error = "fact not found within specified group(s)";
+		return false;
+	}
+
+	if(facts_then.empty())
+	{
+		error = "no facts for '" + key + "' at that time";
+		return false;
+	}
+
+	if(!resolve)
+	{
+		lines = std::move(facts_then);
+		return true;
+	}
+
+	// every aliased key as it was at the same time
+	auto resolved = std::make_shared<resolved_lines>();
+	resolved->resolve(key, [&](const str& k, fact_lines& facts)
+	{
+		str_vec more;
+		str_set more_groups;
+		find_facts_at(k, when, more, more_groups);
+
+		// nothing if k was not in the groups either
+		if(more.empty() || !in_any(more_groups, groups))
+			return false;
+
+		facts = fact_lines(std::move(more));
+		return true;
+	}, max_alias_depth);
+
+	lines = resolved_lines::flatten(resolved, [](const str&){ return true; }).to_vec();
+
+	return true;
+}
+
+/**
+ * Add a fact by keyword and optionally add it to groups.
+ * @param key
+ * @param fact
+ * @param groups
+ * @return
+ */
+void FactoidManager::add_fact(const str& given, const str& fact, const str_set& groups)
+{
+	LatencyTimer timer(timed.add_fact);
+
+	str buf;
+	const str& key = folded(given, buf);
+
+	write_lock lock(write_mtx);
+
+	auto old_facts = share_facts(key);
+	const str_set old_groups = get_groups(key);
+
+	str_vec lines;
+	if(old_facts)
+		lines = *old_facts;
+	lines.push_back(fact);
+
+	str_set all_groups = old_groups;
+	all_groups.insert(groups.begin(), groups.end());
+	bug_cnt(all_groups);
+
+	{
+		data_lock update(data_mtx);
+		history.record(key, std::move(old_facts), old_groups);
+		set_facts(key, lines);
+		if(!groups.empty())
+			index_groups(key, all_groups);
+	}
+
+	if(journal)
+		journal->set_facts(key, lines);
+	else
+	{
+		std::lock_guard<std::mutex> store_lock(store_mtx);
+		write_files([&]{ store.add(key, fact); });
+	}
+
+	if(!groups.empty())
+		persist_groups(key, all_groups);
+}
+
+/**
+ * Delete all facts, or a single fact from a keyword.
+ * @param key
+ * @param line
+ * @param groups
+ * @return
+ */
+bool FactoidManager::del_fact(const str& given, uns line, const str_set& groups)
+{
+	LatencyTimer timer(timed.del_fact);
+
+	str buf;
+	const str& key = folded(given, buf);
+
+	write_lock lock(write_mtx);
+
+	if(!groups.empty() && !in_groups(key, groups))
+	{
+		error = "fact not found within specified group(s)";
+		return false;
+	}
+
+	auto old_facts = share_facts(key);
+
+	str_vec tmps;
+	if(old_facts)
+		tmps = *old_facts;
+
+	if(line == noline)
+		tmps.clear();
+	else
+	{
+		if(line <= tmps.size())
+			tmps.erase(tmps.begin() + line - 1);
+		else
+		{
+			error = "line number for key '" + key + "' does not exist: " + std::to_string(line);
+			return false;
+		}
+	}
+
+	{
+		data_lock update(data_mtx);
+		history.record(key, std::move(old_facts), get_groups(key));
+		set_facts(key, tmps);
+		if(tmps.empty())
+			index_groups(key, {});
+	}
+
+	persist_facts(key, tmps);
+
+	if(tmps.empty())
+		persist_groups(key, {});
+
+	return true;
+}
+
+/**
+ * Add keyword to groups.
+ * @param key
+ * @param groups
+ * @return
+ */
+void FactoidManager::add_to_groups(const str& given, const str_set& groups)
+{
+	LatencyTimer timer(timed.add_to_groups);
+
+	str buf;
+	const str& key = folded(given, buf);
+
+	write_lock lock(write_mtx);
+
+	const str_set old_groups = get_groups(key);
+
+	str_set current_groups = old_groups;
+	current_groups.insert(groups.begin(), groups.end());
+	bug_cnt(current_groups);
+
+	auto old_facts = share_facts(key);
+
+	{
+		data_lock update(data_mtx);
+		history.record(key, std::move(old_facts), old_groups);
+		index_groups(key, current_groups);
+	}
+
+	persist_groups(key, current_groups);
+}
+
+/**
+ * Remove keyword from groups.
+ * @param key
+ * @param groups
+ * @return
+ */
+void FactoidManager::del_from_groups(const str& given, const str_set& groups)
+{
+	LatencyTimer timer(timed.del_from_groups);
+
+	str buf;
+	const str& key = folded(given, buf);
+
+	write_lock lock(write_mtx);
+
+	const str_set old_groups = get_groups(key);
+	if(old_groups.empty())
+		return;
+
+	str_set current_groups = old_groups;
+	for(auto&& g: groups)
+		current_groups.erase(g);
+
+	auto old_facts = share_facts(key);
+
+	{
+		data_lock update(data_mtx);
+		history.record(key, std::move(old_facts), old_groups);
+		index_groups(key, current_groups);
+	}
+
+	persist_groups(key, current_groups);
+}
+
+/**
+ * Get a set of kewords that match the wildcard expression
+ * @return
+ */
+str_set FactoidManager::find_fact(const str& wild_given, const str_set& groups, siz max)
+{
+	LatencyTimer timer(timed.find_fact);
+
+	str buf;
+	const str& wild_key = folded(wild_given, buf);
+
+	read_lock lock(data_mtx);
+
+	if(groups.empty())
+		return keys.find(wild_key, max);
+
+	const auto in = key_groups.get_filter(groups);
+	if(in.empty())
+		return {};
+
+	return keys.find(wild_key, max, [&](const str& key)
+	{
+		return key_groups.in_groups(key, in);
+	});
+}
+
+/**
+ * Get a set of groups that match the wildcard expression
+ * @return
+ */
+str_set FactoidManager::find_group(const str& wild_group)
+{
+	str_set groups;
+
+	visit_groups(wild_group, [&](const str& group)
+	{
+		groups.insert(groups.end(), group);
+	});
+
+	return groups;
+}
+
+std::vector<TextSearch::hit> FactoidManager::search_fact(const str& terms, const str_set& groups, siz max)
+{
+	LatencyTimer timer(timed.search_fact);
+
+	read_lock lock(data_mtx);
+
+	if(groups.empty())
+		return text.search(terms, max);
+
+	const auto in = key_groups.get_filter(groups);
+	if(in.empty())
+		return {};
+
+	return text.search(terms, max, [&](const str& key)
+	{
+		return key_groups.in_groups(key, in);
+	});
+}
+
+str_vec FactoidManager::suggest_fact(const str& given, const str_set& groups, siz max)
+{
+	LatencyTimer timer(timed.suggest_fact);
+
+	str buf;
+	const str& key = folded(given, buf);
+
+	// one edit in three at most so short keys
+	// don't match nearly everything
+	const siz distance = std::min<siz>(max_suggest_distance, key.size() / 3 + 1);
+
+	read_lock lock(data_mtx);
+
+	const auto in = key_groups.get_filter(groups);
+
+	return similar.suggest(key, distance, max, [&](const str& k)
+	{
+		return k != key && (groups.empty() || key_groups.in_groups(k, in));
+	});
+}
+
+siz FactoidManager::visit_facts(const str& wild_given, const visitor& visit, const str_set& groups, siz max
+	, const StopToken* stop)
+{
+	LatencyTimer timer(timed.find_fact);
+
+	str buf;
+	const str& wild_key = folded(wild_given, buf);
+
+	read_lock lock(data_mtx);
+
+	if(groups.empty())
+		return keys.visit(wild_key, visit, max, {}, stop);
+
+	const auto in = key_groups.get_filter(groups);
+	if(in.empty())
+		return 0;
+
+	return keys.visit(wild_key, visit, max, [&](const str& key)
+	{
+		return key_groups.in_groups(key, in);
+	}, stop);
+}
+
+siz FactoidManager::visit_groups(const str& wild_group, const visitor& visit, siz max
+	, const StopToken* stop)
+{
+	LatencyTimer timer(timed.find_group);
+
+	siz found = 0;
+
+	WildPattern wild(wild_group);
+
+	read_lock lock(data_mtx);
+
+	siz tested = 0;
+
+	for(auto&& g: key_groups.get_groups())
+	{
+		if(max && found == max)
+			break;
+		if(stop && !(++tested % 256) && stop->should_stop())
+			break;
+		if(!wild.match(g.first))
+			continue;
+		visit(g.first);
+		++found;
+	}
+
+	return found;
+}
+
+str_vec FactoidManager::get_fact(const str& key, const str_set& groups)
+{
+	return get_fact_lines(key, groups).to_vec();
+}
+
+fact_lines FactoidManager::get_fact_lines(const str& given, const str_set& groups)
+{
+	LatencyTimer timer(timed.get_fact);
+
+	str buf;
+	const str& key = folded(given, buf);
+
+	read_lock lock(data_mtx);
+
+	fact_lines lines;
+
+	if(!groups.empty() && !in_groups(key, groups))
+		return lines;
+
+	find_facts(key, lines);
+	return lines;
+}
+
+str_vec FactoidManager::get_resolved_fact(const str& key, const str_set& groups)
+{
+	return get_resolved_lines(key, groups).to_vec();
+}
+
+fact_lines FactoidManager::get_resolved_lines(const str& given, const str_set& groups)
+{
+	LatencyTimer timer(timed.get_resolved_fact);
+
+	str buf;
+	const str& key = folded(given, buf);
+
+	read_lock lock(data_mtx);
+
+	return resolve_lines(key, groups, key_groups.get_filter(groups), true);
+}
+
+std::vector<fact_lines> FactoidManager::get_facts(const str_vec& given, const str_set& groups, bool resolve)
+{
+	LatencyTimer timer(timed.get_facts);
+
+	// only copied if some need folding
+	str_vec buf;
+	if(!std::all_of(given.begin(), given.end(), [](const str& key){ return is_folded(key); }))
+	{
+		buf = given;
+		for(auto&& key: buf)
+			fold_key_in_place(key);
+	}
+	const str_vec& keys = buf.empty() ? given : buf;
+
+	// neighbouring keys share tree nodes and snapshot pages
+	std::vector<siz> order(keys.size());
+	for(siz i = 0; i < order.size(); ++i)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [&](siz a, siz b){ return keys[a] < keys[b]; });
+
+	std::vector<fact_lines> facts(keys.size());
+
+	read_lock lock(data_mtx);
+
+	const auto in = key_groups.get_filter(groups);
+
+	for(siz i: order)
+		facts[i] = resolve_lines(keys[i], groups, in, resolve);
+
+	return facts;
+}
+
+fact_lines FactoidManager::resolve_lines(const str& key, const str_set& groups
+	, const GroupIndex::filter& in, bool resolve)
+{
+	fact_lines facts;
+
+	if(!groups.empty() && !key_groups.in_groups(key, in))
+		return facts;
+
+	if(!find_facts(key, facts) || !resolve)
+		return facts;
+
+	// plain facts need no resolving
+	if(std::none_of(facts.begin(), facts.end(), [](const str_view& fact)
+		{ return !fact.empty() && fact[0] == '='; }))
+		return facts;
+
+	std::unique_lock<std::mutex> alias_lock(alias_mtx);
+
+	auto lines = aliases.find(key);
+
+	if(lines)
+		timed.alias_cache.hit();
+	else
+	{
+		timed.alias_cache.miss();
+
+		alias_lock.unlock();
+
+		auto resolved = std::make_shared<resolved_lines>();
+		resolved->resolve(key, [this](const str& k, fact_lines& f){ return find_facts(k, f); }, max_alias_depth);
+
+		// edits can't happen while we hold data_mtx so
+		// if someone else got here first theirs is the same
+		alias_lock.lock();
+
+		aliases.insert(key, resolved);
+		lines = resolved;
+	}
+
+	alias_lock.unlock();
+
+	return resolved_lines::flatten(lines, [&](const str& k)
+	{
+		return groups.empty() || key_groups.in_groups(k, in);
+	});
+}
+
+}} // skivvy::factoid
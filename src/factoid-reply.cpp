@@ -0,0 +1,226 @@
+/*
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+
+#include <skivvy/factoid-reply.h>
+
+#include <algorithm>
+
+namespace skivvy { namespace factoid {
+
+// the least text room a message is given whatever the head
+static const siz min_text = 32;
+
+ReplyBuilder::ReplyBuilder(const str& head, siz max, bool pack, const str& sep)
+: head(head)
+, sep(sep)
+, max(std::max(max, head.size() + min_text))
+, pack(pack)
+{
+}
+
+void ReplyBuilder::reserve(siz bytes)
+{
+	buf.reserve(buf.size() + bytes);
+}
+
+void ReplyBuilder::end()
+{
+	if(!open)
+		return;
+	ends.push_back(buf.size());
+	open = false;
+}
+
+/**
+ * Find where to split line so the first part is no
+ * longer than room, preferably between words.
+ */
+static siz get_break(const str_view& line, siz room)
+{
+	siz cut = line.rfind(' ', room);
+
+	// before all the spaces there
+	while(cut != str_view::npos && cut && line[cut - 1] == ' ')
+		--cut;
+
+	if(cut != str_view::npos && cut)
+		return cut;
+
+	// no space to break at so at least don't
+	// split a UTF-8 sequence
+	for(cut = room; cut; --cut)
+		if((line[cut] & 0xC0) != 0x80)
+			return cut;
+
+	return room;
+}
+
+void ReplyBuilder::add(str_view line)
+{
+	if(open)
+	{
+		// only whole lines are packed
+		if(pack && buf.size() - start() + sep.size() + line.size() <= max)
+		{
+			buf += sep;
+			buf.append(line.data(), line.size());
+			return;
+		}
+		end();
+	}
+
+	const siz room = max - head.size();
+
+	for(;;)
+	{
+		buf += head;
+
+		siz cut = line.size() > room ? get_break(line, room) : line.size();
+		buf.append(line.data(), cut);
+		line.remove_prefix(cut);
+
+		// the space we split at goes
+		while(!line.empty() && line.front() == ' ')
+			line.remove_prefix(1);
+
+		if(line.empty())
+			break;
+
+		ends.push_back(buf.size());
+	}
+
+	open = true;
+}
+
+str_view ReplyBuilder::get(siz i) const
+{
+	siz b = i ? ends[i - 1] : 0;
+	siz e = i < ends.size() ? ends[i] : buf.size();
+	return str_view(buf.data() + b, e - b);
+}
+
+siz ReplyBuilder::send(const sender& send, siz first, siz last) const
+{
+	last = std::min(last, size());
+
+	str msg;
+	for(siz i = first; i < last; ++i)
+	{
+		str_view m = get(i);
+		msg.assign(m.data(), m.size());
+		send(msg);
+	}
+
+	return last > first ? last - first : 0;
+}
+
+ReplyCache::ReplyCache(siz capacity)
+: capacity(capacity)
+{
+}
+
+bool ReplyCache::renew(std::uint64_t generation)
+{
+	if(generation < this->generation)
+		return false;
+
+	if(generation > this->generation)
+	{
+		used.clear();
+		entries.clear();
+		this->generation = generation;
+	}
+
+	return true;
+}
+
+void ReplyCache::set_capacity(siz capacity)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	this->capacity = capacity;
+
+	while(used.size() > capacity)
+	{
+		entries.erase(used.back().first);
+		used.pop_back();
+	}
+}
+
+ReplyCache::reply ReplyCache::get(const str& id, std::uint64_t generation)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	if(!renew(generation))
+		return {};
+
+	auto found = entries.find(id);
+
+	if(found == entries.end())
+		return {};
+
+	used.splice(used.begin(), used, found->second);
+
+	return found->second->second;
+}
+
+void ReplyCache::put(const str& id, std::uint64_t generation, reply r)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	// built from facts that may have changed since
+	if(!capacity || !renew(generation))
+		return;
+
+	auto found = entries.find(id);
+
+	if(found != entries.end())
+	{
+		found->second->second = r;
+		used.splice(used.begin(), used, found->second);
+		return;
+	}
+
+	if(used.size() >= capacity)
+	{
+		entries.erase(used.back().first);
+		used.pop_back();
+	}
+
+	used.emplace_front(id, r);
+	entries.emplace(id, used.begin());
+}
+
+siz ReplyCache::size() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return used.size();
+}
+
+}} // skivvy::factoid
@@ -0,0 +1,1118 @@
+/*
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <skivvy/factoid-search.h>
+
+#include <cmath>
+#include <cctype>
+#include <cstring>
+#include <limits>
+#include <iterator>
+#include <algorithm>
+
+#include <fnmatch.h>
+
+namespace skivvy { namespace factoid {
+
+bool wild_match(const str& w, const str& s, int flags)
+{
+	return !fnmatch(w.c_str(), s.c_str(), flags | FNM_EXTMATCH);
+}
+
+static bool is_extended(const str& wild, siz pos)
+{
+	return pos + 1 < wild.size() && wild[pos + 1] == '('
+		&& std::strchr("?*+@!", wild[pos]);
+}
+
+WildPattern::WildPattern(const str& wild)
+: wild(wild)
+{
+	for(siz i = 0; !fallback && i < wild.size(); ++i)
+	{
+		token t{token::type::lit, wild[i], {}};
+
+		if(is_extended(wild, i))
+			fallback = true;
+		else if(wild[i] == '*')
+		{
+			// runs of stars are the same as one
+			if(!tokens.empty() && tokens.back().t == token::type::star)
+				continue;
+			t.t = token::type::star;
+		}
+		else if(wild[i] == '?')
+			t.t = token::type::any;
+		else if(wild[i] == '\\')
+		{
+			if(i + 1 == wild.size())
+				fallback = true;
+			else
+				t.c = wild[++i];
+		}
+		else if(wild[i] == '[')
+		{
+			// leave anything odd to fnmatch
+			if(!parse_bracket(i, t.chars))
+				fallback = true;
+			t.t = token::type::set;
+		}
+
+		if(t.t == token::type::any || t.t == token::type::set)
+			has_any = true;
+
+		tokens.push_back(t);
+	}
+}
+
+// parse the bracket expression starting at pos leaving pos
+// on the closing ']'
+bool WildPattern::parse_bracket(siz& pos, std::bitset<256>& chars) const
+{
+	siz i = pos + 1;
+
+	bool negate = false;
+	if(i < wild.size() && (wild[i] == '!' || wild[i] == '^'))
+		{ negate = true; ++i; }
+
+	bool first = true;
+	for(; i < wild.size(); ++i, first = false)
+	{
+		if(wild[i] == ']' && !first)
+		{
+			if(negate)
+				chars.flip();
+			pos = i;
+			return true;
+		}
+
+		int lo;
+
+		if(wild[i] == '[' && i + 1 < wild.size() && wild[i + 1] == ':')
+		{
+			siz end = wild.find(":]", i + 2);
+			if(end == str::npos)
+				return false;
+
+			str name = wild.substr(i + 2, end - i - 2);
+
+			int (*is)(int) = nullptr;
+			if(name == "alnum") is = std::isalnum;
+			else if(name == "alpha") is = std::isalpha;
+			else if(name == "blank") is = std::isblank;
+			else if(name == "cntrl") is = std::iscntrl;
+			else if(name == "digit") is = std::isdigit;
+			else if(name == "graph") is = std::isgraph;
+			else if(name == "lower") is = std::islower;
+			else if(name == "print") is = std::isprint;
+			else if(name == "punct") is = std::ispunct;
+			else if(name == "space") is = std::isspace;
+			else if(name == "upper") is = std::isupper;
+			else if(name == "xdigit") is = std::isxdigit;
+
+			if(!is)
+				return false;
+
+			for(int c = 0; c < 128; ++c)
+				if(is(c))
+					chars.set(c);
+
+			i = end + 1;
+			continue;
+		}
+		else if(wild[i] == '[' && i + 1 < wild.size() && std::strchr(".=", wild[i + 1]))
+		{
+			// only single character collating elements
+			if(i + 4 >= wild.size() || wild[i + 3] != wild[i + 1] || wild[i + 4] != ']')
+				return false;
+			lo = (unsigned char)wild[i + 2];
+			i += 4;
+		}
+		else if(wild[i] == '\\')
+		{
+			if(++i == wild.size())
+				return false;
+			lo = (unsigned char)wild[i];
+		}
+		else
+			lo = (unsigned char)wild[i];
+
+		// range?
+		if(i + 2 < wild.size() && wild[i + 1] == '-' && wild[i + 2] != ']')
+		{
+			i += 2;
+			if(wild[i] == '[' || wild[i] == '\\')
+				return false;
+			int hi = (unsigned char)wild[i];
+			for(int c = lo; c <= hi; ++c)
+				chars.set(c);
+		}
+		else
+			chars.set(lo);
+	}
+
+	return false;
+}
+
+bool WildPattern::match(const str& s) const
+{
+	if(fallback)
+		return wild_match(wild, s);
+
+	// '?' and '[..]' match whole multibyte
+	// characters in some locales
+	if(has_any)
+		for(char c: s)
+			if((unsigned char)c > 127)
+				return wild_match(wild, s);
+
+	siz t = 0; // token
+	siz c = 0; // character
+	siz star_t = str::npos;
+	siz star_c = 0;
+
+	while(c < s.size())
+	{
+		if(t < tokens.size())
+		{
+			const token& tok = tokens[t];
+
+			if(tok.t == token::type::star)
+			{
+				star_t = t++;
+				star_c = c;
+				continue;
+			}
+
+			if((tok.t == token::type::lit && tok.c == s[c])
+			|| tok.t == token::type::any
+			|| (tok.t == token::type::set && tok.chars.test((unsigned char)s[c])))
+			{
+				++t;
+				++c;
+				continue;
+			}
+		}
+
+		// backtrack to the last star and let it eat one more
+		if(star_t == str::npos)
+			return false;
+
+		t = star_t + 1;
+		c = ++star_c;
+	}
+
+	while(t < tokens.size() && tokens[t].t == token::type::star)
+		++t;
+
+	return t == tokens.size();
+}
+
+// return the position of the closing ']' of the bracket
+// expression opened at pos or str::npos
+static siz skip_bracket(const str& wild, siz pos)
+{
+	siz i = pos + 1;
+
+	if(i < wild.size() && (wild[i] == '!' || wild[i] == '^'))
+		++i;
+	if(i < wild.size() && wild[i] == ']')
+		++i;
+
+	for(; i < wild.size(); ++i)
+	{
+		if(wild[i] == ']')
+			return i;
+
+		// [:class:], [.sym.], [=equiv=]
+		if(wild[i] == '[' && i + 1 < wild.size() && std::strchr(":.=", wild[i + 1]))
+		{
+			siz end = wild.find(str{wild[i + 1], ']'}, i + 2);
+			if(end == str::npos)
+				return str::npos;
+			i = end + 1;
+		}
+	}
+
+	return str::npos;
+}
+
+wild_literals get_wild_literals(const str& wild)
+{
+	wild_literals wl;
+
+	str run;
+	bool in_prefix = true;
+
+	auto end_run = [&]
+	{
+		if(in_prefix)
+			wl.prefix = run;
+		in_prefix = false;
+		if(!run.empty())
+			wl.parts.push_back(run);
+		run.clear();
+	};
+
+	for(siz i = 0; i < wild.size(); ++i)
+	{
+		const char c = wild[i];
+
+		// ?(..) *(..) +(..) @(..) !(..)
+		if(is_extended(wild, i))
+			break;
+
+		if(c == '\\')
+		{
+			if(++i == wild.size())
+				break;
+			run += wild[i];
+		}
+		else if(c == '*' || c == '?')
+			end_run();
+		else if(c == '[')
+		{
+			siz end = skip_bracket(wild, i);
+			if(end == str::npos)
+				break;
+			end_run();
+			i = end;
+		}
+		else
+			run += c;
+	}
+
+	end_run();
+
+	return wl;
+}
+
+void KeySearch::get_grams(const str& s, std::vector<gram>& v)
+{
+	for(siz i = 0; i + 3 <= s.size(); ++i)
+		v.push_back(gram((unsigned char)s[i]) << 16
+			| gram((unsigned char)s[i + 1]) << 8
+			| gram((unsigned char)s[i + 2]));
+}
+
+void KeySearch::clear()
+{
+	grams.clear();
+	keys.clear();
+}
+
+void KeySearch::insert(const str& key)
+{
+	auto i = keys.insert(key);
+
+	if(!i.second)
+		return;
+
+	const str* k = &*i.first;
+
+	std::vector<gram> v;
+	get_grams(key, v);
+	std::sort(v.begin(), v.end());
+	v.erase(std::unique(v.begin(), v.end()), v.end());
+
+	for(auto g: v)
+	{
+		posting& p = grams[g];
+		p.insert(std::lower_bound(p.begin(), p.end(), k, std::less<const str*>()), k);
+	}
+}
+
+void KeySearch::erase(const str& key)
+{
+	auto i = keys.find(key);
+
+	if(i == keys.end())
+		return;
+
+	const str* k = &*i;
+
+	std::vector<gram> v;
+	get_grams(key, v);
+
+	for(auto g: v)
+	{
+		auto found = grams.find(g);
+		if(found == grams.end())
+			continue;
+
+		posting& p = found->second;
+		auto pos = std::lower_bound(p.begin(), p.end(), k, std::less<const str*>());
+		if(pos != p.end() && *pos == k)
+			p.erase(pos);
+		if(p.empty())
+			grams.erase(found);
+	}
+
+	keys.erase(i);
+}
+
+void KeySearch::assign(const str_vec& sorted)
+{
+	clear();
+
+	std::vector<gram> v;
+
+	for(auto&& key: sorted)
+	{
+		const str* k = &*keys.insert(keys.end(), key);
+
+		v.clear();
+		get_grams(key, v);
+		std::sort(v.begin(), v.end());
+		v.erase(std::unique(v.begin(), v.end()), v.end());
+
+		for(auto g: v)
+			grams[g].push_back(k);
+	}
+
+	// sorted once at the end rather than on every insert
+	for(auto&& p: grams)
+		std::sort(p.second.begin(), p.second.end(), std::less<const str*>());
+}
+
+str_set KeySearch::find(const str& wild, siz max, const filter& accept) const
+{
+	str_set found;
+
+	visit(wild, [&](const str& key)
+	{
+		found.insert(found.end(), key);
+	}, max, accept);
+
+	return found;
+}
+
+siz KeySearch::visit(const str& wild, const visitor& visit, siz max, const filter& accept
+	, const StopToken* stop) const
+{
+	siz found = 0;
+	siz tested = 0;
+
+	WildPattern pattern(wild);
+
+	// returns false when we have enough (or must stop)
+	auto test = [&](const str& key)
+	{
+		// the clock is only read every so often
+		if(stop && !(++tested % 256) && stop->should_stop())
+			return false;
+		if(!pattern.match(key) || (accept && !accept(key)))
+			return true;
+		visit(key);
+		++found;
+		return !max || found < max;
+	};
+
+	wild_literals wl = get_wild_literals(wild);
+
+	std::vector<gram> want;
+	for(auto&& part: wl.parts)
+		get_grams(part, want);
+
+	// a short prefix range is not worth walking if
+	// the trigrams can narrow things down instead
+	if(wl.prefix.size() < 3 && !want.empty())
+	{
+		std::sort(want.begin(), want.end());
+		want.erase(std::unique(want.begin(), want.end()), want.end());
+
+		std::vector<const posting*> lists;
+		for(auto g: want)
+		{
+			auto p = grams.find(g);
+			if(p == grams.end())
+				return found;
+			lists.push_back(&p->second);
+		}
+
+		std::sort(lists.begin(), lists.end(), [](const posting* a, const posting* b)
+		{
+			return a->size() < b->size();
+		});
+
+		posting candidates = *lists.front();
+		for(auto p = std::next(lists.begin()); p != lists.end() && !candidates.empty(); ++p)
+		{
+			posting both;
+			std::set_intersection(candidates.begin(), candidates.end()
+				, (*p)->begin(), (*p)->end(), std::back_inserter(both)
+				, std::less<const str*>());
+			candidates.swap(both);
+		}
+
+		// results are cut off in key order
+		std::sort(candidates.begin(), candidates.end(), [](const str* a, const str* b)
+		{
+			return *a < *b;
+		});
+
+		for(const str* k: candidates)
+			if(!test(*k))
+				break;
+
+		return found;
+	}
+
+	auto k = wl.prefix.empty() ? keys.begin() : keys.lower_bound(wl.prefix);
+
+	for(; k != keys.end(); ++k)
+	{
+		if(k->compare(0, wl.prefix.size(), wl.prefix))
+			break;
+		if(!test(*k))
+			break;
+	}
+
+	return found;
+}
+
+GroupIndex::group_id GroupIndex::intern(const str& group)
+{
+	auto found = ids.find(group);
+	if(found != ids.end())
+		return found->second;
+
+	group_id id;
+	if(!unused.empty())
+	{
+		id = unused.back();
+		unused.pop_back();
+		names[id] = group;
+	}
+	else
+	{
+		id = group_id(names.size());
+		names.push_back(group);
+		sizes.push_back(0);
+	}
+
+	ids.emplace(group, id);
+	return id;
+}
+
+void GroupIndex::release(group_id id)
+{
+	if(--sizes[id])
+		return;
+
+	ids.erase(names[id]);
+	names[id].clear();
+	unused.push_back(id);
+}
+
+void GroupIndex::clear()
+{
+	ids.clear();
+	names.clear();
+	sizes.clear();
+	unused.clear();
+	key_groups.clear();
+}
+
+void GroupIndex::set(const str& key, const str_set& groups)
+{
+	group_ids gids;
+	gids.reserve(groups.size());
+
+	// interned before the old ids are released so a
+	// group the key stays in keeps its id
+	for(auto&& g: groups)
+	{
+		gids.push_back(intern(g));
+		++sizes[gids.back()];
+	}
+
+	std::sort(gids.begin(), gids.end());
+
+	auto found = key_groups.find(key);
+
+	if(found != key_groups.end())
+	{
+		for(auto id: found->second)
+			release(id);
+		if(gids.empty())
+			key_groups.erase(found);
+		else
+			found->second.swap(gids);
+	}
+	else if(!gids.empty())
+		key_groups.emplace(key, std::move(gids));
+}
+
+str_set GroupIndex::get_names(const group_ids& gids) const
+{
+	str_set groups;
+	for(auto id: gids)
+		groups.insert(names[id]);
+	return groups;
+}
+
+str_set GroupIndex::get(const str& key) const
+{
+	auto found = key_groups.find(key);
+
+	if(found == key_groups.end())
+		return {};
+
+	return get_names(found->second);
+}
+
+GroupIndex::filter GroupIndex::get_filter(const str_set& groups) const
+{
+	filter f;
+
+	for(auto&& g: groups)
+	{
+		auto found = ids.find(g);
+		if(found == ids.end())
+			continue;
+		const siz word = found->second / 64;
+		if(word >= f.bits.size())
+			f.bits.resize(word + 1);
+		f.bits[word] |= std::uint64_t(1) << (found->second % 64);
+	}
+
+	return f;
+}
+
+bool GroupIndex::in_groups(const str& key, const filter& f) const
+{
+	if(f.empty())
+		return false;
+
+	auto found = key_groups.find(key);
+
+	if(found == key_groups.end())
+		return false;
+
+	for(auto id: found->second)
+	{
+		const siz word = id / 64;
+		if(word >= f.bits.size())
+			break; // the rest are higher still
+		if(f.bits[word] & (std::uint64_t(1) << (id % 64)))
+			return true;
+	}
+
+	return false;
+}
+
+const siz KeySuggest::max_edits;
+const siz KeySuggest::prefix;
+
+siz KeySuggest::distance(const str& a, const str& b, siz max)
+{
+	const str& s = a.size() < b.size() ? a : b; // the shorter
+	const str& t = a.size() < b.size() ? b : a;
+
+	if(t.size() - s.size() > max)
+		return max + 1;
+
+	std::vector<siz> row(s.size() + 1);
+	for(siz i = 0; i <= s.size(); ++i)
+		row[i] = i;
+
+	for(siz j = 1; j <= t.size(); ++j)
+	{
+		siz diag = row[0];
+		row[0] = j;
+		siz lowest = row[0];
+
+		for(siz i = 1; i <= s.size(); ++i)
+		{
+			const siz up = row[i];
+			row[i] = std::min({up + 1, row[i - 1] + 1, diag + (s[i - 1] != t[j - 1])});
+			diag = up;
+			lowest = std::min(lowest, row[i]);
+		}
+
+		// every path from here on costs at least this
+		if(lowest > max)
+			return max + 1;
+	}
+
+	return row[s.size()];
+}
+
+void KeySuggest::get_hashes(const str& key, std::vector<std::uint32_t>& hashes)
+{
+	const siz n = std::min(key.size(), prefix);
+
+	// each set bit of mask deletes that character
+	for(unsigned mask = 0; mask < (1U << n); ++mask)
+	{
+		if(siz(__builtin_popcount(mask)) > max_edits)
+			continue;
+
+		std::uint32_t h = 2166136261U; // FNV-1a
+		for(siz i = 0; i < n; ++i)
+			if(!(mask & (1U << i)))
+				h = (h ^ (unsigned char)key[i]) * 16777619U;
+
+		hashes.push_back(h);
+	}
+
+	std::sort(hashes.begin(), hashes.end());
+	hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+}
+
+void KeySuggest::clear()
+{
+	keys.clear();
+	ids.clear();
+	runs.clear();
+}
+
+void KeySuggest::add_run(std::vector<entry> run)
+{
+	runs.push_back(std::move(run));
+
+	while(runs.size() > 1 && runs[runs.size() - 2].size() <= 2 * runs.back().size())
+	{
+		const auto& a = runs[runs.size() - 2];
+		const auto& b = runs.back();
+
+		std::vector<entry> merged;
+		merged.reserve(a.size() + b.size());
+		std::merge(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(merged));
+
+		runs.pop_back();
+		runs.back().swap(merged);
+	}
+}
+
+void KeySuggest::insert(const str& key)
+{
+	if(ids.count(key))
+		return;
+
+	if(keys.size() == std::numeric_limits<key_id>::max())
+		rebuild();
+
+	const key_id id = key_id(keys.size());
+	keys.push_back(key);
+	ids[key] = id;
+
+	std::vector<std::uint32_t> hashes;
+	get_hashes(key, hashes);
+
+	std::vector<entry> run;
+	for(auto h: hashes)
+		run.push_back(entry(h) << 32 | id);
+
+	add_run(std::move(run)); // hashes are sorted so run is too
+}
+
+void KeySuggest::erase(const str& key)
+{
+	auto found = ids.find(key);
+
+	if(found == ids.end())
+		return;
+
+	// its entries stay until the next rebuild
+	// lookups skip them
+	keys[found->second].clear();
+	ids.erase(found);
+
+	if(keys.size() > 2 * ids.size() + 1024)
+		rebuild();
+}
+
+void KeySuggest::rebuild()
+{
+	std::vector<str> live;
+	live.reserve(ids.size());
+	for(auto&& key: keys)
+		if(!key.empty())
+			live.push_back(std::move(key));
+
+	clear();
+
+	keys.swap(live);
+
+	std::vector<entry> run;
+	std::vector<std::uint32_t> hashes;
+	for(key_id id = 0; id < keys.size(); ++id)
+	{
+		ids[keys[id]] = id;
+
+		hashes.clear();
+		get_hashes(keys[id], hashes);
+		for(auto h: hashes)
+			run.push_back(entry(h) << 32 | id);
+	}
+
+	std::sort(run.begin(), run.end());
+	runs.push_back(std::move(run));
+}
+
+str_vec KeySuggest::suggest(const str& key, siz max_distance, siz count, const filter& accept) const
+{
+	using best_key = std::pair<siz, const str*>; // distance, key
+
+	std::vector<best_key> best; // sorted, at most count
+
+	if(!count)
+		return {};
+
+	max_distance = std::min(max_distance, max_edits);
+
+	std::vector<std::uint32_t> hashes;
+	get_hashes(key, hashes);
+
+	std::vector<key_id> candidates;
+
+	for(auto h: hashes)
+	{
+		const entry lo = entry(h) << 32;
+		const entry hi = lo | 0xFFFFFFFFU;
+
+		for(auto&& run: runs)
+			for(auto e = std::lower_bound(run.begin(), run.end(), lo); e != run.end() && *e <= hi; ++e)
+				candidates.push_back(key_id(*e));
+	}
+
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+	siz max = max_distance;
+
+	for(auto id: candidates)
+	{
+		const str& k = keys[id];
+
+		if(k.empty()) // erased
+			continue;
+
+		const siz d = distance(key, k, max);
+
+		if(d > max || (accept && !accept(k)))
+			continue;
+
+		best_key found{d, &k};
+		best.insert(std::upper_bound(best.begin(), best.end(), found, [](const best_key& a, const best_key& b)
+		{
+			return a.first < b.first || (a.first == b.first && *a.second < *b.second);
+		}), found);
+
+		if(best.size() > count)
+			best.pop_back();
+
+		// nothing further away can make the list now
+		if(best.size() == count)
+			max = best.back().first;
+	}
+
+	str_vec found;
+	for(auto&& b: best)
+		found.push_back(*b.second);
+
+	return found;
+}
+
+void TextSearch::get_words(const str& text, str_vec& v)
+{
+	str word;
+
+	auto end_word = [&]
+	{
+		if(!word.empty())
+			v.push_back(std::move(word));
+		word.clear();
+	};
+
+	// up to two digits
+	auto skip_number = [&](siz& i)
+	{
+		siz d = 0;
+		while(d < 2 && i + 1 < text.size() && std::isdigit((unsigned char)text[i + 1]))
+			{ ++i; ++d; }
+		return d;
+	};
+
+	for(siz i = 0; i < text.size(); ++i)
+	{
+		const unsigned char c = text[i];
+
+		if(c == '\x03') // IRC colour ^Cfg(,bg)?
+		{
+			end_word();
+			if(skip_number(i) && i + 2 < text.size() && text[i + 1] == ','
+				&& std::isdigit((unsigned char)text[i + 2]))
+			{
+				++i;
+				skip_number(i);
+			}
+		}
+		else if(std::isalnum(c) || c >= 0x80) // keep UTF-8 words whole
+			word += char(std::tolower(c));
+		else
+			end_word();
+	}
+
+	end_word();
+}
+
+void TextSearch::clear()
+{
+	docs.clear();
+	ids.clear();
+	words.clear();
+	total_length = 0;
+}
+
+void TextSearch::set(const str& key, const str_vec& lines)
+{
+	erase(key);
+
+	std::unordered_map<str, std::uint32_t> tfs;
+	std::uint32_t length = 0;
+
+	str_vec v;
+	for(auto&& line: lines)
+	{
+		if(!line.empty() && line[0] == '=') // alias
+			continue;
+		v.clear();
+		get_words(line, v);
+		for(auto&& w: v)
+			++tfs[w];
+		length += std::uint32_t(v.size());
+	}
+
+	if(tfs.empty())
+		return;
+
+	if(docs.size() == std::numeric_limits<doc_id>::max())
+		compact();
+
+	const doc_id id = doc_id(docs.size());
+
+	document d;
+	d.key = key;
+	d.length = length;
+	d.words.reserve(tfs.size());
+
+	// new documents have the highest number so
+	// appending keeps the posting lists sorted
+	for(auto&& tf: tfs)
+	{
+		auto p = words.emplace(tf.first, std::vector<posting>()).first;
+		p->second.push_back({id, tf.second});
+		d.words.push_back(&p->first);
+	}
+
+	docs.push_back(std::move(d));
+	ids[key] = id;
+	total_length += length;
+}
+
+void TextSearch::erase(const str& key)
+{
+	auto found = ids.find(key);
+
+	if(found == ids.end())
+		return;
+
+	const doc_id id = found->second;
+	document& d = docs[id];
+
+	for(const str* w: d.words)
+	{
+		auto p = words.find(*w);
+		if(p == words.end())
+			continue;
+
+		auto& list = p->second;
+		auto pos = std::lower_bound(list.begin(), list.end(), id, [](const posting& a, doc_id b)
+		{
+			return a.doc < b;
+		});
+		if(pos != list.end() && pos->doc == id)
+			list.erase(pos);
+		if(list.empty())
+			words.erase(p);
+	}
+
+	total_length -= d.length;
+	d.key.clear();
+	std::vector<const str*>().swap(d.words);
+	ids.erase(found);
+
+	if(docs.size() > 2 * ids.size() + 1024)
+		compact();
+}
+
+void TextSearch::compact()
+{
+	// renumbering in the same order keeps the posting lists sorted
+	std::vector<doc_id> renumber(docs.size());
+	std::vector<document> live;
+	live.reserve(ids.size());
+
+	for(siz i = 0; i < docs.size(); ++i)
+	{
+		if(docs[i].key.empty())
+			continue;
+		renumber[i] = doc_id(live.size());
+		ids[docs[i].key] = doc_id(live.size());
+		live.push_back(std::move(docs[i]));
+	}
+
+	for(auto&& w: words)
+		for(auto&& p: w.second)
+			p.doc = renumber[p.doc];
+
+	docs.swap(live);
+}
+
+std::vector<TextSearch::hit> TextSearch::search(const str& query, siz max, const filter& accept) const
+{
+	std::vector<hit> hits;
+
+	if(ids.empty())
+		return hits;
+
+	str_vec v;
+	get_words(query, v);
+	std::sort(v.begin(), v.end());
+	v.erase(std::unique(v.begin(), v.end()), v.end());
+
+	struct term
+	{
+		const std::vector<posting>* list;
+		double idf;
+	};
+
+	const double n = double(ids.size());
+
+	std::vector<term> terms;
+	for(auto&& w: v)
+	{
+		auto p = words.find(w);
+		if(p == words.end())
+			continue;
+		const double df = double(p->second.size());
+		terms.push_back({&p->second, std::log(1 + (n - df + 0.5) / (df + 0.5))});
+	}
+
+	if(terms.empty())
+		return hits;
+
+	// rarest (highest scoring) words first
+	std::sort(terms.begin(), terms.end(), [](const term& a, const term& b)
+	{
+		return a.list->size() < b.list->size();
+	});
+
+	// BM25
+	const double k1 = 1.2;
+	const double b = 0.75;
+	const double avg_length = double(total_length) / n;
+
+	// the most the words from i on can add to a score
+	std::vector<double> rest(terms.size() + 1, 0);
+	for(siz i = terms.size(); i--;)
+		rest[i] = rest[i + 1] + terms[i].idf * (k1 + 1);
+
+	std::unordered_map<doc_id, double> scores; // negative = not accepted
+	siz accepted = 0;
+	bool grow = true; // can new documents still make the top max
+
+	std::vector<double> best;
+
+	for(siz i = 0; i < terms.size(); ++i)
+	{
+		if(grow && max && accepted >= max)
+		{
+			best.clear();
+			for(auto&& s: scores)
+				if(s.second >= 0)
+					best.push_back(s.second);
+			std::nth_element(best.begin(), best.begin() + (max - 1), best.end(), std::greater<double>());
+			grow = rest[i] >= best[max - 1];
+		}
+
+		for(auto&& p: *terms[i].list)
+		{
+			auto s = scores.find(p.doc);
+
+			if(s == scores.end())
+			{
+				if(!grow)
+					continue;
+				const bool ok = !accept || accept(docs[p.doc].key);
+				s = scores.emplace(p.doc, ok ? 0.0 : -1.0).first;
+				if(ok)
+					++accepted;
+			}
+
+			if(s->second < 0)
+				continue;
+
+			const double norm = k1 * (1 - b + b * docs[p.doc].length / avg_length);
+			s->second += terms[i].idf * p.tf * (k1 + 1) / (p.tf + norm);
+		}
+	}
+
+	std::vector<std::pair<double, doc_id>> ranked;
+	ranked.reserve(accepted);
+	for(auto&& s: scores)
+		if(s.second >= 0)
+			ranked.emplace_back(s.second, s.first);
+
+	// equal scores in key order
+	auto better = [&](const std::pair<double, doc_id>& a, const std::pair<double, doc_id>& b)
+	{
+		if(a.first != b.first)
+			return a.first > b.first;
+		return docs[a.second].key < docs[b.second].key;
+	};
+
+	if(max && ranked.size() > max)
+	{
+		std::partial_sort(ranked.begin(), ranked.begin() + max, ranked.end(), better);
+		ranked.resize(max);
+	}
+	else
+		std::sort(ranked.begin(), ranked.end(), better);
+
+	hits.reserve(ranked.size());
+	for(auto&& r: ranked)
+		hits.push_back({docs[r.second].key, r.first});
+
+	return hits;
+}
+
+}} // skivvy::factoid
@@ -0,0 +1,795 @@
+/*
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <skivvy/factoid-shards.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <sookee/str.h>
+#include <sookee/types/basic.h>
+#include <sookee/types/stream.h>
+
+#include <sookee/log.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::log;
+using namespace sookee::types;
+
+thread_local str FactoidShards::error;
+
+/**
+ * Is there a file with something in it?
+ */
+static bool has_data(const str& file)
+{
+	struct stat st;
+	return !::stat(file.c_str(), &st) && st.st_size > 0;
+}
+
+/**
+ * The shard numbers of the files named <file>.<i> with something in them.
+ */
+static std::vector<siz> find_shard_files(const str& file)
+{
+	const auto slash = file.rfind('/');
+	const str dir = slash == str::npos ? "." : slash ? file.substr(0, slash) : "/";
+	const str base = (slash == str::npos ? file : file.substr(slash + 1)) + ".";
+
+	std::vector<siz> found;
+
+	DIR* d = ::opendir(dir.c_str());
+	if(!d)
+		return found;
+
+	while(const dirent* e = ::readdir(d))
+	{
+		const str name = e->d_name;
+		if(name.size() <= base.size() || name.compare(0, base.size(), base))
+			continue;
+
+		const str num = name.substr(base.size());
+		if(num.size() > 9 || !std::all_of(num.begin(), num.end(), [](char c){ return c >= '0' && c <= '9'; }))
+			continue;
+
+		if(has_data(dir + "/" + name))
+			found.push_back(std::stoul(num));
+	}
+
+	::closedir(d);
+
+	std::sort(found.begin(), found.end());
+
+	return found;
+}
+
+FactoidShards::FactoidShards(const str& store_file, const str& index_file, const str& snapshot_file
+	, siz count, bool compress, siz body_cache)
+: stats(std::make_shared<FactoidStats>())
+, alias_hits(stats->cache("fm.alias_cache"))
+, store_file(store_file)
+, index_file(index_file)
+{
+	count = std::max<siz>(count, 1);
+
+	// before any shard files are made
+	if(!check_files(count))
+		log("ERROR: " + error);
+
+	auto name = [count](const str& file, siz i)
+	{
+		return count == 1 || file.empty() ? file : file + "." + std::to_string(i);
+	};
+
+	auto gauge_prefix = [count](siz i)
+	{
+		return count == 1 ? str("fm.") : "shard." + std::to_string(i) + ".fm.";
+	};
+
+	// loading is most of the start up so do it all at once
+	std::vector<std::future<std::unique_ptr<FactoidManager>>> loading;
+	for(siz i = 0; i < count; ++i)
+		loading.push_back(std::async(std::launch::async, [&, i]
+		{
+			return std::unique_ptr<FactoidManager>(new FactoidManager(name(store_file, i)
+				, name(index_file, i), name(snapshot_file, i), compress, body_cache, stats, gauge_prefix(i)));
+		}));
+
+	for(auto&& l: loading)
+		shards.push_back(l.get());
+
+	// aliases may lead to other shards so
+	// they are resolved and cached here
+	if(count > 1)
+		for(auto&& s: shards)
+			s->changed = [this](const str& key){ invalidate_aliases(key); };
+
+	fanout.start(count - 1, siz(-1));
+
+	move_merged_keys();
+
+	if(count == 1)
+		return;
+
+	// the totals of every shard (but the aliases are cached here)
+	for(auto&& gauge: shards[0]->get_gauges())
+	{
+		if(gauge == "alias_cache_entries")
+			continue;
+
+		std::vector<str> names;
+		for(siz i = 0; i < count; ++i)
+			names.push_back(gauge_prefix(i) + gauge);
+
+		FactoidStats& all = *stats;
+		stats->size("fm." + gauge, [&all, names]
+		{
+			siz total = 0;
+			for(auto&& n: names)
+				total += all.get_size(n);
+			return total;
+		});
+	}
+
+	stats->size("fm.alias_cache_entries", [this]
+	{
+		std::lock_guard<std::mutex> lock(alias_mtx);
+		return aliases.size();
+	});
+}
+
+FactoidShards::~FactoidShards()
+{
+	// the size gauges look at the shards
+	stats->stop_dump();
+	fanout.stop();
+}
+
+bool FactoidShards::check_files(siz count)
+{
+	for(auto&& file: {store_file, index_file})
+	{
+		if(count > 1 && has_data(file))
+		{
+			error = "facts for one shard found in " + file + " but there are " + std::to_string(count)
+				+ " shards, move them with skivvy-factoid-bulk --shards";
+			return false;
+		}
+
+		for(siz i: find_shard_files(file))
+		{
+			if(count > 1 && i < count)
+				continue;
+			error = "facts for shard " + std::to_string(i) + " found in " + file + "." + std::to_string(i)
+				+ " but there " + (count == 1 ? "is 1 shard" : "are " + std::to_string(count) + " shards")
+				+ ", move them with skivvy-factoid-bulk --shards";
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool FactoidShards::check_files()
+{
+	return check_files(shards.size());
+}
+
+siz FactoidShards::get_shard(const str& key) const
+{
+	if(shards.size() == 1)
+		return 0;
+
+	return siz(key_hash(key) % shards.size());
+}
+
+void FactoidShards::move_merged_keys()
+{
+	for(siz i = 0; i < shards.size(); ++i)
+	{
+		FactoidManager& from = *shards[i];
+
+		str_vec merged;
+		{
+			std::lock_guard<std::mutex> lock(from.write_mtx);
+			merged.swap(from.merged_keys);
+		}
+
+		for(auto&& key: merged)
+		{
+			FactoidManager& to = shard_of(key);
+			if(&to == &from)
+				continue;
+
+			const str_vec lines = from.get_fact(key, {});
+
+			str_set groups;
+			{
+				std::shared_lock<std::shared_timed_mutex> lock(from.data_mtx);
+				groups = from.get_groups(key);
+			}
+
+			for(auto&& line: lines)
+				to.add_fact(key, line);
+			if(!groups.empty())
+				to.add_to_groups(key, groups);
+
+			from.del_fact(key);
+
+			log("INFO: moved key to shard " + std::to_string(get_shard(key)) + ": " + key);
+		}
+	}
+}
+
+bool FactoidShards::all(const std::vector<str>& errors)
+{
+	for(siz i = 0; i < errors.size(); ++i)
+	{
+		if(errors[i].empty())
+			continue;
+		error = shards.size() == 1 ? errors[i] : "shard " + std::to_string(i) + ": " + errors[i];
+		return false;
+	}
+
+	return true;
+}
+
+std::uint64_t FactoidShards::get_generation() const
+{
+	// each only goes up so their sum does too
+	std::uint64_t generation = 0;
+	for(auto&& s: shards)
+		generation += s->get_generation();
+	return generation;
+}
+
+void FactoidShards::set_max_alias_depth(uns depth)
+{
+	for(auto&& s: shards)
+		s->max_alias_depth = depth;
+}
+
+void FactoidShards::set_max_suggest_distance(uns distance)
+{
+	for(auto&& s: shards)
+		s->max_suggest_distance = distance;
+}
+
+bool FactoidShards::save_snapshot()
+{
+	return all(each([](FactoidManager& s)
+	{
+		return s.save_snapshot() ? str() : FactoidManager::error;
+	}));
+}
+
+bool FactoidShards::open_journal(const str& file, std::chrono::milliseconds sync_interval
+	, std::chrono::seconds compact_interval)
+{
+	const siz count = shards.size();
+
+	std::vector<str> errors;
+	for(siz i = 0; i < count; ++i)
+	{
+		const str name = count == 1 ? file : file + "." + std::to_string(i);
+		errors.push_back(shards[i]->open_journal(name, sync_interval, compact_interval)
+			? str() : FactoidManager::error);
+	}
+
+	return all(errors);
+}
+
+void FactoidShards::sync()
+{
+	each([](FactoidManager& s){ s.sync(); return true; });
+}
+
+bool FactoidShards::reload()
+{
+	const bool ok = all(each([](FactoidManager& s)
+	{
+		return s.reload() ? str() : FactoidManager::error;
+	}));
+
+	move_merged_keys();
+
+	return ok;
+}
+
+bool FactoidShards::reload(siz shard)
+{
+	const bool ok = shards[shard]->reload();
+	if(!ok)
+		error = FactoidManager::error;
+
+	move_merged_keys();
+
+	return ok;
+}
+
+bool FactoidShards::watch_files(std::chrono::milliseconds settle)
+{
+	std::vector<str> errors;
+	for(auto&& s: shards)
+		errors.push_back(s->watch_files(settle) ? str() : FactoidManager::error);
+
+	return all(errors);
+}
+
+void FactoidShards::unwatch_files()
+{
+	for(auto&& s: shards)
+		s->unwatch_files();
+}
+
+void FactoidShards::set_history(siz max_edits, std::chrono::seconds max_age)
+{
+	for(auto&& s: shards)
+		s->set_history(max_edits, max_age);
+}
+
+bool FactoidShards::backup_facts(const str& file, bulk_format format)
+{
+	const siz count = shards.size();
+
+	// every shard is frozen as it starts, so within a shard
+	// the backup is of one moment (though not across shards)
+	return all(each([&](FactoidManager& s)
+	{
+		siz i = 0;
+		while(shards[i].get() != &s)
+			++i;
+		const str name = count == 1 ? file : file + "." + std::to_string(i);
+		return s.backup_facts(name, format) ? str() : FactoidManager::error;
+	}));
+}
+
+bool FactoidShards::import_facts(std::istream& is, bulk_format format, siz& added)
+{
+	const siz count = shards.size();
+
+	if(count == 1)
+	{
+		if(shards[0]->import_facts(is, format, added))
+			return true;
+		error = FactoidManager::error;
+		return false;
+	}
+
+	added = 0;
+
+	// split the input by shard first so it is all
+	// read, and found good, before any shard changes
+	str_vec files;
+	std::vector<std::unique_ptr<std::ofstream>> outs;
+	std::vector<std::unique_ptr<BulkWriter>> writers;
+	for(siz i = 0; i < count; ++i)
+	{
+		files.push_back(store_file + ".import." + std::to_string(i));
+		outs.emplace_back(new std::ofstream(files.back(), std::ios::trunc));
+		writers.emplace_back(new BulkWriter(*outs.back(), bulk_format::jsonl));
+	}
+
+	auto remove_files = [&]
+	{
+		outs.clear();
+		for(auto&& file: files)
+			std::remove(file.c_str());
+	};
+
+	BulkReader reader(is, format);
+	for(bulk_record rec; reader.next(rec);)
+		writers[get_shard(rec.key)]->write(rec.key, rec.facts, rec.groups);
+
+	if(!reader.error.empty())
+	{
+		error = reader.error;
+		remove_files();
+		return false;
+	}
+
+	for(siz i = 0; i < count; ++i)
+	{
+		if(!outs[i]->flush())
+		{
+			error = "can not write: " + files[i] + ": " + std::strerror(errno);
+			remove_files();
+			return false;
+		}
+	}
+	outs.clear();
+
+	std::vector<siz> adds(count);
+	const bool ok = all(each([&](FactoidManager& s)
+	{
+		siz i = 0;
+		while(shards[i].get() != &s)
+			++i;
+		std::ifstream ifs(files[i]);
+		return s.import_facts(ifs, bulk_format::jsonl, adds[i]) ? str() : FactoidManager::error;
+	}));
+
+	remove_files();
+
+	for(siz a: adds)
+		added += a;
+
+	return ok;
+}
+
+bool FactoidShards::export_facts(std::ostream& os, bulk_format format)
+{
+	for(auto&& s: shards)
+	{
+		if(!s->export_facts(os, format))
+		{
+			error = FactoidManager::error;
+			return false;
+		}
+	}
+	return true;
+}
+
+void FactoidShards::add_fact(const str& key, const str& fact, const str_set& groups)
+{
+	shard_of(key).add_fact(key, fact, groups);
+}
+
+bool FactoidShards::del_fact(const str& key, uns line, const str_set& groups)
+{
+	if(shard_of(key).del_fact(key, line, groups))
+		return true;
+	error = FactoidManager::error;
+	return false;
+}
+
+void FactoidShards::add_to_groups(const str& key, const str_set& groups)
+{
+	shard_of(key).add_to_groups(key, groups);
+}
+
+void FactoidShards::del_from_groups(const str& key, const str_set& groups)
+{
+	shard_of(key).del_from_groups(key, groups);
+}
+
+str_vec FactoidShards::get_fact(const str& key, const str_set& groups)
+{
+	return shard_of(key).get_fact(key, groups);
+}
+
+fact_lines FactoidShards::get_fact_lines(const str& key, const str_set& groups)
+{
+	return shard_of(key).get_fact_lines(key, groups);
+}
+
+bool FactoidShards::undo_fact(const str& key)
+{
+	if(shard_of(key).undo_fact(key))
+		return true;
+	error = FactoidManager::error;
+	return false;
+}
+
+bool FactoidShards::get_fact_at(const str& key, FactHistory::clock::time_point when, str_vec& lines
+	, const str_set& groups)
+{
+	// aliases may refer to keys in other shards
+	str_vec facts;
+	if(!shard_of(key).get_fact_at(key, when, facts, groups, false))
+	{
+		error = FactoidManager::error;
+		return false;
+	}
+
+	auto resolved = std::make_shared<resolved_lines>();
+	resolved->resolve(fold_key(key), [&](const str& k, fact_lines& more)
+	{
+		str_vec lines_then;
+		if(!shard_of(k).get_fact_at(k, when, lines_then, groups, false))
+			return false; // nothing if k was not in the groups either
+		more = fact_lines(std::move(lines_then));
+		return true;
+	}, get_max_alias_depth());
+
+	lines = resolved_lines::flatten(resolved, [](const str&){ return true; }).to_vec();
+
+	return true;
+}
+
+str_vec FactoidShards::get_resolved_fact(const str& key, const str_set& groups)
+{
+	return get_resolved_lines(key, groups).to_vec();
+}
+
+fact_lines FactoidShards::get_resolved_lines(const str& key, const str_set& groups)
+{
+	if(shards.size() == 1)
+		return shards[0]->get_resolved_lines(key, groups);
+
+	return resolve_lines(key, get_fact_lines(key, groups), groups);
+}
+
+fact_lines FactoidShards::resolve_lines(const str& given, fact_lines facts, const str_set& groups)
+{
+	// plain facts need no resolving
+	if(std::none_of(facts.begin(), facts.end(), [](const str_view& fact)
+		{ return !fact.empty() && fact[0] == '='; }))
+		return facts;
+
+	const str key = fold_key(given);
+
+	// every shard as of one moment, in shard order
+	// so two of us can't each wait for the other
+	std::vector<std::shared_lock<std::shared_timed_mutex>> locks;
+	for(auto&& s: shards)
+		locks.emplace_back(s->data_mtx);
+
+	std::unique_lock<std::mutex> alias_lock(alias_mtx);
+
+	auto lines = aliases.find(key);
+
+	if(lines)
+		alias_hits.hit();
+	else
+	{
+		alias_hits.miss();
+
+		alias_lock.unlock();
+
+		auto resolved = std::make_shared<resolved_lines>();
+		resolved->resolve(key, [this](const str& k, fact_lines& f)
+		{
+			return shard_of(k).find_facts(k, f);
+		}, get_max_alias_depth());
+
+		// no shard can change while we hold every data_mtx so
+		// if someone else got here first theirs is the same
+		alias_lock.lock();
+
+		aliases.insert(key, resolved);
+		lines = resolved;
+	}
+
+	alias_lock.unlock();
+
+	return resolved_lines::flatten(lines, [&](const str& k)
+	{
+		return groups.empty() || shard_of(k).in_groups(k, groups);
+	});
+}
+
+void FactoidShards::invalidate_aliases(const str& key)
+{
+	std::lock_guard<std::mutex> lock(alias_mtx);
+
+	if(key.empty())
+		aliases.clear();
+	else
+		aliases.invalidate(key);
+}
+
+std::vector<fact_lines> FactoidShards::get_facts(const str_vec& keys, const str_set& groups)
+{
+	if(shards.size() == 1)
+		return shards[0]->get_facts(keys, groups);
+
+	// which of keys each shard has
+	std::vector<std::vector<siz>> mine(shards.size());
+	for(siz i = 0; i < keys.size(); ++i)
+		mine[get_shard(keys[i])].push_back(i);
+
+	// aliases are followed afterwards as they may lead to other shards
+	auto got = each([&](FactoidManager& s)
+	{
+		siz shard = 0;
+		while(shards[shard].get() != &s)
+			++shard;
+
+		str_vec want;
+		for(siz i: mine[shard])
+			want.push_back(keys[i]);
+		return want.empty() ? std::vector<fact_lines>() : s.get_facts(want, groups, false);
+	});
+
+	std::vector<fact_lines> facts(keys.size());
+
+	for(siz shard = 0; shard < shards.size(); ++shard)
+	{
+		for(siz j = 0; j < mine[shard].size(); ++j)
+		{
+			const siz i = mine[shard][j];
+			fact_lines& f = got[shard][j];
+
+			if(std::none_of(f.begin(), f.end(), [](const str_view& fact)
+				{ return !fact.empty() && fact[0] == '='; }))
+			{
+				facts[i] = std::move(f);
+				continue;
+			}
+
+			facts[i] = resolve_lines(keys[i], std::move(f), groups);
+		}
+	}
+
+	return facts;
+}
+
+str_set FactoidShards::find_fact(const str& wild_key, const str_set& groups, siz max)
+{
+	str_set found;
+
+	visit_facts(wild_key, [&](const str& key)
+	{
+		found.insert(found.end(), key);
+	}, groups, max);
+
+	return found;
+}
+
+str_set FactoidShards::find_group(const str& wild_group)
+{
+	str_set found;
+
+	visit_groups(wild_group, [&](const str& group)
+	{
+		found.insert(found.end(), group);
+	});
+
+	return found;
+}
+
+std::vector<TextSearch::hit> FactoidShards::search_fact(const str& terms, const str_set& groups, siz max)
+{
+	if(shards.size() == 1)
+		return shards[0]->search_fact(terms, groups, max);
+
+	std::vector<TextSearch::hit> hits;
+
+	for(auto&& got: each([&](FactoidManager& s){ return s.search_fact(terms, groups, max); }))
+		hits.insert(hits.end(), got.begin(), got.end());
+
+	std::sort(hits.begin(), hits.end(), [](const TextSearch::hit& a, const TextSearch::hit& b)
+	{
+		return a.score > b.score || (a.score == b.score && a.key < b.key);
+	});
+
+	if(max && hits.size() > max)
+		hits.resize(max);
+
+	return hits;
+}
+
+str_vec FactoidShards::suggest_fact(const str& key, const str_set& groups, siz max)
+{
+	if(shards.size() == 1)
+		return shards[0]->suggest_fact(key, groups, max);
+
+	std::vector<std::pair<siz, str>> near; // distance, key
+
+	for(auto&& got: each([&](FactoidManager& s){ return s.suggest_fact(key, groups, max); }))
+		for(auto&& k: got)
+			near.emplace_back(KeySuggest::distance(key, k), k);
+
+	std::sort(near.begin(), near.end());
+
+	str_vec similar;
+	for(siz i = 0; i < near.size() && i < max; ++i)
+		similar.push_back(near[i].second);
+
+	return similar;
+}
+
+siz FactoidShards::visit_facts(const str& wild_key, const visitor& visit, const str_set& groups, siz max
+	, const StopToken* stop)
+{
+	if(shards.size() == 1)
+		return shards[0]->visit_facts(wild_key, visit, groups, max, stop);
+
+	std::atomic<bool> stopped{false};
+
+	// each shard's first max keys include the first max of them all
+	auto got = each([&](FactoidManager& s)
+	{
+		// a token is only for one thread
+		std::unique_ptr<StopToken> mine(stop ? new StopToken(*stop) : nullptr);
+
+		str_vec keys;
+		s.visit_facts(wild_key, [&](const str& key){ keys.push_back(key); }, groups, max, mine.get());
+		if(mine && mine->stopped())
+			stopped = true;
+		return keys;
+	});
+
+	str_vec keys;
+	for(auto&& g: got)
+		keys.insert(keys.end(), g.begin(), g.end());
+
+	std::sort(keys.begin(), keys.end());
+
+	if(max && keys.size() > max)
+		keys.resize(max);
+
+	// so the caller can tell the keys are incomplete
+	if(stopped)
+		stop->should_stop();
+
+	for(auto&& key: keys)
+		visit(key);
+
+	return keys.size();
+}
+
+siz FactoidShards::visit_groups(const str& wild_group, const visitor& visit, siz max
+	, const StopToken* stop)
+{
+	if(shards.size() == 1)
+		return shards[0]->visit_groups(wild_group, visit, max, stop);
+
+	std::atomic<bool> stopped{false};
+
+	auto got = each([&](FactoidManager& s)
+	{
+		std::unique_ptr<StopToken> mine(stop ? new StopToken(*stop) : nullptr);
+
+		str_vec groups;
+		s.visit_groups(wild_group, [&](const str& group){ groups.push_back(group); }, max, mine.get());
+		if(mine && mine->stopped())
+			stopped = true;
+		return groups;
+	});
+
+	// a group may have keys in several shards
+	str_set groups;
+	for(auto&& g: got)
+		groups.insert(g.begin(), g.end());
+
+	if(stopped)
+		stop->should_stop();
+
+	siz found = 0;
+	for(auto&& group: groups)
+	{
+		if(max && found == max)
+			break;
+		visit(group);
+		++found;
+	}
+
+	return found;
+}
+
+}} // skivvy::factoid
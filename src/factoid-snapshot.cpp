@@ -0,0 +1,524 @@
+/*
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <skivvy/factoid-snapshot.h>
+
+#include <map>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace skivvy { namespace factoid {
+
+static const char magic[8] = {'S', 'K', 'F', 'A', 'C', 'T', 'S', '\0'};
+static const std::uint32_t endian = 0x01020304;
+
+const std::uint32_t FactoidSnapshot::version;
+const std::uint64_t FactoidSnapshot::compressed;
+
+static void put_varint(str& out, std::uint64_t v)
+{
+	for(; v >= 0x80; v >>= 7)
+		out += char(v | 0x80);
+	out += char(v);
+}
+
+static bool get_varint(const char*& p, const char* end, std::uint64_t& v)
+{
+	v = 0;
+	for(unsigned shift = 0; p != end && shift < 64; shift += 7)
+	{
+		const unsigned char b = *p++;
+		v |= std::uint64_t(b & 0x7F) << shift;
+		if(!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+FactoidSnapshot::~FactoidSnapshot()
+{
+	if(map)
+		::munmap(map, map_size);
+}
+
+FactoidSnapshot::stamp_type FactoidSnapshot::get_stamp(const str& store_file, const str& index_file)
+{
+	stamp_type stamp = {{0, 0, 0, 0}};
+
+	struct stat st;
+
+	if(!::stat(store_file.c_str(), &st))
+	{
+		stamp[0] = std::uint64_t(st.st_size);
+		stamp[1] = std::uint64_t(st.st_mtim.tv_sec) * 1000000000 + std::uint64_t(st.st_mtim.tv_nsec);
+	}
+
+	if(!::stat(index_file.c_str(), &st))
+	{
+		stamp[2] = std::uint64_t(st.st_size);
+		stamp[3] = std::uint64_t(st.st_mtim.tv_sec) * 1000000000 + std::uint64_t(st.st_mtim.tv_nsec);
+	}
+
+	return stamp;
+}
+
+str FactoidSnapshot::get_image(const stamp_type& stamp, const source& next, bool compress)
+{
+	std::vector<key_rec> key_recs;
+	std::vector<str_ref> fact_refs;
+	std::vector<std::uint32_t> group_refs; // first seen ids until remapped below
+	std::map<str, std::uint32_t> group_ids;
+	str pool;
+
+	auto add = [&](const str& s) -> str_ref
+	{
+		str_ref r = {pool.size(), s.size()};
+		pool += s;
+		return r;
+	};
+
+	str key;
+	str_vec facts;
+	str_set groups;
+
+	while(next(key, facts, groups))
+	{
+		key_rec rec = {add(key), fact_refs.size(), facts.size(), group_refs.size(), groups.size(), {0, 0}};
+
+		for(auto&& f: facts)
+			fact_refs.push_back(add(f));
+
+		for(auto&& g: groups)
+			group_refs.push_back(group_ids.emplace(g, std::uint32_t(group_ids.size())).first->second);
+
+		key_recs.push_back(rec);
+
+		key.clear();
+		facts.clear();
+		groups.clear();
+	}
+
+	str_ref dict = {0, 0};
+
+	// repack the pool with each key's lines compressed together
+	if(compress)
+	{
+		std::vector<str_view> samples;
+		samples.reserve(fact_refs.size());
+		for(auto&& r: fact_refs)
+			samples.emplace_back(pool.data() + r.off, r.len);
+
+		const FactCodec codec(FactCodec::train(samples));
+		samples = std::vector<str_view>();
+
+		str packed;
+		str body;
+
+		for(auto&& rec: key_recs)
+		{
+			const str_ref k = {packed.size(), rec.key.len};
+			packed.append(pool, rec.key.off, rec.key.len);
+			rec.key = k;
+
+			body.clear();
+			for(auto f = rec.fact_first; f < rec.fact_first + rec.fact_count; ++f)
+			{
+				put_varint(body, fact_refs[f].len);
+				body.append(pool, fact_refs[f].off, fact_refs[f].len);
+			}
+
+			rec.fact_first = 0;
+			rec.body = {packed.size(), 0};
+			if(rec.fact_count)
+				codec.compress(body, packed);
+			rec.body.len = packed.size() - rec.body.off;
+		}
+
+		dict = {packed.size(), codec.dictionary().size()};
+		packed.append(codec.dictionary().data(), codec.dictionary().size());
+
+		pool.swap(packed);
+		fact_refs.clear();
+	}
+
+	// number the groups in name order
+	std::vector<str_ref> group_names;
+	std::vector<std::uint32_t> remap(group_ids.size());
+	for(auto&& g: group_ids)
+	{
+		remap[g.second] = std::uint32_t(group_names.size());
+		group_names.push_back(add(g.first));
+	}
+
+	for(auto&& id: group_refs)
+		id = remap[id];
+
+	header head;
+	std::memset(&head, 0, sizeof(head));
+	std::memcpy(head.magic, magic, sizeof(magic));
+	head.version = version;
+	head.endian = endian;
+	head.stamp = stamp;
+	head.key_count = key_recs.size();
+	head.fact_count = fact_refs.size();
+	head.group_count = group_names.size();
+	head.group_ref_count = group_refs.size();
+	head.pool_size = pool.size();
+	head.flags = compress ? compressed : 0;
+	head.dict = dict;
+
+	str image;
+	image.reserve(sizeof(head) + key_recs.size() * sizeof(key_rec)
+		+ fact_refs.size() * sizeof(str_ref) + group_names.size() * sizeof(str_ref)
+		+ group_refs.size() * sizeof(std::uint32_t) + pool.size());
+
+	image.append((const char*)&head, sizeof(head));
+	image.append((const char*)key_recs.data(), key_recs.size() * sizeof(key_rec));
+	image.append((const char*)fact_refs.data(), fact_refs.size() * sizeof(str_ref));
+	image.append((const char*)group_names.data(), group_names.size() * sizeof(str_ref));
+	image.append((const char*)group_refs.data(), group_refs.size() * sizeof(std::uint32_t));
+	image.append(pool);
+
+	return image;
+}
+
+bool FactoidSnapshot::write(const str& file, const stamp_type& stamp, const source& next, str& error
+	, bool compress)
+{
+	const str tmp = file + ".tmp";
+
+	{
+		const str image = get_image(stamp, next, compress);
+
+		std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+
+		if(!ofs.write(image.data(), image.size()) || !ofs.flush())
+		{
+			error = "can not write snapshot: " + tmp;
+			std::remove(tmp.c_str());
+			return false;
+		}
+	}
+
+	// anyone with the old one mapped keeps it
+	if(std::rename(tmp.c_str(), file.c_str()))
+	{
+		error = "can not replace snapshot: " + file + ": " + std::strerror(errno);
+		std::remove(tmp.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool FactoidSnapshot::open(const str& file)
+{
+	int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+
+	if(fd == -1)
+	{
+		error = "can not open snapshot: " + file + ": " + std::strerror(errno);
+		return false;
+	}
+
+	struct stat st;
+	if(::fstat(fd, &st) || siz(st.st_size) < sizeof(header))
+	{
+		::close(fd);
+		error = "bad snapshot: " + file;
+		return false;
+	}
+
+	map_size = siz(st.st_size);
+	map = ::mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+
+	if(map == MAP_FAILED)
+	{
+		map = nullptr;
+		error = "can not map snapshot: " + file + ": " + std::strerror(errno);
+		return false;
+	}
+
+	return attach((const char*)map, map_size, file);
+}
+
+bool FactoidSnapshot::build(const stamp_type& stamp, const source& next, bool compress)
+{
+	image = get_image(stamp, next, compress);
+	return attach(image.data(), image.size(), "(in memory)");
+}
+
+void FactoidSnapshot::set_cache(siz size, HitCounter* hits)
+{
+	std::lock_guard<std::mutex> lock(cache_mtx);
+
+	cache_size = size;
+	cache_hits = hits;
+
+	while(cache.size() > cache_size)
+	{
+		cache.erase(cache_order.back());
+		cache_order.pop_back();
+	}
+}
+
+bool FactoidSnapshot::attach(const char* data, siz data_size, const str& name)
+{
+	// only kept if it checks out
+	const header* h = (const header*)data;
+
+	if(std::memcmp(h->magic, magic, sizeof(magic)) || h->endian != endian)
+	{
+		error = "not a snapshot: " + name;
+		return false;
+	}
+
+	if(h->version != version)
+	{
+		error = "wrong snapshot version: " + name + ": " + std::to_string(h->version);
+		return false;
+	}
+
+	// check the tables fit without overflowing
+	siz end = sizeof(header);
+	auto table = [&](std::uint64_t count, siz size) -> const char*
+	{
+		if(count > (data_size - end) / size)
+			return nullptr;
+		const char* p = data + end;
+		end += count * size;
+		return p;
+	};
+
+	keys = (const key_rec*)table(h->key_count, sizeof(key_rec));
+	facts = (const str_ref*)table(h->fact_count, sizeof(str_ref));
+	groups = (const str_ref*)table(h->group_count, sizeof(str_ref));
+	group_refs = (const std::uint32_t*)table(h->group_ref_count, sizeof(std::uint32_t));
+	pool = table(h->pool_size, 1);
+
+	if(!keys || !facts || !groups || !group_refs || !pool || end != data_size
+		|| ((h->flags & compressed) && (h->dict.off > h->pool_size || h->dict.len > h->pool_size - h->dict.off)))
+	{
+		error = "corrupt snapshot: " + name;
+		return false;
+	}
+
+	head = h;
+
+	if(h->flags & compressed)
+		codec = FactCodec(get_view(h->dict));
+
+	return true;
+}
+
+str_view FactoidSnapshot::get_view(const str_ref& r) const
+{
+	if(r.off > head->pool_size || r.len > head->pool_size - r.off)
+		return {};
+	return str_view(pool + r.off, r.len);
+}
+
+str FactoidSnapshot::get_str(const str_ref& r) const
+{
+	str_view v = get_view(r);
+	return str(v.data(), v.size());
+}
+
+int FactoidSnapshot::compare(const str_ref& r, const str& s) const
+{
+	if(r.off > head->pool_size || r.len > head->pool_size - r.off)
+		return -1;
+
+	int cmp = std::memcmp(pool + r.off, s.data(), std::min<siz>(r.len, s.size()));
+
+	if(cmp)
+		return cmp;
+
+	return r.len < s.size() ? -1 : r.len > s.size() ? 1 : 0;
+}
+
+siz FactoidSnapshot::find(const str& key) const
+{
+	siz lo = 0;
+	siz hi = size();
+
+	while(lo < hi)
+	{
+		siz mid = lo + (hi - lo) / 2;
+		int cmp = compare(keys[mid].key, key);
+
+		if(!cmp)
+			return mid;
+
+		if(cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return npos;
+}
+
+siz FactoidSnapshot::fact_count(siz i) const
+{
+	return keys[i].fact_count;
+}
+
+str FactoidSnapshot::key(siz i) const
+{
+	return get_str(keys[i].key);
+}
+
+str_vec FactoidSnapshot::get_facts(siz i) const
+{
+	// not worth caching when every key is read
+	unpacked u;
+	if(is_compressed())
+		unpack(i, u);
+
+	std::vector<str_view> views;
+	if(is_compressed())
+		views = std::move(u.lines);
+	else
+		get_facts(i, views);
+
+	str_vec v;
+	v.reserve(views.size());
+	for(auto&& view: views)
+		v.emplace_back(view.data(), view.size());
+
+	return v;
+}
+
+std::shared_ptr<const void> FactoidSnapshot::get_facts(siz i, std::vector<str_view>& views) const
+{
+	if(is_compressed())
+	{
+		auto u = get_unpacked(i);
+		views.insert(views.end(), u->lines.begin(), u->lines.end());
+		return u;
+	}
+
+	const key_rec& rec = keys[i];
+
+	if(rec.fact_first > head->fact_count || rec.fact_count > head->fact_count - rec.fact_first)
+		return nullptr;
+
+	views.reserve(views.size() + rec.fact_count);
+	for(auto f = rec.fact_first; f < rec.fact_first + rec.fact_count; ++f)
+		views.push_back(get_view(facts[f]));
+
+	return nullptr;
+}
+
+void FactoidSnapshot::unpack(siz i, unpacked& u) const
+{
+	const key_rec& rec = keys[i];
+
+	if(!rec.fact_count || !codec.decompress(get_view(rec.body), u.text))
+		return;
+
+	const char* p = u.text.data();
+	const char* end = p + u.text.size();
+
+	std::uint64_t len;
+	while(p != end && get_varint(p, end, len) && len <= std::uint64_t(end - p))
+	{
+		u.lines.emplace_back(p, len);
+		p += len;
+	}
+
+	// the lines don't add up
+	if(p != end || u.lines.size() != rec.fact_count)
+		u.lines.clear();
+}
+
+std::shared_ptr<const FactoidSnapshot::unpacked> FactoidSnapshot::get_unpacked(siz i) const
+{
+	{
+		std::lock_guard<std::mutex> lock(cache_mtx);
+
+		auto found = cache.find(i);
+		if(found != cache.end())
+		{
+			if(cache_hits)
+				cache_hits->hit();
+			cache_order.splice(cache_order.begin(), cache_order, found->second.second);
+			return found->second.first;
+		}
+
+		if(cache_hits)
+			cache_hits->miss();
+	}
+
+	// decompressed outside the lock so lookups of other keys carry on
+	auto u = std::make_shared<unpacked>();
+	unpack(i, *u);
+
+	std::lock_guard<std::mutex> lock(cache_mtx);
+
+	if(!cache_size || cache.count(i))
+		return u;
+
+	cache_order.push_front(i);
+	cache.emplace(i, std::make_pair(u, cache_order.begin()));
+
+	if(cache.size() > cache_size)
+	{
+		cache.erase(cache_order.back());
+		cache_order.pop_back();
+	}
+
+	return u;
+}
+
+str_set FactoidSnapshot::get_groups(siz i) const
+{
+	const key_rec& rec = keys[i];
+
+	if(rec.group_first > head->group_ref_count || rec.group_count > head->group_ref_count - rec.group_first)
+		return {};
+
+	str_set s;
+	for(auto g = rec.group_first; g < rec.group_first + rec.group_count; ++g)
+		if(group_refs[g] < head->group_count)
+			s.insert(get_str(groups[group_refs[g]]));
+
+	return s;
+}
+
+}} // skivvy::factoid
@@ -0,0 +1,396 @@
+/*
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <skivvy/factoid-stats.h>
+#include <skivvy/factoid-search.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include <sookee/log.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::log;
+
+LatencyHistogram::LatencyHistogram()
+: n(0), sum(0), high(0)
+{
+	for(auto&& b: buckets)
+		b.store(0, std::memory_order_relaxed);
+}
+
+// values below 2 * subs get a bucket each, above that
+// each power of two is split into subs buckets
+siz LatencyHistogram::bucket(count_t ns)
+{
+	if(ns < subs)
+		return siz(ns);
+
+	unsigned msb = 63 - __builtin_clzll(ns);
+	unsigned shift = msb - sub_bits;
+
+	return siz((shift + 1) * subs + ((ns >> shift) & (subs - 1)));
+}
+
+// the largest value that goes in bucket b
+LatencyHistogram::count_t LatencyHistogram::bucket_top(siz b)
+{
+	if(b < subs)
+		return b;
+
+	unsigned shift = unsigned(b / subs - 1);
+
+	return ((subs + b % subs) << shift) + ((count_t(1) << shift) - 1);
+}
+
+void LatencyHistogram::record(clock::duration d)
+{
+	const count_t ns = d.count() > 0
+		? count_t(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count()) : 0;
+
+	buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+	n.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(ns, std::memory_order_relaxed);
+
+	count_t m = high.load(std::memory_order_relaxed);
+	while(ns > m && !high.compare_exchange_weak(m, ns, std::memory_order_relaxed)) {}
+}
+
+double LatencyHistogram::mean() const
+{
+	const count_t c = count();
+	return c ? double(sum.load(std::memory_order_relaxed)) / c : 0;
+}
+
+LatencyHistogram::count_t LatencyHistogram::percentile(double p) const
+{
+	// the buckets may be recorded into as we read them
+	// so the total is taken from the buckets themselves
+	std::array<count_t, bucket_count> counts;
+	count_t total = 0;
+
+	for(siz b = 0; b < bucket_count; ++b)
+		total += (counts[b] = buckets[b].load(std::memory_order_relaxed));
+
+	if(!total)
+		return 0;
+
+	const count_t wanted = std::max<count_t>(1, count_t(p * total + 0.5));
+
+	count_t seen = 0;
+	for(siz b = 0; b < bucket_count; ++b)
+		if((seen += counts[b]) >= wanted)
+			return std::min(bucket_top(b), max());
+
+	return max();
+}
+
+double HitCounter::rate() const
+{
+	const auto h = get_hits();
+	const auto lookups = h + get_misses();
+	return lookups ? double(h) / lookups : 0;
+}
+
+FactoidStats::FactoidStats()
+: started(clock::now())
+{
+}
+
+FactoidStats::~FactoidStats()
+{
+	stop_dump();
+}
+
+LatencyHistogram& FactoidStats::latency(const str& name)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	auto& h = latencies[name];
+	if(!h)
+		h.reset(new LatencyHistogram);
+
+	return *h;
+}
+
+HitCounter& FactoidStats::cache(const str& name)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+
+	auto& c = caches[name];
+	if(!c)
+		c.reset(new HitCounter);
+
+	return *c;
+}
+
+void FactoidStats::size(const str& name, const sizer& get)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	sizes[name] = get;
+}
+
+std::map<str, siz> FactoidStats::get_sizes() const
+{
+	std::map<str, sizer> sizers;
+
+	{
+		// the gauges may take locks of their own
+		std::lock_guard<std::mutex> lock(mtx);
+		sizers = sizes;
+	}
+
+	std::map<str, siz> got;
+	for(auto&& s: sizers)
+		got[s.first] = s.second();
+
+	return got;
+}
+
+siz FactoidStats::get_size(const str& name) const
+{
+	sizer get;
+
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		auto found = sizes.find(name);
+		if(found == sizes.end())
+			return 0;
+		get = found->second;
+	}
+
+	return get();
+}
+
+// 1234567 -> "1.23ms"
+static str human_ns(double ns)
+{
+	static const char* const units[] = {"ns", "us", "ms", "s"};
+
+	siz u = 0;
+	while(u < 3 && ns >= 1000)
+	{
+		ns /= 1000;
+		++u;
+	}
+
+	std::ostringstream oss;
+	oss << std::setprecision(ns < 10 ? 2 : 3) << ns << units[u];
+	return oss.str();
+}
+
+str_vec FactoidStats::report(const str& wild) const
+{
+	WildPattern match(wild);
+
+	const auto secs = std::chrono::duration<double>(clock::now() - started).count();
+
+	str_vec lines;
+
+	std::map<str, siz> got = get_sizes();
+
+	std::lock_guard<std::mutex> lock(mtx);
+
+	for(auto&& l: latencies)
+	{
+		const auto& h = *l.second;
+		if(!h.count() || !match.match(l.first))
+			continue;
+
+		std::ostringstream oss;
+		oss << std::fixed << std::setprecision(2);
+		oss << l.first << ": " << h.count() << " calls (" << (secs > 0 ? h.count() / secs : 0) << "/s)"
+			<< " p50 " << human_ns(h.percentile(0.50))
+			<< " p99 " << human_ns(h.percentile(0.99))
+			<< " max " << human_ns(h.max())
+			<< " mean " << human_ns(h.mean());
+		lines.push_back(oss.str());
+	}
+
+	for(auto&& c: caches)
+	{
+		if(!match.match(c.first))
+			continue;
+
+		std::ostringstream oss;
+		oss << std::fixed << std::setprecision(1);
+		oss << c.first << ": " << (c.second->rate() * 100) << "% hits ("
+			<< c.second->get_hits() << " of " << (c.second->get_hits() + c.second->get_misses()) << ")";
+		lines.push_back(oss.str());
+	}
+
+	for(auto&& s: got)
+		if(match.match(s.first))
+			lines.push_back(s.first + ": " + std::to_string(s.second));
+
+	return lines;
+}
+
+static void json_str(std::ostream& os, const str& s)
+{
+	os << '"';
+	for(char c: s)
+	{
+		if(c == '"' || c == '\\')
+			os << '\\' << c;
+		else if((unsigned char)c < 0x20)
+			os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+		else
+			os << c;
+	}
+	os << '"';
+}
+
+str FactoidStats::json() const
+{
+	const auto secs = std::chrono::duration<double>(clock::now() - started).count();
+
+	std::map<str, siz> got = get_sizes();
+
+	std::ostringstream os;
+	os << std::fixed << std::setprecision(1);
+
+	os << "{\n";
+	os << "\t\"uptime_sec\": " << secs << ",\n";
+
+	std::lock_guard<std::mutex> lock(mtx);
+
+	str sep;
+
+	os << "\t\"latency\": {";
+	for(auto&& l: latencies)
+	{
+		const auto& h = *l.second;
+		os << sep << "\n\t\t";
+		json_str(os, l.first);
+		os << ": {\"count\": " << h.count()
+			<< ", \"p50_ns\": " << h.percentile(0.50)
+			<< ", \"p90_ns\": " << h.percentile(0.90)
+			<< ", \"p99_ns\": " << h.percentile(0.99)
+			<< ", \"p999_ns\": " << h.percentile(0.999)
+			<< ", \"max_ns\": " << h.max()
+			<< ", \"mean_ns\": " << h.mean() << "}";
+		sep = ",";
+	}
+	os << "\n\t},\n";
+
+	sep.clear();
+	os << "\t\"cache\": {";
+	for(auto&& c: caches)
+	{
+		os << sep << "\n\t\t";
+		json_str(os, c.first);
+		os << ": {\"hits\": " << c.second->get_hits()
+			<< ", \"misses\": " << c.second->get_misses() << "}";
+		sep = ",";
+	}
+	os << "\n\t},\n";
+
+	sep.clear();
+	os << "\t\"size\": {";
+	for(auto&& s: got)
+	{
+		os << sep << "\n\t\t";
+		json_str(os, s.first);
+		os << ": " << s.second;
+		sep = ",";
+	}
+	os << "\n\t}\n";
+
+	os << "}\n";
+
+	return os.str();
+}
+
+bool FactoidStats::write(const str& file)
+{
+	const str tmp = file + ".tmp";
+
+	{
+		std::ofstream ofs(tmp, std::ios::trunc);
+		if(!(ofs << json()) || !ofs.flush())
+		{
+			error = "can not write stats: " + tmp;
+			std::remove(tmp.c_str());
+			return false;
+		}
+	}
+
+	// readers never see a half written file
+	if(std::rename(tmp.c_str(), file.c_str()))
+	{
+		error = "can not replace stats: " + file + ": " + std::strerror(errno);
+		std::remove(tmp.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+void FactoidStats::start_dump(const str& file, std::chrono::seconds interval)
+{
+	stop_dump();
+
+	if(!interval.count())
+		return;
+
+	dump_done = false;
+	dump_thread = std::thread([=]
+	{
+		std::unique_lock<std::mutex> lock(dump_mtx);
+		while(!dump_cv.wait_for(lock, interval, [&]{ return dump_done; }))
+		{
+			lock.unlock();
+			if(!write(file))
+				log("ERROR: " + error);
+			lock.lock();
+		}
+	});
+}
+
+void FactoidStats::stop_dump()
+{
+	if(!dump_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(dump_mtx);
+		dump_done = true;
+	}
+
+	dump_cv.notify_all();
+	dump_thread.join();
+}
+
+}} // skivvy::factoid
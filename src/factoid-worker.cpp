@@ -0,0 +1,159 @@
+/*
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <skivvy/factoid-worker.h>
+
+#include <exception>
+
+#include <sookee/log.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::log;
+
+StopToken::StopToken(clock::time_point deadline, const std::atomic<bool>* cancelled)
+: deadline(deadline)
+, cancelled(cancelled)
+{
+}
+
+bool StopToken::should_stop() const
+{
+	if(!stop)
+		stop = (cancelled && *cancelled) || clock::now() >= deadline;
+	return stop;
+}
+
+/**
+ * When a job given timeout and starting now must stop.
+ */
+static StopToken::clock::time_point get_deadline(std::chrono::milliseconds timeout)
+{
+	if(timeout == std::chrono::milliseconds::max())
+		return StopToken::clock::time_point::max();
+	return StopToken::clock::now() + timeout;
+}
+
+CommandPool::~CommandPool()
+{
+	stop();
+}
+
+void CommandPool::start(siz threads, siz max_queued)
+{
+	stop();
+
+	this->max_queued = max_queued;
+	done = false;
+
+	for(siz i = 0; i < threads; ++i)
+		this->threads.emplace_back([this]{ work(); });
+}
+
+void CommandPool::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		done = true;
+		jobs.clear();
+	}
+	cv.notify_all();
+
+	for(auto&& t: threads)
+		t.join();
+	threads.clear();
+}
+
+void CommandPool::work()
+{
+	std::unique_lock<std::mutex> lock(mtx);
+
+	while(true)
+	{
+		cv.wait(lock, [this]{ return done || !jobs.empty(); });
+
+		if(done)
+			break;
+
+		queued next = std::move(jobs.front());
+		jobs.pop_front();
+		++busy;
+
+		lock.unlock();
+
+		// one bad command must not take the bot down with it
+		try
+		{
+			next.run(StopToken(get_deadline(next.timeout), &done));
+		}
+		catch(const std::exception& e)
+		{
+			log("ERROR: command failed: " + str(e.what()));
+		}
+		catch(...)
+		{
+			log("ERROR: command failed");
+		}
+
+		lock.lock();
+
+		--busy;
+	}
+}
+
+bool CommandPool::submit(const job& run, std::chrono::milliseconds timeout)
+{
+	if(threads.empty())
+	{
+		run(StopToken(get_deadline(timeout)));
+		return true;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		if(done || jobs.size() >= max_queued)
+			return false;
+		jobs.push_back({run, timeout});
+	}
+	cv.notify_one();
+
+	return true;
+}
+
+bool CommandPool::submit(const job& run)
+{
+	return submit(run, std::chrono::milliseconds::max());
+}
+
+siz CommandPool::size() const
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	return jobs.size() + busy;
+}
+
+}} // skivvy::factoid
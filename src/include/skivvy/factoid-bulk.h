@@ -0,0 +1,155 @@
+#pragma once
+#ifndef _SKIVVY_IRCBOT_FACTOID_BULK_H_
+#define _SKIVVY_IRCBOT_FACTOID_BULK_H_
+/*
+ * factoid-bulk.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <vector>
+#include <memory>
+#include <istream>
+#include <ostream>
+#include <functional>
+
+#include <sookee/types/basic.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::types;
+
+/**
+ * Bulk fact file formats.
+ *
+ * tsv   - one fact per line: <key> TAB <fact> (TAB <group>(,<group>)*)?
+ *         with TAB, NL, CR and '\' escaped as \t \n \r \\.
+ *         An empty fact just adds key to the groups.
+ *
+ * jsonl - one JSON object per line:
+ *         {"key": "..", "facts": ["..", ..], "groups": ["..", ..]}
+ *         "fact": ".." may be given instead of "facts".
+ *
+ * Blank lines and (tsv) lines starting with '#' are skipped.
+ */
+enum class bulk_format { tsv, jsonl };
+
+/**
+ * @return false if name is not "tsv" or "jsonl"
+ */
+bool get_bulk_format(const str& name, bulk_format& format);
+
+struct bulk_record
+{
+	str key;
+	str_vec facts;
+	str_set groups;
+};
+
+/**
+ * Reads bulk records one line at a time.
+ */
+class BulkReader
+{
+	std::istream& is;
+	const bulk_format format;
+	siz line_number = 0;
+
+	bool parse_tsv(const str& line, bulk_record& rec);
+	bool parse_jsonl(const str& line, bulk_record& rec);
+
+public:
+	str error;
+
+	BulkReader(std::istream& is, bulk_format format);
+
+	/**
+	 * @return false at the end of the input or on error (see error).
+	 */
+	bool next(bulk_record& rec);
+};
+
+/**
+ * Writes bulk records.
+ */
+class BulkWriter
+{
+	std::ostream& os;
+	const bulk_format format;
+
+public:
+	BulkWriter(std::ostream& os, bulk_format format);
+
+	void write(const str& key, const str_vec& facts, const str_set& groups);
+};
+
+/**
+ * Sorts records by key in bounded memory. Once the records held
+ * reach max_facts they are sorted and spilled to a temporary run
+ * file; the runs are merged again at the end. The facts of each
+ * key keep their input order.
+ */
+class BulkSorter
+{
+	const str prefix; // of the run files
+	const siz max_facts;
+
+	std::vector<bulk_record> records;
+	siz facts = 0; // in records
+	str_vec runs; // run files, oldest first
+
+	bool spill();
+
+public:
+	using visitor = std::function<bool(const bulk_record& rec)>;
+
+	str error;
+
+	/**
+	 * @param prefix Run files are named <prefix>.<n>
+	 * @param max_facts How many facts to hold in memory.
+	 */
+	BulkSorter(const str& prefix, siz max_facts = 1 << 20);
+
+	/**
+	 * Removes the run files.
+	 */
+	~BulkSorter();
+
+	bool add(bulk_record&& rec);
+
+	/**
+	 * Hand each key with all its facts and groups to visit,
+	 * in key order. Stops early if visit returns false.
+	 * @return false on error (see error)
+	 */
+	bool merge(const visitor& visit);
+};
+
+}} // skivvy::factoid
+
+#endif // _SKIVVY_IRCBOT_FACTOID_BULK_H_
@@ -0,0 +1,101 @@
+#pragma once
+#ifndef _SKIVVY_IRCBOT_FACTOID_CODEC_H_
+#define _SKIVVY_IRCBOT_FACTOID_CODEC_H_
+/*
+ * factoid-codec.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <vector>
+#include <cstdint>
+#include <experimental/string_view>
+
+#include <sookee/types/basic.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::types;
+
+using str_view = std::experimental::string_view;
+
+/**
+ * A small LZ77 codec for fact text. Facts are short so on their
+ * own they hardly compress, but much of their text (links, "see
+ * also" and the like) recurs across the database. Matches may
+ * therefore also refer back into a dictionary of that common
+ * text, trained from the facts themselves.
+ *
+ * Compressed data is the varint length of the text followed
+ * by sequences, each:
+ *
+ * token   - literal length (high 4 bits) and match length - 4
+ *           (low 4 bits), 15 meaning more length bytes follow
+ * [bytes] - the rest of the literal length, 255 meaning more
+ * literals
+ * offset  - uint16 (little endian), how far back the match starts
+ *           in the dictionary followed by the text
+ * [bytes] - the rest of the match length
+ *
+ * The last sequence is literals only.
+ */
+class FactCodec
+{
+	str dict;
+	std::vector<std::uint32_t> dict_table; // hash of 4 bytes -> position in dict + 1
+
+public:
+	// matches only reach 64k back
+	static const siz max_dict = 1 << 15;
+
+	FactCodec() = default;
+	explicit FactCodec(str_view dict);
+
+	/**
+	 * Pick out the text that recurs most in samples.
+	 * @param samples The text to compress, or a fair part of it.
+	 * @param size The longest dictionary to make.
+	 */
+	static str train(const std::vector<str_view>& samples, siz size = max_dict);
+
+	str_view dictionary() const { return dict; }
+
+	/**
+	 * Append the compressed text to out.
+	 */
+	void compress(str_view text, str& out) const;
+
+	/**
+	 * Append the text in data to out.
+	 * @return false if data is corrupt.
+	 */
+	bool decompress(str_view data, str& out) const;
+};
+
+}} // skivvy::factoid
+
+#endif // _SKIVVY_IRCBOT_FACTOID_CODEC_H_
@@ -0,0 +1,147 @@
+#pragma once
+#ifndef _SKIVVY_IRCBOT_FACTOID_COMMAND_H_
+#define _SKIVVY_IRCBOT_FACTOID_COMMAND_H_
+/*
+ * factoid-command.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <vector>
+
+#include <skivvy/factoid-reply.h>
+
+namespace skivvy { namespace factoid {
+
+/**
+ * A list of views with room for the first few in place,
+ * so short lists (most group and key lists) never allocate.
+ */
+class view_list
+{
+	static const siz room = 8;
+
+	str_view first[room];
+	std::vector<str_view> more; // all of them once past room
+	siz count = 0;
+
+public:
+	void push_back(str_view v);
+	void clear() { more.clear(); count = 0; }
+
+	siz size() const { return count; }
+	bool empty() const { return !count; }
+
+	const str_view* begin() const { return count > room ? more.data() : first; }
+	const str_view* end() const { return begin() + count; }
+
+	const str_view& operator[](siz i) const { return begin()[i]; }
+};
+
+/**
+ * The parameters of a factoid command as views into the text
+ * they were parsed from, which must outlive them.
+ */
+struct fact_command
+{
+	static const uns noline = uns(-1);
+
+	str_view nick;
+	view_list groups;
+	view_list keys;
+	str_view text; // trimmed
+	uns line = noline;
+};
+
+/**
+ * What each command expects after its name. An optional
+ * [<group>(,<group>)*] may come first where shown.
+ */
+enum class command_syntax
+{
+	key_text,   // [groups]? <key> <text>      !addfact
+	key_groups, // <key> <group>(,<group>)*    !addgroup
+	key_line,   // [groups]? <key> #<line>?    !delfact
+	text,       // [groups]? <text>            !findfact, !searchfact
+	bare_text,  // <text>                      !findgroup
+	keys,       // [groups]? <key>+            !fact
+	nick_keys,  // <nick> [groups]? <key>+     !give
+};
+
+/**
+ * Walks command parameters a token at a time without
+ * copying them.
+ */
+class CommandParser
+{
+	str_view rest;
+
+	void skip_space();
+
+public:
+	explicit CommandParser(str_view params): rest(params) {}
+
+	bool done();
+
+	/**
+	 * @return The next word or empty at the end.
+	 */
+	str_view word();
+
+	/**
+	 * Read a [<group>(,<group>)*] list if one comes next.
+	 * The groups are trimmed and empty ones left out.
+	 * @return false if the list has no closing ']'.
+	 */
+	bool group_list(view_list& groups);
+
+	/**
+	 * Read a <group>(,<group>)* list to the end.
+	 */
+	void comma_list(view_list& groups);
+
+	/**
+	 * @return Whatever is left, trimmed.
+	 */
+	str_view tail();
+};
+
+/**
+ * Parse params the way syntax says.
+ * @return false if something required is missing or bad. For a
+ * bad line number cmd.text is left holding it.
+ */
+bool parse_command(str_view params, command_syntax syntax, fact_command& cmd);
+
+/**
+ * Copy views into a set.
+ */
+str_set to_set(const view_list& views);
+
+}} // skivvy::factoid
+
+#endif // _SKIVVY_IRCBOT_FACTOID_COMMAND_H_
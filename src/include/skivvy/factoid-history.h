@@ -0,0 +1,126 @@
+#pragma once
+#ifndef _SKIVVY_IRCBOT_FACTOID_HISTORY_H_
+#define _SKIVVY_IRCBOT_FACTOID_HISTORY_H_
+/*
+ * factoid-history.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <deque>
+#include <chrono>
+#include <memory>
+
+#include <sookee/types/basic.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::types;
+
+/**
+ * The recent edits of the fact database, each as the key was
+ * just before it. The facts are shared with the database (it
+ * never changes them in place, only replaces them) so an edit
+ * only costs a copy of its key's facts if they had not been
+ * edited already.
+ *
+ * The state of a key at any time since get_since() is that
+ * before the first edit of it after that time, or as it is
+ * now if it has not been edited since.
+ *
+ * Not locked, the FactoidManager guards it with its own locks.
+ */
+class FactHistory
+{
+public:
+	using clock = std::chrono::system_clock;
+
+	struct entry
+	{
+		clock::time_point when;
+		str key;
+		std::shared_ptr<const str_vec> facts; // before the edit (null if none)
+		str_set groups; // before the edit
+		bool undone = false; // undone, or an undo itself
+	};
+
+private:
+	std::deque<entry> entries; // oldest first
+
+	// nothing is known of the edits before this
+	clock::time_point since = clock::now();
+
+	siz max_entries = 1000;
+	std::chrono::seconds max_age = std::chrono::hours(24 * 7);
+
+	/**
+	 * Forget the edits that are too many or too old.
+	 */
+	void trim(clock::time_point now);
+
+public:
+	/**
+	 * Forget edits beyond the last max_entries or older than max_age.
+	 */
+	void set_limits(siz max_entries, std::chrono::seconds max_age);
+
+	/**
+	 * Record an edit of key.
+	 * @param facts The facts of key before the edit.
+	 * @param groups The groups of key before the edit.
+	 */
+	void record(const str& key, std::shared_ptr<const str_vec> facts, const str_set& groups
+		, clock::time_point when = clock::now());
+
+	/**
+	 * Find the last edit of key that has not been undone, mark
+	 * it undone and record the undo (which can not be undone
+	 * itself) in its place.
+	 * @param facts The facts of key now.
+	 * @param groups The groups of key now.
+	 * @param e Receives the edit, with key as it was before it.
+	 * @return false if there is nothing to undo.
+	 */
+	bool undo(const str& key, std::shared_ptr<const str_vec> facts, const str_set& groups
+		, entry& e, clock::time_point when = clock::now());
+
+	/**
+	 * The first edit of key (in the order they were made) stamped
+	 * after when, which has key as it was then. Only meaningful if
+	 * when is not before get_since().
+	 * @return null if key has not been edited since.
+	 */
+	const entry* find_after(const str& key, clock::time_point when) const;
+
+	clock::time_point get_since() const { return since; }
+
+	siz size() const { return entries.size(); }
+};
+
+}} // skivvy::factoid
+
+#endif // _SKIVVY_IRCBOT_FACTOID_HISTORY_H_
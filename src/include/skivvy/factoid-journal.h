@@ -0,0 +1,139 @@
+#pragma once
+#ifndef _SKIVVY_IRCBOT_FACTOID_JOURNAL_H_
+#define _SKIVVY_IRCBOT_FACTOID_JOURNAL_H_
+/*
+ * factoid-journal.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+#include <sookee/types/basic.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::types;
+
+/**
+ * Write ahead log for fact edits.
+ *
+ * Every edit is recorded as the complete new state of one key
+ * so replaying the log is idempotent. A background thread writes
+ * the records in batches, fsyncing once per batch, and every
+ * compact interval hands the latest state of each edited key
+ * to the compactor, truncating the log once it succeeds.
+ *
+ * Log format, one record per line, fields separated by TAB
+ * with TAB, NL, CR and '\' escaped:
+ *
+ * F <key> <fact>*    - the facts of key (none = deleted)
+ * G <key> <group>*   - the groups of key (none = no groups)
+ */
+class FactoidJournal
+{
+public:
+	using clock = std::chrono::steady_clock;
+	using key_values = std::map<str, str_vec>;
+
+	/**
+	 * Called for each record when the log is replayed.
+	 */
+	using applier = std::function<void(char type, const str& key, const str_vec& values)>;
+
+	/**
+	 * Called from the journal thread with the latest facts and groups
+	 * of every key edited since the last compaction. The log is only
+	 * truncated once it returns true, otherwise the edits are kept
+	 * for the next compaction.
+	 */
+	using compactor = std::function<bool(const key_values& facts, const key_values& groups)>;
+
+private:
+	const str file;
+	const std::chrono::milliseconds sync_interval;
+	const std::chrono::seconds compact_interval;
+	const compactor compact;
+
+	int fd = -1;
+
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::condition_variable synced_cv;
+	bool done = false;
+	unsigned long sync_requests = 0;
+	unsigned long syncs_done = 0;
+
+	str pending; // records not yet written
+	key_values dirty_facts;
+	key_values dirty_groups;
+
+	std::thread thread;
+
+	void run();
+	void flush(std::unique_lock<std::mutex>& lock, bool compact_now);
+	void record(char type, const str& key, const str_vec& values);
+
+public:
+	str error;
+
+	FactoidJournal(const str& file, std::chrono::milliseconds sync_interval
+		, std::chrono::seconds compact_interval, compactor compact);
+
+	/**
+	 * Stop the journal thread after writing and
+	 * compacting everything outstanding.
+	 */
+	~FactoidJournal();
+
+	/**
+	 * Replay every complete record in the log, dropping any
+	 * torn record at the end, then start the journal thread.
+	 * Replayed records are compacted with the next batch.
+	 * @param apply
+	 * @return false on error (see error)
+	 */
+	bool open(const applier& apply);
+
+	void set_facts(const str& key, const str_vec& facts);
+	void set_groups(const str& key, const str_set& groups);
+
+	/**
+	 * Write, fsync and compact everything outstanding
+	 * and wait for it to finish.
+	 */
+	void sync();
+};
+
+}} // skivvy::factoid
+
+#endif // _SKIVVY_IRCBOT_FACTOID_JOURNAL_H_
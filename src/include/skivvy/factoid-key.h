@@ -0,0 +1,81 @@
+#pragma once
+#ifndef _SKIVVY_IRCBOT_FACTOID_KEY_H_
+#define _SKIVVY_IRCBOT_FACTOID_KEY_H_
+/*
+ * factoid-key.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <cstdint>
+#include <experimental/string_view>
+
+#include <sookee/types/basic.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::types;
+
+using str_view = std::experimental::string_view;
+
+/**
+ * Keys are kept case folded so "Foo", "FOO" and "foo" are all one
+ * key. Letters are folded by their simple Unicode case folding
+ * (Latin-1, Latin Extended-A and Additional, Greek and Coptic,
+ * Greek Extended, Cyrillic, Armenian and fullwidth Latin), except
+ * where that would change how many bytes a UTF-8 key takes (U+0130,
+ * U+017F, U+1E9E and U+1FBE stay as they are). Anything that is not
+ * valid UTF-8 is left as it is. Keys that are all ASCII are
+ * folded 16 bytes at a time where SSE2 is available.
+ */
+
+/**
+ * Is key already as fold_key() would leave it?
+ */
+bool is_folded(str_view key);
+
+/**
+ * Fold key into folded.
+ */
+void fold_key(str_view key, str& folded);
+str fold_key(str_view key);
+
+/**
+ * Fold key in place.
+ * @return false if it was already folded.
+ */
+bool fold_key_in_place(str& key);
+
+/**
+ * FNV-1a of the folded key, worked out without folding a
+ * copy of it. Keys that fold alike hash alike.
+ */
+std::uint64_t key_hash(str_view key);
+
+}} // skivvy::factoid
+
+#endif // _SKIVVY_IRCBOT_FACTOID_KEY_H_
@@ -0,0 +1,812 @@
+#pragma once
+#ifndef _SKIVVY_IRCBOT_FACTOID_MANAGER_H_
+#define _SKIVVY_IRCBOT_FACTOID_MANAGER_H_
+/*
+ * factoid-manager.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <map>
+#include <array>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <functional>
+#include <shared_mutex>
+
+#include <skivvy/store.h>
+#include <skivvy/factoid-key.h>
+#include <skivvy/factoid-bulk.h>
+#include <skivvy/factoid-stats.h>
+#include <skivvy/factoid-search.h>
+#include <skivvy/factoid-history.h>
+#include <skivvy/factoid-journal.h>
+#include <skivvy/factoid-snapshot.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace skivvy::utils;
+
+/**
+ * The (case folded) key an alias line "= <key>" refers to.
+ */
+str alias_of(str_view fact);
+
+/**
+ * The lines of a fact as views into the database rather than
+ * copies. Whatever the views point into is kept alive for as
+ * long as the fact_lines are, so they stay valid even if the
+ * fact is edited or the database reloaded meanwhile.
+ */
+class fact_lines
+{
+	friend class FactoidManager;
+	friend class FactoidShards;
+	friend struct resolved_lines;
+
+	std::shared_ptr<const void> pin; // owns the viewed text
+	std::vector<str_view> lines;
+
+public:
+	using const_iterator = std::vector<str_view>::const_iterator;
+
+	fact_lines() = default;
+
+	/**
+	 * Lines that own their text.
+	 */
+	explicit fact_lines(str_vec lines);
+
+	const_iterator begin() const { return lines.begin(); }
+	const_iterator end() const { return lines.end(); }
+
+	siz size() const { return lines.size(); }
+	bool empty() const { return lines.empty(); }
+
+	const str_view& operator[](siz i) const { return lines[i]; }
+
+	/**
+	 * Copy the lines out.
+	 */
+	str_vec to_vec() const;
+};
+
+/**
+ * The facts of a key with its alias lines ("= <key>") followed
+ * depth first, skipping any alias that would loop or go deeper
+ * than max_depth. Each line remembers the key it came from so
+ * groups can be applied to the aliased keys afterwards.
+ */
+struct resolved_lines
+{
+	struct line
+	{
+		str key; // the key this line came from
+		str_view fact; // empty for an alias marker
+		siz depth; // alias hops from the requested key
+		bool alias; // marks where the lines of an aliased key (one deeper) start
+	};
+
+	std::vector<std::shared_ptr<const void>> pins; // owns the viewed facts
+	std::vector<line> lines;
+	str_set deps; // every key looked up
+
+	/**
+	 * Get the facts of key.
+	 * @return false if it has none.
+	 */
+	using lookup = std::function<bool(const str& key, fact_lines& facts)>;
+
+	void resolve(const str& key, const lookup& find, siz max_depth);
+
+	/**
+	 * The lines of r, leaving out those of every aliased
+	 * key (and whatever it aliases) that in says no to.
+	 */
+	static fact_lines flatten(const std::shared_ptr<const resolved_lines>& r
+		, const std::function<bool(const str& key)>& in);
+
+private:
+	void resolve(const str& key, const lookup& find, siz max_depth, siz depth, str_vec& chain);
+};
+
+/**
+ * Alias resolutions by the key they start from, each dropped
+ * as soon as any key it read changes. Not locked.
+ */
+class AliasCache
+{
+public:
+	using entry = std::shared_ptr<const resolved_lines>;
+
+private:
+	std::map<str, entry> entries;
+	std::map<str, str_set> dependents; // key -> cached keys that read it
+
+public:
+	/**
+	 * @return null if key is not cached.
+	 */
+	entry find(const str& key) const;
+
+	/**
+	 * Keep lines until any of lines->deps changes.
+	 */
+	void insert(const str& key, entry lines);
+
+	/**
+	 * Drop every resolution that read key.
+	 */
+	void invalidate(const str& key);
+
+	void clear();
+
+	siz size() const { return entries.size(); }
+};
+
+/**
+ * A map from keys to T split into chunks by key hash, each one
+ * shared between copies of the map until one of them changes it.
+ * So a copy costs one pointer and the first change to a chunk
+ * after a copy copies only that chunk. Not locked.
+ */
+template<typename T>
+class SharedMap
+{
+public:
+	using value_type = std::pair<const str, T>;
+
+private:
+	static const siz chunk_count = 64;
+
+	using chunk = std::map<str, T>;
+	using chunks = std::array<std::shared_ptr<chunk>, chunk_count>;
+
+	std::shared_ptr<chunks> all = std::make_shared<chunks>();
+	siz count = 0;
+
+	static siz chunk_of(const str& key) { return siz(key_hash(key) % chunk_count); }
+
+	// the chunk of key, copied first if any copy shares it
+	chunk& edit(const str& key)
+	{
+		if(all.use_count() > 1)
+			all = std::make_shared<chunks>(*all);
+
+		auto& c = (*all)[chunk_of(key)];
+		if(!c)
+			c = std::make_shared<chunk>();
+		else if(c.use_count() > 1)
+			c = std::make_shared<chunk>(*c);
+
+		return *c;
+	}
+
+public:
+	/**
+	 * @return null if key is not in the map.
+	 */
+	const T* find(const str& key) const
+	{
+		const auto& c = (*all)[chunk_of(key)];
+		if(!c)
+			return nullptr;
+		auto found = c->find(key);
+		return found == c->end() ? nullptr : &found->second;
+	}
+
+	void set(const str& key, T value)
+	{
+		auto added = edit(key).emplace(key, T());
+		if(added.second)
+			++count;
+		added.first->second = std::move(value);
+	}
+
+	void erase(const str& key)
+	{
+		if(find(key))
+			count -= edit(key).erase(key);
+	}
+
+	void clear()
+	{
+		all = std::make_shared<chunks>();
+		count = 0;
+	}
+
+	siz size() const { return count; }
+
+	/**
+	 * Every entry, in key order.
+	 */
+	std::vector<const value_type*> sorted() const
+	{
+		std::vector<const value_type*> entries;
+		entries.reserve(count);
+		for(auto&& c: *all)
+			if(c)
+				for(auto&& e: *c)
+					entries.push_back(&e);
+		std::sort(entries.begin(), entries.end(), [](const value_type* a, const value_type* b)
+		{
+			return a->first < b->first;
+		});
+		return entries;
+	}
+};
+
+/**
+ * The fact database. Safe to use from several threads at once.
+ *
+ * Keys are case folded (see fold_key()) whenever they come in, so
+ * every call takes a key in any case. Keys on file that are not
+ * folded yet are merged into their folded key as they are loaded.
+ *
+ * Edits are serialised by write_mtx, which is held while an edit is
+ * worked out and persisted. data_mtx is only held exclusively for the
+ * moment the in memory data is updated, so lookups (which hold it
+ * shared) are never kept waiting for a write to disk.
+ *
+ * The database is an immutable snapshot with the edits since laid
+ * over it (in SharedMaps), and edited facts are replaced rather than
+ * changed. So a copy of the whole database as it is at one moment
+ * is a few pointers, and the recent edits (see FactHistory) share
+ * their facts with it.
+ */
+class FactoidManager
+{
+	friend class FactoidShards;
+
+	// first so it outlives everything its size gauges look at
+	// (unless it is shared, see the constructor)
+	const std::shared_ptr<FactoidStats> stats_owner;
+	FactoidStats& stats;
+
+	// the names of our size gauges, without gauge_prefix
+	str_vec gauges;
+
+	// the figures recorded on every call, looked up once
+	struct timings
+	{
+		LatencyHistogram& add_fact;
+		LatencyHistogram& del_fact;
+		LatencyHistogram& add_to_groups;
+		LatencyHistogram& del_from_groups;
+		LatencyHistogram& find_fact;
+		LatencyHistogram& find_group;
+		LatencyHistogram& search_fact;
+		LatencyHistogram& suggest_fact;
+		LatencyHistogram& get_fact;
+		LatencyHistogram& get_resolved_fact;
+		LatencyHistogram& get_facts;
+		LatencyHistogram& reload;
+		LatencyHistogram& save_snapshot;
+		LatencyHistogram& sync;
+		LatencyHistogram& import_facts;
+		LatencyHistogram& export_facts;
+		LatencyHistogram& backup_facts;
+		LatencyHistogram& undo_fact;
+		LatencyHistogram& get_fact_at;
+		HitCounter& alias_cache;
+		HitCounter& body_cache;
+
+		explicit timings(FactoidStats& stats);
+	} timed;
+
+	std::mutex write_mtx;
+	mutable std::shared_timed_mutex data_mtx;
+	std::mutex alias_mtx; // lookups fill in the alias cache
+
+	const str store_file;
+	const str index_file;
+	const str snapshot_file;
+
+	// keep the facts of the snapshot compressed, with
+	// the last body_cache keys looked up decompressed
+	const bool compress;
+	const siz body_cache;
+
+	// persistent copies of facts and key_groups
+	std::mutex store_mtx; // store and index are written by the journal thread
+	BackupStore store;
+	BackupStore index;
+
+	// the store files as we last left them so reload() can
+	// tell if anyone else has changed them (under store_mtx)
+	FactoidSnapshot::stamp_type files_stamp = {{0, 0, 0, 0}};
+	bool files_changed = false;
+
+	// the database as of the last load or snapshot, mapped from
+	// snapshot_file or else built in memory as one arena
+	std::shared_ptr<const FactoidSnapshot> snapshot;
+
+	// key -> facts, overriding the snapshot
+	// (null facts mark a key deleted since)
+	// shared so lookups can hand out views of them
+	SharedMap<std::shared_ptr<const str_vec>> facts;
+
+	// in memory mirror of index so group lookups
+	// don't need to walk the index file
+	GroupIndex key_groups;
+
+	// key -> groups, overriding the snapshot (as facts does)
+	SharedMap<std::shared_ptr<const str_set>> group_edits;
+
+	// the key as it was before each recent edit (under data_mtx)
+	FactHistory history;
+
+	KeySearch keys;
+	TextSearch text; // words of the facts
+	KeySuggest similar; // keys by edit distance
+
+	// bumped by every change to facts or key_groups (under data_mtx)
+	std::atomic<std::uint64_t> generation{0};
+
+	// if set edits are persisted through it rather than
+	// written straight to store and index
+	std::unique_ptr<FactoidJournal> journal;
+
+	// keys fold_keys() has merged into since the FactoidShards
+	// last looked, which may now belong in another shard
+	str_vec merged_keys;
+
+	// reloads when the store files are changed from outside
+	std::thread watch_thread;
+	std::atomic<bool> watch_done{false};
+
+	// the whole database as it was at one moment, which
+	// can be read at leisure without holding data_mtx
+	struct frozen
+	{
+		std::shared_ptr<const FactoidSnapshot> snapshot;
+		SharedMap<std::shared_ptr<const str_vec>> facts;
+		SharedMap<std::shared_ptr<const str_set>> groups;
+	};
+
+	/**
+	 * Copy the database as it is now, which shares everything
+	 * with it (so data_mtx is held for a moment whatever the
+	 * size of the database or the number of edits).
+	 */
+	frozen freeze() const;
+
+	/**
+	 * Write every key of db with its facts and groups to os in key order.
+	 * @return false on error (see error)
+	 */
+	bool write_frozen(const frozen& db, std::ostream& os, bulk_format format);
+
+	// flattened facts for keys that contain aliases (under alias_mtx)
+	AliasCache aliases;
+
+	// told of every key whose facts change, or of "" when they all
+	// may have, with data_mtx held exclusively (see FactoidShards)
+	std::function<void(const str& key)> changed;
+
+	/**
+	 * The facts of key if it is in the groups of in (or groups
+	 * is empty), with aliases followed if resolve is set.
+	 * Must be called with data_mtx held.
+	 */
+	fact_lines resolve_lines(const str& key, const str_set& groups
+		, const GroupIndex::filter& in, bool resolve);
+
+	/**
+	 * The facts and groups key had at the time when, which must not
+	 * be before history.get_since().
+	 * Must be called with data_mtx held.
+	 */
+	void find_facts_at(const str& key, FactHistory::clock::time_point when
+		, str_vec& lines, str_set& groups) const;
+
+	/**
+	 * Rebuild everything in memory from the snapshot if it is
+	 * current, otherwise from store and index packed into one
+	 * arena. Lookups see the old data until it is all ready.
+	 * Must be called with write_mtx locked.
+	 */
+	void load();
+
+	/**
+	 * Bring the in memory data into line with store and index
+	 * (already reloaded) updating only the keys that differ.
+	 * Must be called with write_mtx locked.
+	 */
+	void load_changes();
+
+	/**
+	 * Merge every key that is not case folded into its folded
+	 * key, after the folded key's own facts and then in key order,
+	 * taking the groups of them all. Once the files are merged
+	 * this finds nothing to do.
+	 * Must be called with write_mtx locked.
+	 */
+	void fold_keys();
+
+	/**
+	 * Have store or index been changed other than by us since
+	 * we last loaded or wrote them?
+	 */
+	bool files_changed_outside();
+
+	/**
+	 * Run write, which updates store and/or index, noting first
+	 * whether they were changed by anyone else since our last write.
+	 * Must be called with store_mtx locked.
+	 */
+	template<typename Write>
+	void write_files(Write write);
+
+	/**
+	 * Write a fresh snapshot of the whole database and switch over to it.
+	 * Without a snapshot file it is built in memory instead.
+	 * Must be called with write_mtx locked.
+	 */
+	bool write_snapshot();
+
+	/**
+	 * Get the groups of key.
+	 */
+	str_set get_groups(const str& key) const;
+
+	/**
+	 * Get the current facts for key.
+	 * @return false if there are none.
+	 */
+	bool find_facts(const str& key, fact_lines& lines) const;
+	bool find_facts(const str& key, str_vec& lines) const;
+
+	/**
+	 * Get the current facts for key without copying them if
+	 * they have been edited since the snapshot.
+	 * @return null if there are none.
+	 */
+	std::shared_ptr<const str_vec> share_facts(const str& key) const;
+
+	/**
+	 * Replace the facts for key in memory and keep
+	 * the key index and alias cache up to date.
+	 * This does not update the store.
+	 * @param key
+	 * @param lines An empty vector removes key.
+	 */
+	void set_facts(const str& key, const str_vec& lines);
+
+	/**
+	 * Write the facts or groups of key to the journal
+	 * if there is one, otherwise to store or index.
+	 */
+	void persist_facts(const str& key, const str_vec& lines);
+	void persist_groups(const str& key, const str_set& groups);
+
+	/**
+	 * Replace the groups recorded for key in the in memory group index.
+	 * This does not update the index store.
+	 * @param key
+	 * @param groups An empty set removes key from the group index.
+	 */
+	void index_groups(const str& key, const str_set& groups);
+
+	/**
+	 * Does key belong to at least one of groups?
+	 * To test many keys get a GroupIndex::filter once instead.
+	 * @param key
+	 * @param groups
+	 * @return
+	 */
+	bool in_groups(const str& key, const str_set& groups) const;
+
+public:
+	static const uns noline = uns(-1);
+
+	// the reason for the last failure on this thread
+	static thread_local str error;
+
+	uns max_alias_depth = 10;
+	uns max_suggest_distance = 2; // edits
+
+	/**
+	 * @param store_file
+	 * @param index_file
+	 * @param snapshot_file If not empty load from (and keep up to date)
+	 * this binary snapshot of the store and index files.
+	 * @param compress Keep the facts compressed in memory (and in the
+	 * snapshot file) until they are looked up. Edits stay uncompressed
+	 * until the next save_snapshot().
+	 * @param body_cache How many keys' facts to keep decompressed.
+	 * @param stats If not null record the timings here, along with
+	 * those of other FactoidManagers sharing it. It must not be
+	 * reported on once we are gone.
+	 * @param gauge_prefix Goes before the names of the size gauges,
+	 * to tell them apart from those of the others.
+	 */
+	FactoidManager(const str& store_file, const str& index_file, const str& snapshot_file = ""
+		, bool compress = false, siz body_cache = 1024
+		, std::shared_ptr<FactoidStats> stats = nullptr, const str& gauge_prefix = "fm.");
+	~FactoidManager();
+
+	/**
+	 * Timings of every operation along with cache hit rates
+	 * and database sizes. Callers may add their own.
+	 */
+	FactoidStats& get_stats() { return stats; }
+
+	/**
+	 * The names of the size gauges we add, without gauge_prefix.
+	 */
+	const str_vec& get_gauges() const { return gauges; }
+
+	/**
+	 * Goes up whenever any fact or group changes, so callers can
+	 * tell if something they worked out from a lookup is stale.
+	 * Read it before the lookup.
+	 */
+	std::uint64_t get_generation() const { return generation; }
+
+	/**
+	 * @return The number of keys with facts.
+	 */
+	siz size() const;
+
+	/**
+	 * Write a fresh snapshot of the whole database and switch over to it.
+	 * Without a snapshot file this is only done if the facts are
+	 * compressed, rebuilding them in memory with the edits since.
+	 * @return false on error (see error), true if done or there is nothing to do.
+	 */
+	bool save_snapshot();
+
+	/**
+	 * Persist edits through a write ahead journal instead of updating the
+	 * store files on every edit. Any records left in the journal by a
+	 * previous run are replayed first.
+	 * @param file The journal file.
+	 * @param sync_interval How often batched records are written and fsynced.
+	 * @param compact_interval How often the journal is folded into the store files.
+	 * @return false on error (see error)
+	 */
+	bool open_journal(const str& file, std::chrono::milliseconds sync_interval
+		, std::chrono::seconds compact_interval);
+
+	/**
+	 * Make sure every edit so far is in the store files.
+	 */
+	void sync();
+
+	/**
+	 * Pick up changes made to the store files from outside. Only
+	 * the keys that changed are updated, and nothing is reread
+	 * if the files are as we left them.
+	 */
+	bool reload();
+
+	/**
+	 * Reload whenever the store files are changed from outside.
+	 * @param settle How long the files must be left alone first.
+	 * @return false on error (see error)
+	 */
+	bool watch_files(std::chrono::milliseconds settle = std::chrono::milliseconds(500));
+	void unwatch_files();
+
+	/**
+	 * Add every fact and group in is, as add_fact() would but
+	 * sorted by key first (in bounded memory) so each key is
+	 * updated and persisted once. Nothing is added if any of
+	 * the input is bad.
+	 * @param is
+	 * @param format
+	 * @param added Receives the number of facts added.
+	 * @return false on error (see error)
+	 */
+	bool import_facts(std::istream& is, bulk_format format, siz& added);
+
+	/**
+	 * Write every key with its facts and groups to os in key order,
+	 * all as they were when it started. Edits and lookups carry
+	 * on meanwhile.
+	 * @return false on error (see error)
+	 */
+	bool export_facts(std::ostream& os, bulk_format format);
+
+	/**
+	 * Export to file, by way of a temporary file so
+	 * there is always a whole backup in file.
+	 * @return false on error (see error)
+	 */
+	bool backup_facts(const str& file, bulk_format format = bulk_format::jsonl);
+
+	/**
+	 * Remember the last max_edits edits for undo_fact() and
+	 * get_fact_at(), for up to max_age.
+	 */
+	void set_history(siz max_edits, std::chrono::seconds max_age);
+
+	/**
+	 * Put key back as it was before its last edit that has not
+	 * been undone already, facts and groups both. Only the edits
+	 * made since start up (through this FactoidManager) are
+	 * remembered, see set_history().
+	 * @return false if there is nothing to undo (see error)
+	 */
+	bool undo_fact(const str& key);
+
+	/**
+	 * Get the facts that key had at the time when.
+	 * @param key
+	 * @param when
+	 * @param lines Receives the facts.
+	 * @param groups If not empty the key must have been in one of these groups.
+	 * @param resolve Follow alias lines as get_resolved_fact() does, to
+	 * the facts the aliased keys had at the same time.
+	 * @return false if there were none or the edits from then
+	 * are no longer remembered (see error)
+	 */
+	bool get_fact_at(const str& key, FactHistory::clock::time_point when, str_vec& lines
+		, const str_set& groups = {}, bool resolve = true);
+
+	/**
+	 * Add a fact by keyword and optionally add it to groups.
+	 * @param key
+	 * @param fact
+	 * @param groups
+	 * @return
+	 */
+	void add_fact(const str& key, const str& fact, const str_set& groups = {});
+
+	/**
+	 * Delete all facts, or a single fact from a keyword.
+	 * @param key
+	 * @param line
+	 * @param groups
+	 * @return
+	 */
+	bool del_fact(const str& key, uns line = noline, const str_set& groups = {});
+
+	/**
+	 * Add keyword to groups.
+	 * @param key
+	 * @param groups
+	 * @return
+	 */
+	void add_to_groups(const str& key, const str_set& groups);
+
+	/**
+	 * Remove keyword from groups.
+	 * @param key
+	 * @param groups
+	 */
+	void del_from_groups(const str& key, const str_set& groups);
+
+	/**
+	 * Get a set of kewords that match the wildcard expression
+	 * @param wild_key
+	 * @param groups If not empty restrict the search to these groups.
+	 * @param max Stop after this many keys (0 = no limit).
+	 * @return
+	 */
+	str_set find_fact(const str& wild_key, const str_set& groups = {}, siz max = 0);
+
+	/**
+	 * Get a set of groups that match the wildcard expression
+	 * @return
+	 */
+	str_set find_group(const str& wild_group);
+
+	/**
+	 * Rank the keys whose facts contain any of the words in terms.
+	 * @param terms
+	 * @param groups If not empty restrict the search to these groups.
+	 * @param max Return at most this many keys (0 = no limit).
+	 * @return Best match first.
+	 */
+	std::vector<TextSearch::hit> search_fact(const str& terms, const str_set& groups = {}, siz max = 0);
+
+	/**
+	 * Get the keys that are the fewest edits away from key
+	 * (which is never among them), for when it is not found.
+	 * Short keys allow fewer edits than max_suggest_distance.
+	 * @param key
+	 * @param groups If not empty only suggest keys in these groups.
+	 * @param max How many keys to suggest.
+	 * @return Closest first.
+	 */
+	str_vec suggest_fact(const str& key, const str_set& groups = {}, siz max = 3);
+
+	using visitor = std::function<void(const str&)>;
+
+	/**
+	 * Like find_fact() but hand each key to visit in turn
+	 * instead of copying them into a set.
+	 * The database is locked for reading throughout so
+	 * visit must not call back into the FactoidManager.
+	 * @param stop If not null give up early when it says so.
+	 * @return The number of keys visited.
+	 */
+	siz visit_facts(const str& wild_key, const visitor& visit, const str_set& groups = {}, siz max = 0
+		, const StopToken* stop = nullptr);
+
+	/**
+	 * Like find_group() but hand each group to visit in turn
+	 * instead of copying them into a set.
+	 * The database is locked for reading throughout so
+	 * visit must not call back into the FactoidManager.
+	 * @param stop If not null give up early when it says so.
+	 * @return The number of groups visited.
+	 */
+	siz visit_groups(const str& wild_group, const visitor& visit, siz max = 0
+		, const StopToken* stop = nullptr);
+
+	/**
+	 * Retrieve all facts for key optionally restricted by groups..
+	 * @param key The key of the facts to retrieve
+	 * @param groups If not empty redtrict fact search to these groups.
+	 * @return str_vec of facts
+	 */
+	str_vec get_fact(const str& key, const str_set& groups);
+
+	/**
+	 * Like get_fact() but without copying the facts.
+	 */
+	fact_lines get_fact_lines(const str& key, const str_set& groups);
+
+	/**
+	 * Retrieve all facts for key optionally restricted by groups
+	 * with alias lines (= <key>) replaced by the facts of the key
+	 * they refer to. The groups apply to every aliased key too.
+	 * @param key The key of the facts to retrieve
+	 * @param groups If not empty restrict fact search to these groups.
+	 * @return str_vec of facts
+	 */
+	str_vec get_resolved_fact(const str& key, const str_set& groups);
+
+	/**
+	 * Like get_resolved_fact() but without copying the facts.
+	 */
+	fact_lines get_resolved_lines(const str& key, const str_set& groups);
+
+	/**
+	 * Look up many keys at once, all from the database as it
+	 * is at one moment. They are looked up in key order.
+	 * @param keys
+	 * @param groups If not empty restrict every key to these groups.
+	 * @param resolve Follow alias lines as get_resolved_lines() does.
+	 * @return The facts of each key in the order of keys (empty if
+	 * it has none).
+	 */
+	std::vector<fact_lines> get_facts(const str_vec& keys, const str_set& groups, bool resolve = true);
+
+};
+
+}} // skivvy::factoid
+
+#endif // _SKIVVY_IRCBOT_FACTOID_MANAGER_H_
@@ -0,0 +1,168 @@
+#pragma once
+#ifndef _SKIVVY_IRCBOT_FACTOID_REPLY_H_
+#define _SKIVVY_IRCBOT_FACTOID_REPLY_H_
+/*
+ * factoid-reply.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <experimental/string_view>
+
+#include <sookee/types/basic.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::types;
+
+using str_view = std::experimental::string_view;
+
+/**
+ * Formats every line of one reply into as few IRC messages
+ * as possible, all in one buffer. Each message starts with
+ * the same head. Short lines are packed together, separated
+ * by sep, and long lines are split between words so that no
+ * message is longer than max bytes.
+ */
+class ReplyBuilder
+{
+	const str head;
+	const str sep;
+	const siz max; // bytes per message, head included
+	const bool pack;
+
+	str buf; // the messages back to back
+	std::vector<siz> ends; // where each finished message ends in buf
+	bool open = false; // is a message being built at the end of buf
+
+	siz start() const { return ends.empty() ? 0 : ends.back(); }
+
+public:
+	using sender = std::function<void(const str&)>;
+
+	/**
+	 * @param head The text every message starts with.
+	 * @param max The most bytes a message may have.
+	 * @param pack Put as many lines in a message as will fit.
+	 * @param sep Goes between lines packed into one message.
+	 */
+	ReplyBuilder(const str& head, siz max, bool pack = true, const str& sep = " | ");
+
+	/**
+	 * Make room for this many bytes of lines.
+	 */
+	void reserve(siz bytes);
+
+	/**
+	 * Add a line, starting a new message if need be.
+	 */
+	void add(str_view line);
+
+	/**
+	 * Start the next line in a new message even if it would fit.
+	 */
+	void end();
+
+	/**
+	 * @return The number of messages.
+	 */
+	siz size() const { return ends.size() + open; }
+	bool empty() const { return !size(); }
+
+	str_view get(siz i) const;
+
+	/**
+	 * Pass messages first to last (exclusive) to send in order.
+	 * @return The number of messages sent.
+	 */
+	siz send(const sender& send, siz first = 0, siz last = siz(-1)) const;
+};
+
+/**
+ * Keeps the most recently sent replies so a popular fact is only
+ * looked up and formatted once. Each reply is stored under an id
+ * made of everything it was built from. The cache only holds
+ * replies from one generation of the database; asking for a
+ * newer generation empties it.
+ */
+class ReplyCache
+{
+public:
+	using reply = std::shared_ptr<const ReplyBuilder>;
+
+private:
+	using entry = std::pair<str, reply>;
+
+	mutable std::mutex mtx;
+	siz capacity;
+	std::uint64_t generation = 0;
+	std::list<entry> used; // most recently used first
+	std::unordered_map<str, std::list<entry>::iterator> entries;
+
+	/**
+	 * Drop every reply older than generation.
+	 * Must be called with mtx locked.
+	 * @return false if generation is older than the cache.
+	 */
+	bool renew(std::uint64_t generation);
+
+public:
+	/**
+	 * @param capacity The most replies kept (0 = none).
+	 */
+	explicit ReplyCache(siz capacity = 256);
+
+	void set_capacity(siz capacity);
+
+	/**
+	 * @param id
+	 * @param generation Of the database now.
+	 * @return The reply or null if it is not cached.
+	 */
+	reply get(const str& id, std::uint64_t generation);
+
+	/**
+	 * Keep r, forgetting the least recently used reply if full.
+	 * @param id
+	 * @param generation Of the database as it was before the
+	 * facts in r were looked up.
+	 * @param r
+	 */
+	void put(const str& id, std::uint64_t generation, reply r);
+
+	siz size() const;
+};
+
+}} // skivvy::factoid
+
+#endif // _SKIVVY_IRCBOT_FACTOID_REPLY_H_
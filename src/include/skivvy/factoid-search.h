@@ -0,0 +1,373 @@
+#pragma once
+#ifndef _SKIVVY_IRCBOT_FACTOID_SEARCH_H_
+#define _SKIVVY_IRCBOT_FACTOID_SEARCH_H_
+/*
+ * factoid-search.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <map>
+#include <bitset>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+#include <sookee/types/basic.h>
+
+#include <skivvy/factoid-worker.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::types;
+
+bool wild_match(const str& w, const str& s, int flags = 0);
+
+/**
+ * A wildcard expression parsed once so it can be tested
+ * against many strings. Matches exactly like wild_match().
+ * Extended patterns and anything else it can't handle itself
+ * are passed on to fnmatch().
+ */
+class WildPattern
+{
+	// each token matches one character except star
+	struct token
+	{
+		enum class type { lit, any, set, star } t;
+		char c;
+		std::bitset<256> chars;
+	};
+
+	str wild;
+	std::vector<token> tokens;
+	bool fallback = false; // use fnmatch()
+	bool has_any = false; // '?' or '[..]' present
+
+	bool parse_bracket(siz& pos, std::bitset<256>& chars) const;
+
+public:
+	WildPattern() = default;
+	explicit WildPattern(const str& wild);
+
+	const str& text() const { return wild; }
+
+	bool match(const str& s) const;
+};
+
+/**
+ * The parts of a wildcard expression that every matching
+ * key must contain.
+ */
+struct wild_literals
+{
+	str prefix; // literal text every match starts with
+	str_vec parts; // literal runs every match contains
+};
+
+/**
+ * Pull the literal prefix and the required literal runs out
+ * of an (FNM_EXTMATCH) wildcard expression. Nothing after the
+ * first extended pattern is taken into account.
+ */
+wild_literals get_wild_literals(const str& wild);
+
+/**
+ * Sorted key set with a trigram index used to narrow
+ * down the candidates for a wildcard search before
+ * they are tested with wild_match().
+ */
+class KeySearch
+{
+	using gram = std::uint32_t;
+	using posting = std::vector<const str*>; // sorted by address
+
+	str_set keys;
+	std::unordered_map<gram, posting> grams;
+
+	static void get_grams(const str& s, std::vector<gram>& v);
+
+public:
+	using filter = std::function<bool(const str&)>;
+	using visitor = std::function<void(const str&)>;
+
+	void clear();
+
+	void insert(const str& key);
+	void erase(const str& key);
+
+	/**
+	 * Replace every key at once, much faster than inserting
+	 * them one by one.
+	 * @param sorted The keys in order.
+	 */
+	void assign(const str_vec& sorted);
+
+	bool contains(const str& key) const { return keys.count(key); }
+	siz size() const { return keys.size(); }
+
+	const str_set& get_keys() const { return keys; }
+
+	/**
+	 * Get the keys that match the wildcard expression, in key order.
+	 * @param wild The wildcard expression.
+	 * @param max Stop after this many matches (0 = no limit).
+	 * @param accept If set, only count keys it returns true for.
+	 * @return
+	 */
+	str_set find(const str& wild, siz max = 0, const filter& accept = {}) const;
+
+	/**
+	 * Like find() but hand each matching key to visit, in key
+	 * order, rather than copying it into a set.
+	 * @param stop If not null the walk gives up when it says so.
+	 * @return The number of keys visited.
+	 */
+	siz visit(const str& wild, const visitor& visit, siz max = 0, const filter& accept = {}
+		, const StopToken* stop = nullptr) const;
+};
+
+/**
+ * Which keys belong to which groups. Group names are interned
+ * so each key holds a short sorted vector of group ids, and a
+ * lookup turns the groups it wants into a bitset once so each
+ * key is tested with a few word ANDs instead of comparing
+ * strings. The ids of groups left empty are reused.
+ */
+class GroupIndex
+{
+public:
+	using group_id = std::uint32_t;
+	using group_ids = std::vector<group_id>; // sorted
+
+	/**
+	 * The groups a lookup wants, as a bitset of their ids.
+	 * Only valid until the index is next changed.
+	 */
+	class filter
+	{
+		friend class GroupIndex;
+		std::vector<std::uint64_t> bits;
+
+	public:
+		/**
+		 * No key can be in any of the groups.
+		 */
+		bool empty() const { return bits.empty(); }
+	};
+
+private:
+	std::map<str, group_id> ids; // group -> id
+	str_vec names; // id -> group
+	std::vector<siz> sizes; // id -> number of keys
+	group_ids unused; // ids free for reuse
+
+	std::map<str, group_ids> key_groups; // key -> ids
+
+	group_id intern(const str& group);
+	void release(group_id id);
+
+public:
+	using const_iterator = std::map<str, group_ids>::const_iterator;
+
+	void clear();
+
+	/**
+	 * Replace the groups of key.
+	 * @param groups An empty set removes key.
+	 */
+	void set(const str& key, const str_set& groups);
+
+	str_set get(const str& key) const;
+	str_set get_names(const group_ids& gids) const;
+
+	/**
+	 * Get the bitset of the named groups. Groups with
+	 * no keys are left out.
+	 */
+	filter get_filter(const str_set& groups) const;
+
+	/**
+	 * Is key in at least one of the groups of f?
+	 */
+	bool in_groups(const str& key, const filter& f) const;
+
+	siz group_count() const { return ids.size(); }
+	siz key_count() const { return key_groups.size(); }
+
+	/**
+	 * Every group name, sorted.
+	 */
+	const std::map<str, group_id>& get_groups() const { return ids; }
+
+	/**
+	 * Every key with groups and their ids, in key order.
+	 */
+	const_iterator begin() const { return key_groups.begin(); }
+	const_iterator end() const { return key_groups.end(); }
+};
+
+/**
+ * Symmetric delete (SymSpell) index of keys for suggesting
+ * the keys closest to one that does not exist.
+ *
+ * Two strings within n edits of each other can both be turned
+ * into the same string with at most n deletions each, and that
+ * still holds for their first few characters. So the hashes of
+ * every string that up to max_edits deletions make of the start
+ * of each key are kept in sorted runs, merged like a binary counter
+ * so there are only ever log n of them. A lookup makes the same
+ * deletions of the wanted key, gathers the keys sharing any hash
+ * and checks each with a real edit distance.
+ */
+class KeySuggest
+{
+public:
+	static const siz max_edits = 2;
+	static const siz prefix = 5; // characters of each key that are indexed
+
+private:
+	using key_id = std::uint32_t;
+	using entry = std::uint64_t; // hash << 32 | key_id
+
+	std::vector<str> keys; // by key_id, empty once erased
+	std::unordered_map<str, key_id> ids;
+
+	// each at least twice the size of the next
+	std::vector<std::vector<entry>> runs;
+
+	static void get_hashes(const str& key, std::vector<std::uint32_t>& hashes);
+	void add_run(std::vector<entry> run);
+	void rebuild();
+
+public:
+	using filter = std::function<bool(const str&)>;
+
+	/**
+	 * The edit (Levenshtein) distance between a and b,
+	 * or anything above max once it is known to be above max.
+	 */
+	static siz distance(const str& a, const str& b, siz max = siz(-1));
+
+	void clear();
+
+	void insert(const str& key);
+	void erase(const str& key);
+
+	siz size() const { return ids.size(); }
+
+	/**
+	 * Get the keys within max_distance (at most max_edits)
+	 * edits of key, closest first then in key order.
+	 * @param key
+	 * @param max_distance
+	 * @param count Return at most this many keys.
+	 * @param accept If set, only return keys it returns true for.
+	 * @return
+	 */
+	str_vec suggest(const str& key, siz max_distance, siz count, const filter& accept = {}) const;
+};
+
+/**
+ * Inverted index of the words in fact bodies ranked with BM25.
+ *
+ * Words are runs of letters and digits, ASCII folded to lower
+ * case. IRC formatting is skipped and alias lines (= <key>)
+ * are not indexed. Every (re)indexed key gets a new document
+ * number so posting lists stay sorted by simply appending;
+ * the numbers are packed again once most of them are dead.
+ */
+class TextSearch
+{
+	using doc_id = std::uint32_t;
+
+	struct posting
+	{
+		doc_id doc;
+		std::uint32_t tf; // times the word appears
+	};
+
+	using postings = std::unordered_map<str, std::vector<posting>>;
+
+	struct document
+	{
+		str key; // empty once replaced or erased
+		std::uint32_t length; // words
+		std::vector<const str*> words; // distinct, keys of postings
+	};
+
+	std::vector<document> docs; // by doc_id
+	std::unordered_map<str, doc_id> ids; // key -> current document
+	postings words;
+	std::uint64_t total_length = 0; // of current documents
+
+	void compact();
+
+public:
+	using filter = std::function<bool(const str&)>;
+
+	struct hit
+	{
+		str key;
+		double score;
+	};
+
+	/**
+	 * Split text into lower case words.
+	 */
+	static void get_words(const str& text, str_vec& v);
+
+	void clear();
+
+	/**
+	 * Replace the indexed text of key.
+	 * @param key
+	 * @param lines The facts of key, none removes it.
+	 */
+	void set(const str& key, const str_vec& lines);
+	void erase(const str& key);
+
+	siz size() const { return ids.size(); }
+	siz word_count() const { return words.size(); }
+
+	/**
+	 * Rank the keys containing any of the words of query.
+	 * Rare words are scored first and once nothing that has
+	 * not been seen yet could make the top max the remaining
+	 * words only rescore the keys already found.
+	 * @param query
+	 * @param max Return at most this many hits (0 = no limit).
+	 * @param accept If set, only rank keys it returns true for.
+	 * @return Best first.
+	 */
+	std::vector<hit> search(const str& query, siz max = 0, const filter& accept = {}) const;
+};
+
+}} // skivvy::factoid
+
+#endif // _SKIVVY_IRCBOT_FACTOID_SEARCH_H_
@@ -0,0 +1,297 @@
+#pragma once
+#ifndef _SKIVVY_IRCBOT_FACTOID_SHARDS_H_
+#define _SKIVVY_IRCBOT_FACTOID_SHARDS_H_
+/*
+ * factoid-shards.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <future>
+
+#include <skivvy/factoid-worker.h>
+#include <skivvy/factoid-manager.h>
+
+namespace skivvy { namespace factoid {
+
+/**
+ * The fact database split into shards, each a FactoidManager with
+ * its own store, index, snapshot and journal files, its own locks
+ * and its own search indexes. A key (with its facts and groups)
+ * lives in the shard its hash (key_hash()) picks, so edits and lookups of one
+ * key only touch that shard. Searches run on every shard at once
+ * and the results are merged.
+ *
+ * With one shard the files are used as named and every call goes
+ * straight to it. With more, shard i uses <file>.<i>. Changing the
+ * number of shards needs the facts exported with the old number and
+ * imported again with the new (see import_facts()), which
+ * skivvy-factoid-bulk --shards does.
+ */
+class FactoidShards
+{
+	// shared by every shard, so outlives them
+	const std::shared_ptr<FactoidStats> stats;
+
+	// alias resolutions that may span shards, which every
+	// shard tells of its edits, so outlive them too
+	std::mutex alias_mtx;
+	AliasCache aliases;
+	HitCounter& alias_hits;
+
+	std::vector<std::unique_ptr<FactoidManager>> shards;
+
+	// runs the lookups of every shard but the first
+	// (which runs in the caller's thread) at once
+	CommandPool fanout;
+
+	// as given, without the shard numbers
+	const str store_file;
+	const str index_file;
+
+	bool check_files(siz count);
+
+	/**
+	 * Call get on every shard at once, the first in this
+	 * thread, and collect what they return in shard order.
+	 * Every call has finished before this returns, or throws
+	 * what the first (in shard order) that threw did.
+	 */
+	template<typename Get>
+	auto each(const Get& get) -> std::vector<decltype(get(std::declval<FactoidManager&>()))>
+	{
+		using result = decltype(get(std::declval<FactoidManager&>()));
+
+		// run by whichever gets to it first, the pool or this
+		// thread, so one the pool drops or has yet to start is
+		// not waited for
+		struct task
+		{
+			std::packaged_task<result()> get;
+			std::atomic<bool> claimed{false};
+			void run() { if(!claimed.exchange(true)) get(); }
+		};
+
+		std::vector<std::shared_ptr<task>> tasks;
+		std::vector<std::future<result>> futures;
+		for(siz i = 0; i < shards.size(); ++i)
+		{
+			tasks.push_back(std::make_shared<task>());
+			tasks.back()->get = std::packaged_task<result()>([&get, this, i]{ return get(*shards[i]); });
+			futures.push_back(tasks.back()->get.get_future());
+		}
+
+		for(siz i = 1; i < tasks.size(); ++i)
+		{
+			auto t = tasks[i];
+			if(!fanout.submit([t](const StopToken&){ t->run(); }))
+				t->run();
+		}
+
+		for(auto&& t: tasks)
+			t->run();
+		for(auto&& f: futures)
+			f.wait();
+
+		std::vector<result> got;
+		for(auto&& f: futures)
+			got.push_back(f.get());
+
+		return got;
+	}
+
+	/**
+	 * Set error from the first shard that failed.
+	 * @return false if any did.
+	 */
+	bool all(const std::vector<str>& errors);
+
+	/**
+	 * Move the keys the shards have just case folded (see
+	 * FactoidManager::fold_keys()) to the shard their folded
+	 * key hashes to, appending to any facts it has there.
+	 */
+	void move_merged_keys();
+
+	/**
+	 * The facts of key, with aliases followed across shards
+	 * as FactoidManager::get_resolved_lines() does within one.
+	 * @param facts What the shard of key has just returned
+	 * for it, used as it is if it has no alias lines.
+	 */
+	fact_lines resolve_lines(const str& key, fact_lines facts, const str_set& groups);
+
+	/**
+	 * Drop the cached resolutions that read key (every
+	 * one if key is empty). Called by every shard.
+	 */
+	void invalidate_aliases(const str& key);
+
+public:
+	// the reason for the last failure on this thread
+	static thread_local str error;
+
+	/**
+	 * @param store_file
+	 * @param index_file
+	 * @param snapshot_file If not empty every shard keeps a snapshot.
+	 * @param count How many shards (at least 1).
+	 * @param compress Keep the facts compressed (see FactoidManager).
+	 * @param body_cache How many keys' facts each shard keeps decompressed.
+	 */
+	FactoidShards(const str& store_file, const str& index_file, const str& snapshot_file = ""
+		, siz count = 1, bool compress = false, siz body_cache = 1024);
+	~FactoidShards();
+
+	siz size() const { return shards.size(); }
+
+	/**
+	 * Do the store files with facts in them match the number of
+	 * shards? If not (see error) the facts in the others are
+	 * not seen, most likely because factoid.shards was changed.
+	 * The constructor logs this too.
+	 */
+	bool check_files();
+
+	/**
+	 * @return The shard key belongs in.
+	 */
+	siz get_shard(const str& key) const;
+
+	FactoidManager& shard(siz i) { return *shards[i]; }
+	FactoidManager& shard_of(const str& key) { return *shards[get_shard(key)]; }
+
+	/**
+	 * The stats of every shard. The timings and cache counts are
+	 * of all the shards together. With more than one shard the size
+	 * gauges are summed, and each shard's are also kept under
+	 * shard.<i>.fm.<name>. Callers may add their own.
+	 */
+	FactoidStats& get_stats() { return *stats; }
+
+	/**
+	 * Goes up whenever any shard changes.
+	 */
+	std::uint64_t get_generation() const;
+
+	uns get_max_alias_depth() const { return shards[0]->max_alias_depth; }
+	void set_max_alias_depth(uns depth);
+	uns get_max_suggest_distance() const { return shards[0]->max_suggest_distance; }
+	void set_max_suggest_distance(uns distance);
+
+	// see FactoidManager, these act on every shard
+
+	bool save_snapshot();
+	bool open_journal(const str& file, std::chrono::milliseconds sync_interval
+		, std::chrono::seconds compact_interval);
+	void sync();
+	bool reload();
+	bool watch_files(std::chrono::milliseconds settle = std::chrono::milliseconds(500));
+	void unwatch_files();
+	void set_history(siz max_edits, std::chrono::seconds max_age);
+
+	/**
+	 * With more than one shard each is backed up to <file>.<i>.
+	 */
+	bool backup_facts(const str& file, bulk_format format = bulk_format::jsonl);
+
+	/**
+	 * Each key goes to the shard its hash picks, so facts exported
+	 * with any number of shards can be imported with any other.
+	 * Nothing is added to any shard if any of the input is bad.
+	 */
+	bool import_facts(std::istream& is, bulk_format format, siz& added);
+
+	/**
+	 * Every shard one after another, each as it was when it started.
+	 */
+	bool export_facts(std::ostream& os, bulk_format format);
+
+	/**
+	 * Reload just the one shard.
+	 */
+	bool reload(siz shard);
+
+	// see FactoidManager, these go to the shard of key
+
+	void add_fact(const str& key, const str& fact, const str_set& groups = {});
+	bool del_fact(const str& key, uns line = FactoidManager::noline, const str_set& groups = {});
+	void add_to_groups(const str& key, const str_set& groups);
+	void del_from_groups(const str& key, const str_set& groups);
+	str_vec get_fact(const str& key, const str_set& groups);
+	fact_lines get_fact_lines(const str& key, const str_set& groups);
+	bool undo_fact(const str& key);
+
+	/**
+	 * Aliases are followed, as get_resolved_fact() does, to the
+	 * facts the aliased keys had at the same time.
+	 */
+	bool get_fact_at(const str& key, FactHistory::clock::time_point when, str_vec& lines
+		, const str_set& groups = {});
+
+	/**
+	 * Aliases may refer to keys in other shards.
+	 */
+	str_vec get_resolved_fact(const str& key, const str_set& groups);
+	fact_lines get_resolved_lines(const str& key, const str_set& groups);
+
+	/**
+	 * Every shard looks up its own keys at once, each
+	 * as of one moment (though not the same one).
+	 */
+	std::vector<fact_lines> get_facts(const str_vec& keys, const str_set& groups);
+
+	// see FactoidManager, these ask every shard and merge
+
+	str_set find_fact(const str& wild_key, const str_set& groups = {}, siz max = 0);
+	str_set find_group(const str& wild_group);
+
+	/**
+	 * Each shard ranks its own keys so scores are only
+	 * comparable between shards of a similar make up.
+	 */
+	std::vector<TextSearch::hit> search_fact(const str& terms, const str_set& groups = {}, siz max = 0);
+	str_vec suggest_fact(const str& key, const str_set& groups = {}, siz max = 3);
+
+	using visitor = FactoidManager::visitor;
+
+	/**
+	 * Unlike FactoidManager::visit_facts() visit is called once
+	 * every shard is done, so it may call back into us.
+	 */
+	siz visit_facts(const str& wild_key, const visitor& visit, const str_set& groups = {}, siz max = 0
+		, const StopToken* stop = nullptr);
+	siz visit_groups(const str& wild_group, const visitor& visit, siz max = 0
+		, const StopToken* stop = nullptr);
+};
+
+}} // skivvy::factoid
+
+#endif // _SKIVVY_IRCBOT_FACTOID_SHARDS_H_
@@ -0,0 +1,260 @@
+#pragma once
+#ifndef _SKIVVY_IRCBOT_FACTOID_SNAPSHOT_H_
+#define _SKIVVY_IRCBOT_FACTOID_SNAPSHOT_H_
+/*
+ * factoid-snapshot.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <list>
+#include <array>
+#include <mutex>
+#include <memory>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <experimental/string_view>
+
+#include <sookee/types/basic.h>
+
+#include <skivvy/factoid-codec.h>
+#include <skivvy/factoid-stats.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::types;
+
+using str_view = std::experimental::string_view;
+
+/**
+ * Read only, memory mapped image of the fact database.
+ *
+ * The snapshot is derived from the store and index files and
+ * records their size and modification time so a stale one
+ * can be recognised. Keys are sorted so they can be found
+ * with a binary search straight out of the mapping.
+ *
+ * The same image can be built in memory instead, where it
+ * serves as an arena: every key and fact in one contiguous
+ * block, found by offset and freed in one go.
+ *
+ * Layout (native byte order, version 2):
+ *
+ * header
+ * key_rec[key_count]       - sorted by key
+ * str_ref[fact_count]      - fact lines, in key order
+ * str_ref[group_count]     - group names, sorted
+ * uint32[group_ref_count]  - group ids, in key order
+ * char[pool_size]          - every string, packed
+ *
+ * A compressed snapshot has no fact lines. Instead the lines of
+ * each key (varint length, text, ...) are compressed together
+ * by FactCodec into its body, with a dictionary trained from
+ * every fact. Bodies are only decompressed when looked up, and
+ * the most recent are kept decompressed in a small cache.
+ */
+class FactoidSnapshot
+{
+public:
+	using stamp_type = std::array<std::uint64_t, 4>;
+
+	static const std::uint32_t version = 2;
+
+	// header flags
+	static const std::uint64_t compressed = 1;
+
+	struct str_ref
+	{
+		std::uint64_t off;
+		std::uint64_t len;
+	};
+
+	struct key_rec
+	{
+		str_ref key;
+		std::uint64_t fact_first;
+		std::uint64_t fact_count;
+		std::uint64_t group_first;
+		std::uint64_t group_count;
+		str_ref body; // if compressed
+	};
+
+	struct header
+	{
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t endian;
+		stamp_type stamp;
+		std::uint64_t key_count;
+		std::uint64_t fact_count;
+		std::uint64_t group_count;
+		std::uint64_t group_ref_count;
+		std::uint64_t pool_size;
+		std::uint64_t flags;
+		str_ref dict; // if compressed
+	};
+
+	/**
+	 * Supplies the database to write() one key at a time in key order.
+	 * Returns false when there are no more keys.
+	 */
+	using source = std::function<bool(str& key, str_vec& facts, str_set& groups)>;
+
+private:
+	void* map = nullptr;
+	siz map_size = 0;
+
+	str image; // if built in memory rather than mapped
+
+	const header* head = nullptr;
+	const key_rec* keys = nullptr;
+	const str_ref* facts = nullptr;
+	const str_ref* groups = nullptr;
+	const std::uint32_t* group_refs = nullptr;
+	const char* pool = nullptr;
+
+	FactCodec codec; // if compressed
+
+	// the fact lines of a compressed key
+	struct unpacked
+	{
+		str text;
+		std::vector<str_view> lines; // into text
+	};
+
+	// the bodies last looked up, most recent first
+	mutable std::mutex cache_mtx;
+	mutable std::list<siz> cache_order;
+	mutable std::unordered_map<siz, std::pair<std::shared_ptr<const unpacked>
+		, std::list<siz>::iterator>> cache;
+	siz cache_size = 0;
+	HitCounter* cache_hits = nullptr;
+
+	/**
+	 * Decompress the body of key i into u.
+	 */
+	void unpack(siz i, unpacked& u) const;
+
+	/**
+	 * The unpacked body of key i from the cache if it is
+	 * there, otherwise unpacked and added to the cache.
+	 */
+	std::shared_ptr<const unpacked> get_unpacked(siz i) const;
+
+	str_view get_view(const str_ref& r) const;
+	str get_str(const str_ref& r) const;
+	int compare(const str_ref& r, const str& s) const;
+
+	/**
+	 * Lay out the whole snapshot, header first.
+	 */
+	static str get_image(const stamp_type& stamp, const source& next, bool compress);
+
+	/**
+	 * Check the image at data and point the tables into it.
+	 * @param name What to call it in errors.
+	 */
+	bool attach(const char* data, siz data_size, const str& name);
+
+public:
+	static const siz npos = siz(-1);
+
+	str error;
+
+	FactoidSnapshot() = default;
+	FactoidSnapshot(const FactoidSnapshot&) = delete;
+	FactoidSnapshot& operator=(const FactoidSnapshot&) = delete;
+	~FactoidSnapshot();
+
+	/**
+	 * Get the stamp of the store and index files (size & mtime)
+	 * for comparing with the stamp a snapshot was made from.
+	 */
+	static stamp_type get_stamp(const str& store_file, const str& index_file);
+
+	/**
+	 * Write a snapshot to file, replacing any previous one atomically.
+	 * @param compress Compress the facts.
+	 * @return false on error (see error)
+	 */
+	static bool write(const str& file, const stamp_type& stamp, const source& next, str& error
+		, bool compress = false);
+
+	/**
+	 * Map a snapshot written by write().
+	 * @return false if it is missing, corrupt or a different version (see error)
+	 */
+	bool open(const str& file);
+
+	/**
+	 * Build a snapshot in memory rather than writing it to a file.
+	 * @return false on error (see error)
+	 */
+	bool build(const stamp_type& stamp, const source& next, bool compress = false);
+
+	/**
+	 * Keep up to size compressed bodies decompressed, counting
+	 * lookups in hits if it is not null.
+	 */
+	void set_cache(siz size, HitCounter* hits);
+
+	const stamp_type& stamp() const { return head->stamp; }
+
+	siz size() const { return head ? head->key_count : 0; }
+
+	/**
+	 * @return The size of the mapping or the in memory image.
+	 */
+	siz bytes() const { return image.empty() ? map_size : image.size(); }
+
+	bool is_compressed() const { return head && (head->flags & compressed); }
+
+	/**
+	 * @return The position of key or npos.
+	 */
+	siz find(const str& key) const;
+
+	str key(siz i) const;
+	siz fact_count(siz i) const;
+	str_vec get_facts(siz i) const;
+
+	/**
+	 * Append the fact lines of key i to views without copying
+	 * them out of the mapping. The views are only valid while
+	 * this snapshot is open, or if compressed while the
+	 * returned block of decompressed text is kept.
+	 * @return The decompressed text or null if not compressed.
+	 */
+	std::shared_ptr<const void> get_facts(siz i, std::vector<str_view>& views) const;
+
+	str_set get_groups(siz i) const;
+};
+
+}} // skivvy::factoid
+
+#endif // _SKIVVY_IRCBOT_FACTOID_SNAPSHOT_H_
@@ -0,0 +1,225 @@
+#pragma once
+#ifndef _SKIVVY_IRCBOT_FACTOID_STATS_H_
+#define _SKIVVY_IRCBOT_FACTOID_STATS_H_
+/*
+ * factoid-stats.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <map>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+
+#include <sookee/types/basic.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::types;
+
+/**
+ * Lock free latency histogram.
+ *
+ * Like HdrHistogram each power of two range of nanoseconds is
+ * split into the same number of linear buckets, so every value
+ * is kept to within 1/8 (12.5%) of itself from 1ns to centuries
+ * in a fixed 4K of counters. Recording is a handful of relaxed
+ * atomic adds.
+ */
+class LatencyHistogram
+{
+public:
+	using clock = std::chrono::steady_clock;
+	using count_t = std::uint64_t;
+
+private:
+	static const unsigned sub_bits = 3;
+	static const count_t subs = 1 << sub_bits;
+	static const siz bucket_count = (64 - sub_bits + 1) * subs;
+
+	std::array<std::atomic<count_t>, bucket_count> buckets;
+	std::atomic<count_t> n;
+	std::atomic<count_t> sum; // nanoseconds
+	std::atomic<count_t> high; // nanoseconds
+
+	static siz bucket(count_t ns);
+	static count_t bucket_top(siz b);
+
+public:
+	LatencyHistogram();
+
+	void record(clock::duration d);
+
+	count_t count() const { return n.load(std::memory_order_relaxed); }
+	count_t max() const { return high.load(std::memory_order_relaxed); }
+	double mean() const;
+
+	/**
+	 * @param p 0.0 - 1.0
+	 * @return The latency in nanoseconds that p of the
+	 * recorded values were no greater than.
+	 */
+	count_t percentile(double p) const;
+};
+
+/**
+ * Record the time from construction to destruction.
+ */
+class LatencyTimer
+{
+	LatencyHistogram& h;
+	const LatencyHistogram::clock::time_point start;
+
+public:
+	explicit LatencyTimer(LatencyHistogram& h)
+	: h(h), start(LatencyHistogram::clock::now()) {}
+	~LatencyTimer() { h.record(LatencyHistogram::clock::now() - start); }
+};
+
+/**
+ * Hit and miss counts of a cache.
+ */
+class HitCounter
+{
+	std::atomic<std::uint64_t> hits;
+	std::atomic<std::uint64_t> misses;
+
+public:
+	HitCounter(): hits(0), misses(0) {}
+
+	void hit() { hits.fetch_add(1, std::memory_order_relaxed); }
+	void miss() { misses.fetch_add(1, std::memory_order_relaxed); }
+
+	std::uint64_t get_hits() const { return hits.load(std::memory_order_relaxed); }
+	std::uint64_t get_misses() const { return misses.load(std::memory_order_relaxed); }
+
+	/**
+	 * @return hits / lookups or 0 if there were none.
+	 */
+	double rate() const;
+};
+
+/**
+ * Named latency histograms, cache counters and size gauges.
+ *
+ * The registry is locked only to add or list entries. Anything
+ * timing a hot path should look its histogram up once and keep
+ * the reference, which stays valid for the life of the stats.
+ */
+class FactoidStats
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+	/**
+	 * Reports the current size of something.
+	 * Called without any of the stats locks held.
+	 */
+	using sizer = std::function<siz()>;
+
+private:
+	const clock::time_point started;
+
+	mutable std::mutex mtx;
+	std::map<str, std::unique_ptr<LatencyHistogram>> latencies;
+	std::map<str, std::unique_ptr<HitCounter>> caches;
+	std::map<str, sizer> sizes;
+
+	// periodic dump
+	std::mutex dump_mtx;
+	std::condition_variable dump_cv;
+	bool dump_done = false;
+	std::thread dump_thread;
+
+	std::map<str, siz> get_sizes() const;
+
+public:
+	str error;
+
+	FactoidStats();
+	~FactoidStats();
+
+	/**
+	 * Get the latency histogram called name, adding it if need be.
+	 */
+	LatencyHistogram& latency(const str& name);
+
+	/**
+	 * Get the cache counter called name, adding it if need be.
+	 */
+	HitCounter& cache(const str& name);
+
+	/**
+	 * Add (or replace) the size gauge called name.
+	 */
+	void size(const str& name, const sizer& get);
+
+	/**
+	 * The current value of the size gauge called name (0 if none).
+	 */
+	siz get_size(const str& name) const;
+
+	/**
+	 * One line per histogram, cache and size whose name
+	 * matches the wildcard expression.
+	 */
+	str_vec report(const str& wild = "*") const;
+
+	/**
+	 * Everything as a JSON object.
+	 */
+	str json() const;
+
+	/**
+	 * Replace file with json().
+	 * @return false on error (see error)
+	 */
+	bool write(const str& file);
+
+	/**
+	 * Write file every interval from a background thread
+	 * until stop_dump() is called.
+	 */
+	void start_dump(const str& file, std::chrono::seconds interval);
+
+	/**
+	 * Stop the dump thread. Must be called before anything the
+	 * size gauges look at is destroyed.
+	 */
+	void stop_dump();
+};
+
+}} // skivvy::factoid
+
+#endif // _SKIVVY_IRCBOT_FACTOID_STATS_H_
@@ -0,0 +1,156 @@
+#pragma once
+#ifndef _SKIVVY_IRCBOT_FACTOID_WORKER_H_
+#define _SKIVVY_IRCBOT_FACTOID_WORKER_H_
+/*
+ * factoid-worker.h
+ *
+ *  Created on: 17 Oct 2026
+ *      Author: oaskivvy@gmail.com
+ */
+
+/*-----------------------------------------------------------------.
+| Copyright (C) 2026 SooKee oaskivvy@gmail.com                     |
+'------------------------------------------------------------------'
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+02110-1301, USA.
+
+http://www.gnu.org/licenses/gpl-2.0.html
+
+'-----------------------------------------------------------------*/
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#include <sookee/types/basic.h>
+
+namespace skivvy { namespace factoid {
+
+using namespace sookee::types;
+
+/**
+ * Tells a long running job when to give up, either because
+ * its deadline has passed or because it has been cancelled.
+ * Only the thread running the job should check it.
+ */
+class StopToken
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+private:
+	const clock::time_point deadline;
+	const std::atomic<bool>* cancelled;
+	mutable bool stop = false;
+
+public:
+	/**
+	 * @param deadline
+	 * @param cancelled If not null give up once it is set.
+	 */
+	explicit StopToken(clock::time_point deadline = clock::time_point::max()
+		, const std::atomic<bool>* cancelled = nullptr);
+
+	/**
+	 * @return true if the job should give up now. Once
+	 * true it stays true.
+	 */
+	bool should_stop() const;
+
+	/**
+	 * @return true if should_stop() has said to give up,
+	 * so the job's results are incomplete.
+	 */
+	bool stopped() const { return stop; }
+};
+
+/**
+ * Runs jobs on a fixed number of threads so the caller never
+ * waits for them. Jobs wait their turn in a bounded queue and
+ * each one is given until its timeout to finish.
+ */
+class CommandPool
+{
+public:
+	using job = std::function<void(const StopToken& stop)>;
+
+private:
+	struct queued
+	{
+		job run;
+		std::chrono::milliseconds timeout; // max for none
+	};
+
+	mutable std::mutex mtx;
+	std::condition_variable cv;
+	std::deque<queued> jobs;
+	siz max_queued = 0;
+	siz busy = 0; // jobs running
+
+	std::atomic<bool> done{false}; // cancels running jobs
+	std::vector<std::thread> threads;
+
+	void work();
+
+public:
+	CommandPool() = default;
+
+	/**
+	 * Cancels and waits for the running jobs.
+	 */
+	~CommandPool();
+
+	/**
+	 * @param threads How many jobs may run at once. With
+	 * none each job runs in the thread submitting it.
+	 * @param max_queued How many jobs may wait to run.
+	 */
+	void start(siz threads, siz max_queued);
+
+	/**
+	 * Cancel the running jobs, drop the ones still
+	 * waiting and wait for the threads to finish.
+	 */
+	void stop();
+
+	/**
+	 * @param run
+	 * @param timeout How long run has from when it starts.
+	 * @return false if the queue is full so run was dropped.
+	 */
+	bool submit(const job& run, std::chrono::milliseconds timeout);
+
+	/**
+	 * Submit run with no time limit, it only stops early
+	 * if the pool is stopped.
+	 * @return false if the queue is full so run was dropped.
+	 */
+	bool submit(const job& run);
+
+	/**
+	 * @return The number of jobs waiting or running.
+	 */
+	siz size() const;
+};
+
+}} // skivvy::factoid
+
+#endif // _SKIVVY_IRCBOT_FACTOID_WORKER_H_
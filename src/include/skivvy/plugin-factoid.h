@@ -33,10 +33,16 @@ http://www.gnu.org/licenses/gpl-2.0.html
 
 #include <skivvy/ircbot.h>
 
+#include <map>
 #include <deque>
 #include <mutex>
+#include <regex>
+#include <chrono>
+#include <memory>
 
-#include <skivvy/store.h>
+#include <skivvy/factoid-reply.h>
+#include <skivvy/factoid-worker.h>
+#include <skivvy/factoid-shards.h>
 //#include <skivvy/plugin-chanops.h>
 
 namespace skivvy { namespace factoid {
@@ -44,81 +50,7 @@ namespace skivvy { namespace factoid {
 using namespace skivvy::utils;
 using namespace skivvy::ircbot;
 
-// !addfact, !addgroup, !delfact, !fact, !ff, !fg, !findfact, !findgroup, !give, !reloadfacts
-
-class FactoidManager
-{
-	BackupStore store;
-	BackupStore index;
-
-public:
-	static const uns noline = uns(-1);
-
-	str error;
-
-	FactoidManager(const str& store_file, const str& index_file);
-
-	bool reload()
-	{
-		store.reload();
-		index.reload();
-		return true;
-	}
-
-	/**
-	 * Add a fact by keyword and optionally add it to groups.
-	 * @param key
-	 * @param fact
-	 * @param groups
-	 * @return
-	 */
-	void add_fact(const str& key, const str& fact, const str_set& groups = {});
-
-	/**
-	 * Delete all facts, or a single fact from a keyword.
-	 * @param key
-	 * @param line
-	 * @param groups
-	 * @return
-	 */
-	bool del_fact(const str& key, uns line = noline, const str_set& groups = {});
-
-	/**
-	 * Add keyword to groups.
-	 * @param key
-	 * @param groups
-	 * @return
-	 */
-	void add_to_groups(const str& key, const str_set& groups);
-
-	/**
-	 * Remove keyword from groups.
-	 * @param key
-	 * @param groups
-	 */
-	void del_from_groups(const str& key, const str_set& groups);
-
-	/**
-	 * Get a set of kewords that match the wildcard expression
-	 * @return
-	 */
-	str_set find_fact(const str& wild_key, const str_set& groups = {});
-
-	/**
-	 * Get a set of groups that match the wildcard expression
-	 * @return
-	 */
-	str_set find_group(const str& wild_group);
-
-	/**
-	 * Retrieve all facts for key optionally restricted by groups..
-	 * @param key The key of the facts to retrieve
-	 * @param groups If not empty redtrict fact search to these groups.
-	 * @return str_vec of facts
-	 */
-	str_vec get_fact(const str& key, const str_set& groups);
-
-};
+// !addfact, !addgroup, !backupfacts, !delfact, !fact, !factat, !factstats, !ff, !fg, !findfact, !findgroup, !give, !reloadfacts, !searchfact, !undofact
 
 class FactoidIrcBotPlugin
 : public BasicIrcBotPlugin
@@ -129,24 +61,76 @@ private:
 
 	IrcBotPluginHandle chanops;
 
-	FactoidManager fm;
+	FactoidShards fm;
+
+	using clock = std::chrono::steady_clock;
+
+	// compiled authorisation patterns and
+	// recently authorised userhosts
+	struct auth_cache
+	{
+		std::mutex mtx;
+		str_vec users;
+		str_vec wild_config;
+		str_vec preg_config;
+		std::map<str, WildPattern> wild_users;
+		std::map<str, std::shared_ptr<std::regex>> preg_users; // null if invalid
+		std::map<str, clock::time_point> valid; // userhost -> expiry
+		std::chrono::seconds ttl{0}; // of valid
+		clock::time_point next_update; // when to re-read the config
+	} auth;
+
+	HitCounter& auth_hits;
+
+	// formatted !fact replies (see factoid.reply.cache)
+	ReplyCache replies;
+	HitCounter& reply_hits;
+
+	// runs the slow commands (see factoid.workers)
+	CommandPool workers;
 
 	str get_user(const message& msg);
 
+	/**
+	 * Re-read the authorisation patterns and ttl from config,
+	 * only compiling the patterns we have not seen before, and
+	 * forget who was authorised if they changed. Called on start
+	 * up, by !reloadfacts and then at most once a ttl. Must be
+	 * called with auth.mtx locked.
+	 */
+	void update_auth();
+
 	bool is_user_valid(const message& msg);
 
 	bool reloadfacts(const message& msg);
 	bool addgroup(const message& msg);
 	bool addfact(const message& msg);
 	bool delfact(const message& msg);
+	bool undofact(const message& msg);
+	bool factat(const message& msg);
+	bool backupfacts(const message& msg);
 //	bool addtopic(const message& msg);
 
-	bool findfact(const message& msg); // !fs
-	bool findgroup(const message& msg); // !fs
+	bool findfact(const message& msg, const StopToken& stop); // !ff
+	bool findgroup(const message& msg, const StopToken& stop); // !fg
+	bool searchfact(const message& msg);
+
+	/**
+	 * The most bytes a reply to msg may have so it still
+	 * fits once the server has added its own prefix.
+	 */
+	siz get_reply_max(const message& msg);
+
+	/**
+	 * Send the first factoid.max.lines messages to msg's
+	 * channel and the rest by PM.
+	 */
+	void send_lines(const message& msg, const ReplyBuilder& lines, const str& head);
 
-	bool fact(const message& msg, const str& key, const str_set& groups, const str& prefix = "");
+	bool fact(const message& msg, const str_vec& keys, const str_set& groups, const str& prefix = "");
 	bool fact(const message& msg);
 	bool give(const message& msg);
+	bool factstats(const message& msg);
 
 	bool reply(const message& msg, const str& text, bool error = false);
 
@@ -28,6 +28,7 @@ http://www.gnu.org/licenses/gpl-2.0.html
 
 #include <skivvy/plugin-factoid.h>
 #include <skivvy/plugin-chanops.h>
+#include <skivvy/factoid-command.h>
 
 #include <ctime>
 #include <cstdlib>
@@ -70,223 +71,229 @@ const str STORE_FILE_DEFAULT = "factoid-store.txt";
 const str INDEX_FILE = "factoid.index.file";
 const str INDEX_FILE_DEFAULT = "factoid-index.txt";
 
+const str SNAPSHOT = "factoid.snapshot"; // bool
+const str SNAPSHOT_FILE = "factoid.snapshot.file";
+const str SNAPSHOT_FILE_DEFAULT = "factoid-snapshot.bin";
+
+const str JOURNAL = "factoid.journal"; // bool
+const str JOURNAL_FILE = "factoid.journal.file";
+const str JOURNAL_FILE_DEFAULT = "factoid-journal.txt";
+const str JOURNAL_SYNC = "factoid.journal.sync"; // milliseconds
+const uns JOURNAL_SYNC_DEFAULT = 500;
+const str JOURNAL_COMPACT = "factoid.journal.compact"; // seconds
+const uns JOURNAL_COMPACT_DEFAULT = 60;
+
+const str WATCH = "factoid.watch"; // bool
+
+const str SHARDS = "factoid.shards"; // how many FactoidManagers
+const uns SHARDS_DEFAULT = 1;
+
+const str COMPRESS = "factoid.compress"; // bool
+const str COMPRESS_CACHE = "factoid.compress.cache"; // keys kept decompressed
+const uns COMPRESS_CACHE_DEFAULT = 1024;
+
 const str FACT_USER = "factoid.fact.user";
 const str FACT_WILD_USER = "factoid.fact.wild.user";
 const str FACT_PREG_USER = "factoid.fact.preg.user";
 const str FACT_CHANOPS_USERS = "factoid.fact.chanops.users";
 
-FactoidManager::FactoidManager(const str& store_file, const str& index_file)
-: store(store_file)
-, index(index_file)
-{
-}
+const str FACT_AUTH_TTL = "factoid.fact.auth.ttl"; // seconds
+const uns FACT_AUTH_TTL_DEFAULT = 30;
 
-/**
- * Add a fact by keyword and optionally add it to groups.
- * @param key
- * @param fact
- * @param groups
- * @return
- */
-void FactoidManager::add_fact(const str& key, const str& fact, const str_set& groups)
-{
-	store.add(key, fact);
+const str SUGGEST_COUNT = "factoid.suggest.count"; // keys suggested when !fact misses
+const uns SUGGEST_COUNT_DEFAULT = 3;
 
-	if(!groups.empty())
-	{
-		str_set all_groups = index.get_set(key);
-		all_groups.insert(groups.begin(), groups.end());
-		bug_cnt(all_groups);
-		index.set_from(key, all_groups);
-	}
-}
+const str MAX_KEYS = "factoid.max.keys"; // keys per !fact or !give
+const uns MAX_KEYS_DEFAULT = 5;
 
-/**
- * Delete all facts, or a single fact from a keyword.
- * @param key
- * @param line
- * @param groups
- * @return
- */
-bool FactoidManager::del_fact(const str& key, uns line, const str_set& groups)
-{
-	bool kill = groups.empty();
+const str MAX_LINES = "factoid.max.lines"; // messages to the channel
+const uns MAX_LINES_DEFAULT = 2;
 
-	if(!kill)
-	{
-		str_set current_groups = index.get_set(key);
+const str REPLY_MAX = "factoid.reply.max"; // bytes the server allows per line
+const uns REPLY_MAX_DEFAULT = 512;
+const str REPLY_PACK = "factoid.reply.pack"; // bool
+const bool REPLY_PACK_DEFAULT = true;
+const str REPLY_CACHE = "factoid.reply.cache"; // replies kept (0 = none)
+const uns REPLY_CACHE_DEFAULT = 256;
 
-		for(auto&& g: current_groups)
-			if(groups.find(g) != groups.end())
-				{ kill = true; break; }
-	}
+const str WORKERS = "factoid.workers"; // threads for slow commands (0 = none)
+const uns WORKERS_DEFAULT = 2;
+const str WORKERS_QUEUE = "factoid.workers.queue"; // commands waiting
+const uns WORKERS_QUEUE_DEFAULT = 16;
+const str WORKERS_TIMEOUT = "factoid.workers.timeout"; // milliseconds
+const uns WORKERS_TIMEOUT_DEFAULT = 2000;
 
-	if(!kill)
-	{
-		error = "fact not found within specified group(s)";
-		return false;
-	}
+const str HISTORY = "factoid.history"; // edits remembered for !undofact and !factat
+const uns HISTORY_DEFAULT = 1000;
+const str HISTORY_AGE = "factoid.history.age"; // hours
+const uns HISTORY_AGE_DEFAULT = 24 * 7;
+const uns HISTORY_AGE_MAX = 24 * 365 * 10;
 
-	str_vec tmps = store.get_vec(key);
+const str BACKUP_FILE = "factoid.backup.file";
+const str BACKUP_FILE_DEFAULT = "factoid-backup.jsonl";
 
-	if(line == noline)
-		tmps.clear();
-	else
-	{
-		if(line <= tmps.size())
-			tmps.erase(tmps.begin() + line - 1);
-		else
-		{
-			error = "line number for key '" + key + "' does not exist: " + std::to_string(line);
-			return false;
-		}
-	}
+const str STATS_FILE = "factoid.stats.file";
+const str STATS_FILE_DEFAULT = "factoid-stats.json";
+const str STATS_INTERVAL = "factoid.stats.interval"; // seconds (0 = never)
+const uns STATS_INTERVAL_DEFAULT = 300;
 
-	store.clear(key);
+// room for the ":nick!user@host " the server puts
+// in front of our messages when it relays them
+const siz IRC_SOURCE_MAX = 100;
 
-	if(tmps.empty())
-		index.clear(key);
-	else
-		store.set_from(key, tmps);
-
-	return true;
-}
-
-/**
- * Add keyword to groups.
- * @param key
- * @param groups
- * @return
- */
-void FactoidManager::add_to_groups(const str& key, const str_set& groups)
+FactoidIrcBotPlugin::FactoidIrcBotPlugin(IrcBot& bot)
+: BasicIrcBotPlugin(bot)
+//, store(bot.getf(STORE_FILE, STORE_FILE_DEFAULT))
+//, index(bot.getf(INDEX_FILE, INDEX_FILE_DEFAULT))
+, chanops(bot, "chanops")
+, fm(bot.getf(STORE_FILE, STORE_FILE_DEFAULT), bot.getf(INDEX_FILE, INDEX_FILE_DEFAULT)
+	, bot.get(SNAPSHOT, false) ? bot.getf(SNAPSHOT_FILE, SNAPSHOT_FILE_DEFAULT) : ""
+	, bot.get(SHARDS, SHARDS_DEFAULT), bot.get(COMPRESS, false)
+	, bot.get(COMPRESS_CACHE, COMPRESS_CACHE_DEFAULT))
+, auth_hits(fm.get_stats().cache("auth_cache"))
+, reply_hits(fm.get_stats().cache("reply_cache"))
 {
-	str_set current_groups = index.get_set(key);
-	current_groups.insert(groups.begin(), groups.end());
-	index.set_from(key, current_groups);
 }
 
-/**
- * Remove keyword from groups.
- * @param key
- * @param groups
- * @return
- */
-void FactoidManager::del_from_groups(const str& key, const str_set& groups)
+FactoidIrcBotPlugin::~FactoidIrcBotPlugin()
 {
-	str_set current_groups = index.get_set(key);
-	for(auto&& g: groups)
-		current_groups.erase(current_groups.find(g));
-	index.set_from(key, current_groups);
+	// queued commands use everything else
+	workers.stop();
+
+	// the size gauges look at auth
+	fm.get_stats().stop_dump();
 }
 
-/**
- * Get a set of kewords that match the wildcard expression
- * @return
- */
-str_set FactoidManager::find_fact(const str& wild_key, const str_set& groups)
+str FactoidIrcBotPlugin::get_user(const message& msg)
 {
-	str_set wild_keys = store.get_keys_if_wild(wild_key);
-
-	if(groups.empty())
-		return wild_keys;
-
-	str_set keys;
+	bug_fun();
+	bug_var(chanops);
+	// chanops user | msg.userhost
 
-	for(auto&& k: wild_keys)
+	if(chanops && chanops->api(ChanopsApi::is_userhost_logged_in, {msg.get_userhost()}).empty())
 	{
-		for(auto&& g: index.get_set(k))
-			if(groups.find(g) != groups.end())
-				{ keys.insert(k); break; }
+		str_vec r = chanops->api(ChanopsApi::get_userhost_username, {msg.get_userhost()});
+		if(!r.empty())
+			return r[0];
 	}
 
-	return keys;
+	return msg.get_userhost();
 }
 
-bool wild_match(const str& w, const str& s, int flags = 0)
+void FactoidIrcBotPlugin::update_auth()
 {
-	return !fnmatch(w.c_str(), s.c_str(), flags | FNM_EXTMATCH);
-}
+	auth.ttl = std::chrono::seconds(bot.get(FACT_AUTH_TTL, FACT_AUTH_TTL_DEFAULT));
+	auth.next_update = clock::now() + auth.ttl;
 
-/**
- * Get a set of groups that match the wildcard expression
- * @return
- */
-str_set FactoidManager::find_group(const str& wild_group)
-{
-	str_set groups;
+	str_vec users = bot.get_vec(FACT_USER);
+	str_vec wild_config = bot.get_vec(FACT_WILD_USER);
+	str_vec preg_config = bot.get_vec(FACT_PREG_USER);
 
-	str_set keys = index.get_keys();
+	if(users == auth.users && wild_config == auth.wild_config && preg_config == auth.preg_config)
+		return;
 
-	for(auto&& k: keys)
-		for(auto&& g: index.get_set(k))
-			if(wild_match(wild_group, g))
-				groups.insert(g);
+	// config changed so nobody stays authorised on old rules
+	auth.valid.clear();
 
-	return groups;
-}
+	std::map<str, WildPattern> wild_users;
+	for(auto&& w: wild_config)
+	{
+		auto found = auth.wild_users.find(w);
+		if(found != auth.wild_users.end())
+			wild_users[w] = found->second;
+		else
+			wild_users[w] = WildPattern(w);
+	}
 
-template<typename Container1, typename Container2>
-bool group_intersect(Container1&& group1, Container2&& group2)
-{
-	for(auto&& g1: group1)
-		for(auto&& g2: group2)
-			if(g1 == g2)
-				return true;
-	return false;
-}
+	std::map<str, std::shared_ptr<std::regex>> preg_users;
+	for(auto&& r: preg_config)
+	{
+		auto found = auth.preg_users.find(r);
+		if(found != auth.preg_users.end())
+			preg_users[r] = found->second;
+		else
+		{
+			try
+			{
+				preg_users[r] = std::make_shared<std::regex>(r, std::regex::optimize);
+			}
+			catch(const std::regex_error& e)
+			{
+				log("ERROR: bad regex in " + FACT_PREG_USER + ": " + r + ": " + e.what());
+				preg_users[r] = nullptr;
+			}
+		}
+	}
 
-str_vec FactoidManager::get_fact(const str& key, const str_set& groups)
-{
-	if(groups.empty() || group_intersect(groups, index.get_vec(key)))
-		return store.get_vec(key);
-	return {};
+	auth.users = std::move(users);
+	auth.wild_config = std::move(wild_config);
+	auth.preg_config = std::move(preg_config);
+	auth.wild_users = std::move(wild_users);
+	auth.preg_users = std::move(preg_users);
 }
 
-FactoidIrcBotPlugin::FactoidIrcBotPlugin(IrcBot& bot)
-: BasicIrcBotPlugin(bot)
-//, store(bot.getf(STORE_FILE, STORE_FILE_DEFAULT))
-//, index(bot.getf(INDEX_FILE, INDEX_FILE_DEFAULT))
-, chanops(bot, "chanops")
-, fm(bot.getf(STORE_FILE, STORE_FILE_DEFAULT), bot.getf(INDEX_FILE, INDEX_FILE_DEFAULT))
+bool FactoidIrcBotPlugin::is_user_valid(const message& msg)
 {
-}
+//	bug_fun();
 
-FactoidIrcBotPlugin::~FactoidIrcBotPlugin() {}
+	const str& userhost = msg.get_userhost();
+	const auto now = clock::now();
 
-str FactoidIrcBotPlugin::get_user(const message& msg)
-{
-	bug_fun();
-	bug_var(chanops);
-	// chanops user | msg.userhost
+	std::lock_guard<std::mutex> lock(auth.mtx);
 
-	if(chanops && chanops->api(ChanopsApi::is_userhost_logged_in, {msg.get_userhost()}).empty())
+	// config changes are noticed within a ttl, as a user
+	// who is no longer allowed already may be remembered
+	if(now >= auth.next_update)
+		update_auth();
+
+	auto found = auth.valid.find(userhost);
+	if(found != auth.valid.end())
 	{
-		str_vec r = chanops->api(ChanopsApi::get_userhost_username, {msg.get_userhost()});
-		if(!r.empty())
-			return r[0];
+		if(now < found->second)
+		{
+			auth_hits.hit();
+			return true;
+		}
+		auth.valid.erase(found);
 	}
 
-	return msg.get_userhost();
-}
+	auth_hits.miss();
 
-bool FactoidIrcBotPlugin::is_user_valid(const message& msg)
-{
-//	bug_fun();
+	bool valid = false;
 
 	// Manual overrides from config file
-	for(const str& r: bot.get_vec(FACT_USER))
-		if(r == msg.get_userhost())
-			return true;
-	for(const str& r: bot.get_vec(FACT_WILD_USER))
-		if(bot.wild_match(r, msg.get_userhost()))
-			return true;
-	for(const str& r: bot.get_vec(FACT_PREG_USER))
-		if(bot.preg_match(r, msg.get_userhost()))
-			return true;
-	if(bot.get(FACT_CHANOPS_USERS, false) && chanops)
-		return !chanops->api(ChanopsApi::is_userhost_logged_in, {msg.get_userhost()}).empty();
+	for(const str& r: auth.users)
+		if(r == userhost)
+			{ valid = true; break; }
+	if(!valid)
+		for(auto&& w: auth.wild_users)
+			if(w.second.match(userhost))
+				{ valid = true; break; }
+	if(!valid)
+		for(auto&& r: auth.preg_users)
+			if(r.second && std::regex_search(userhost, *r.second))
+				{ valid = true; break; }
+	if(!valid && bot.get(FACT_CHANOPS_USERS, false) && chanops)
+		valid = !chanops->api(ChanopsApi::is_userhost_logged_in, {userhost}).empty();
+
+	if(!valid)
+		return false;
 
-	return false;
+	// only successes are remembered so a new
+	// login is noticed straight away
+	if(auth.ttl.count())
+	{
+		for(auto i = auth.valid.begin(); i != auth.valid.end();)
+		{
+			if(i->second < now)
+				i = auth.valid.erase(i);
+			else
+				++i;
+		}
+		auth.valid[userhost] = now + auth.ttl;
+	}
+
+	return true;
 }
 
 // IRC_BOLD + IRC_COLOR + IRC_Green + "addfact: " + IRC_NORMAL
@@ -307,6 +314,13 @@ bool FactoidIrcBotPlugin::reloadfacts(const message& msg)
 	if(!is_user_valid(msg))
 		return bot.cmd_error(msg, msg.get_nickname() + " is not authorised to reload facts.");
 
+	{
+		// pick up authorisation changes too
+		std::lock_guard<std::mutex> lock(auth.mtx);
+		auth.valid.clear();
+		update_auth();
+	}
+
 	if(fm.reload())
 		bot.fc_reply(msg, get_prefix(msg, IRC_Green) + " Fact database reloaded.");
 	else
@@ -324,22 +338,20 @@ bool FactoidIrcBotPlugin::addgroup(const message& msg)
 	BUG_COMMAND(msg);
 
 	// !addgroup <key> <group>,<group>
-	str key;
-	str_set groups;
-	siss iss(msg.get_user_params());
+	const str params = msg.get_user_params();
 
-	if(!(iss >> key))
-		return reply(msg, "expected <key>", true);
-
-	bug_var(key);
-
-	str group;
-	while(sgl(iss >> std::ws, group, ','))
-		groups.insert(trim(group));
-
-	if(groups.empty())
+	fact_command cmd;
+	if(!parse_command(params, command_syntax::key_groups, cmd))
+	{
+		if(cmd.keys[0].empty())
+			return reply(msg, "expected <key>", true);
 		return reply(msg, "expected groups <group1>, <group2>, etc...");
+	}
+
+	const str key = cmd.keys[0].to_string();
+	const str_set groups = to_set(cmd.groups);
 
+	bug_var(key);
 	bug_cnt(groups);
 
 	fm.add_to_groups(key, groups);
@@ -358,30 +370,16 @@ bool FactoidIrcBotPlugin::addfact(const message& msg)
 	if(!is_user_valid(msg))
 		return bot.cmd_error(msg, msg.get_nickname() + " is not authorised to add facts.");
 
-	str topics, key, fact;
-	siss iss(msg.get_user_params());
+	const str params = msg.get_user_params();
 
-	// add group
-	str_set groups;
-
-	if(!ios::getnested(iss, topics, '[', ']')) // group
-		iss.clear();
-	else
-	{
-		str list, group;
-		sgl(sgl(siss(topics), list, '['), list, ']');
-
-		bug_var(list);
-
-		siss iss(list);
-		while(sgl(iss, group, ','))
-			groups.insert(trim(group));
-	}
-
-	sgl(iss >> key >> std::ws, fact);
-	if(trim(fact).empty())
+	fact_command cmd;
+	if(!parse_command(params, command_syntax::key_text, cmd))
 		return reply(msg, "Empty fact rejected.", true);
 
+	const str key = cmd.keys[0].to_string();
+	const str fact = cmd.text.to_string();
+	const str_set groups = to_set(cmd.groups);
+
 	bug_var(key);
 	bug_var(fact);
 	bug_cnt(groups);
@@ -409,40 +407,23 @@ bool FactoidIrcBotPlugin::delfact(const message& msg)
 	if(!is_user_valid(msg))
 		return bot.cmd_error(msg, msg.get_nickname() + " is not authorised to edit facts.");
 
-	str topics, key, idx;
-	siss iss(msg.get_user_params());
+	const str params = msg.get_user_params();
 
-	// add group
-	str_set groups;
-
-	if(!ios::getnested(iss, topics, '[', ']')) // group
-		iss.clear();
-	else
-	{
-		str list, group;
-		sgl(sgl(siss(topics), list, '['), list, ']');
-
-		bug_var(list);
-
-		siss iss(list);
-		while(sgl(iss, group, ','))
-			groups.insert(trim(group));
-	}
-
-	if(!(iss >> key))
+	fact_command cmd;
+	if(!parse_command(params, command_syntax::key_line, cmd))
 	{
-		log("ERROR: parameters needed");
+		if(cmd.keys.empty() || cmd.keys[0].empty())
+		{
+			log("ERROR: parameters needed");
+			return true;
+		}
+		reply(msg, "bad line number: " + cmd.text.to_string());
 		return true;
 	}
 
-	uns line_number = FactoidManager::noline; // -1 == all lines
-
-	iss >> idx; // #n where n > 0
-	if(!idx.empty() && (idx[0] != '#' || !(siss(idx).ignore() >> line_number) || !line_number))
-	{
-		reply(msg, "bad line number: " + idx);
-		return true;
-	}
+	const str key = cmd.keys[0].to_string();
+	const str_set groups = to_set(cmd.groups);
+	const uns line_number = cmd.line; // noline == all lines
 
 	bug_var(key);
 	bug_var(line_number);
@@ -459,52 +440,204 @@ bool FactoidIrcBotPlugin::delfact(const message& msg)
 	return true;
 }
 
-bool FactoidIrcBotPlugin::findfact(const message& msg)
+bool FactoidIrcBotPlugin::undofact(const message& msg)
 {
 	BUG_COMMAND(msg);
 
-	// !findfact *([group1,group2]) <wildcard>"
+	// !undofact <key>
+
+	if(!is_user_valid(msg))
+		return bot.cmd_error(msg, msg.get_nickname() + " is not authorised to edit facts.");
 
-	siss iss(msg.get_user_params());
+	const str params = msg.get_user_params();
 
-	str_set groups;
-	if(iss.peek() == '[') // groups
+	fact_command cmd;
+	if(!parse_command(params, command_syntax::keys, cmd) || cmd.keys.size() != 1 || !cmd.groups.empty())
+		return reply(msg, "Expected: !undofact <key>.", true);
+
+	const str key = cmd.keys[0].to_string();
+
+	bug_var(key);
+
+	if(!fm.undo_fact(key))
+		return reply(msg, fm.error, true);
+
+	return reply(msg, "Fact '" + fold_key(key) + "' restored to before its last edit.");
+}
+
+/**
+ * Read how long ago as <n>(s|m|h|d).
+ */
+static bool parse_ago(const str& text, std::chrono::seconds& ago)
+{
+	if(text.size() < 2 || !std::all_of(text.begin(), text.end() - 1, [](char c){ return c >= '0' && c <= '9'; }))
+		return false;
+
+	const siz n = std::stoul(text.substr(0, text.size() - 1));
+
+	switch(text.back())
 	{
-		iss.ignore();
-		str list; // groups
-		sgl(iss, list, ']');
-		siss iss(list);
-		str group;
-		while(sgl(iss, group, ','))
-		{
-			bug_var(group);
-			groups.insert(trim(group));
-		}
+		case 's': ago = std::chrono::seconds(n); return true;
+		case 'm': ago = std::chrono::minutes(n); return true;
+		case 'h': ago = std::chrono::hours(n); return true;
+		case 'd': ago = std::chrono::hours(24 * n); return true;
 	}
 
-	str key_match;
-	sgl(iss, key_match);
+	return false;
+}
+
+/**
+ * How long edits are remembered, kept short enough
+ * that the time that long ago can be worked out.
+ */
+static std::chrono::hours get_history_age(IrcBot& bot)
+{
+	return std::chrono::hours(std::min(bot.get(HISTORY_AGE, HISTORY_AGE_DEFAULT), HISTORY_AGE_MAX));
+}
+
+bool FactoidIrcBotPlugin::factat(const message& msg)
+{
+	BUG_COMMAND(msg);
+
+	// !factat *([group1,group2]) <n>(s|m|h|d) <key>
 
-	if(trim(key_match).empty())
+	const str params = msg.get_user_params();
+
+	fact_command cmd;
+	std::chrono::seconds ago;
+	if(!parse_command(params, command_syntax::keys, cmd) || cmd.keys.size() != 2
+		|| cmd.keys[0].size() > 9 || !parse_ago(cmd.keys[0].to_string(), ago))
+		return reply(msg, "Expected: !factat [<group1>(,<group2>)*]? <n>(s|m|h|d) <key>.", true);
+
+	const str key = cmd.keys[1].to_string();
+	const str_set groups = to_set(cmd.groups);
+
+	bug_var(key);
+	bug_var(ago.count());
+
+	// checked before it goes anywhere near a time_point
+	const std::chrono::hours max_age = get_history_age(bot);
+	if(ago > max_age)
+		return reply(msg, "Edits are only remembered for " + std::to_string(max_age.count()) + " hours.", true);
+
+	str_vec lines;
+	if(!fm.get_fact_at(key, FactHistory::clock::now() - ago, lines, groups))
+		return reply(msg, fm.error, true);
+
+	// sent as !fact would, aliases and all
+	const str head = get_prefix(msg, IRC_Aqua_Light) + IRC_BOLD + IRC_COLOR + IRC_Navy_Blue;
+
+	ReplyBuilder built(head, get_reply_max(msg), bot.get(REPLY_PACK, REPLY_PACK_DEFAULT));
+	for(auto&& line: lines)
+		built.add(line);
+
+	send_lines(msg, built, head);
+
+	return true;
+}
+
+bool FactoidIrcBotPlugin::backupfacts(const message& msg)
+{
+	BUG_COMMAND(msg);
+
+	// !backupfacts
+
+	if(!is_user_valid(msg))
+		return bot.cmd_error(msg, msg.get_nickname() + " is not authorised to back up facts.");
+
+	if(!fm.backup_facts(bot.getf(BACKUP_FILE, BACKUP_FILE_DEFAULT)))
+		return reply(msg, fm.error, true);
+
+	return reply(msg, "Facts backed up.");
+}
+
+bool FactoidIrcBotPlugin::findfact(const message& msg, const StopToken& stop)
+{
+	BUG_COMMAND(msg);
+
+	// !findfact *([group1,group2]) <wildcard>"
+
+	const str params = msg.get_user_params();
+
+	fact_command cmd;
+	if(!parse_command(params, command_syntax::text, cmd))
 		return reply(msg, "Empty key rejected.");
 
+	const str key_match = cmd.text.to_string();
+	const str_set groups = to_set(cmd.groups);
+
 	bug_var(key_match);
 
-	str_set keys = fm.find_fact(key_match, groups);
+	uns max = bot.get("factoid.max.results", 20U);
 
-	if(keys.empty())
-		return reply(msg, "No results.", true);
+	str line, sep;
+	siz listed = 0;
 
-	if(keys.size() > 20)
+	// one extra to know if there are too many
+	siz found = fm.visit_facts(key_match, [&](const str& key) // TODO: filter out aliases here ?
 	{
-		uns max = bot.get("factoid.max.results", 20U);
+		if(listed++ == max)
+			return;
+		line += sep;
+		line += '\'';
+		line += key;
+		line += '\'';
+		sep = ", ";
+	}, groups, max + 1, &stop);
+
+	if(!found)
+		return reply(msg, stop.stopped() ? "Search took too long, no results." : "No results.", true);
+
+	if(found > max)
 		reply(msg, "Too many results, printing the first " + std::to_string(max) + ".");
-		keys.erase(std::next(keys.begin(), max));
+	else if(stop.stopped())
+		reply(msg, "Search took too long, printing what was found.");
+
+	reply(msg, line);
+
+	return true;
+}
+
+bool FactoidIrcBotPlugin::searchfact(const message& msg)
+{
+	BUG_COMMAND(msg);
+
+	// !searchfact *([group1,group2]) <terms>
+
+	const str params = msg.get_user_params();
+
+	fact_command cmd;
+	if(!parse_command(params, command_syntax::text, cmd))
+		return reply(msg, "Expected: !searchfact [<group1>(,<group2>)*]? <words>.", true);
+
+	const str terms = cmd.text.to_string();
+	const str_set groups = to_set(cmd.groups);
+
+	bug_var(terms);
+
+	uns max = bot.get("factoid.max.results", 20U);
+
+	// one extra to know if there are too many
+	auto hits = fm.search_fact(terms, groups, max + 1);
+
+	if(hits.empty())
+		return reply(msg, "No results.", true);
+
+	if(hits.size() > max)
+	{
+		reply(msg, "Too many results, printing the best " + std::to_string(max) + ".");
+		hits.resize(max);
 	}
 
 	str line, sep;
-	for(const str& key: keys) // TODO: filter out aliases here ?
-		{ line += sep + "'" + key + "'"; sep = ", "; }
+	for(auto&& hit: hits)
+	{
+		line += sep;
+		line += '\'';
+		line += hit.key;
+		line += '\'';
+		sep = ", ";
+	}
 
 	reply(msg, line);
 
@@ -524,33 +657,44 @@ str_vec split_list(const str& list, char delim = ',')
 	return split;
 }
 
-bool FactoidIrcBotPlugin::findgroup(const message& msg)
+bool FactoidIrcBotPlugin::findgroup(const message& msg, const StopToken& stop)
 {
 	BUG_COMMAND(msg);
 
 	//  !fg <wildcard>
 
-	siss iss(msg.get_user_params());
+	const str params = msg.get_user_params();
 
-	str wild_group;
-	if(!sgl(iss, wild_group) || trim(wild_group).empty())
+	fact_command cmd;
+	if(!parse_command(params, command_syntax::bare_text, cmd))
 		return reply(msg, "expected wildcard group expression", true);
 
-	str_set groups = fm.find_group(wild_group);
+	const str wild_group = cmd.text.to_string();
 
-	if(groups.empty())
-		return reply(msg, "No results.", true);
+	uns max = bot.get("factoid.max.results", 20U);
 
-	if(groups.size() > 20)
+	str line, sep;
+	siz listed = 0;
+
+	// one extra to know if there are too many
+	siz found = fm.visit_groups(wild_group, [&](const str& group)
 	{
-		uns max = bot.get("factoid.max.results", 20U);
+		if(listed++ == max)
+			return;
+		line += sep;
+		line += '\'';
+		line += group;
+		line += '\'';
+		sep = ", ";
+	}, max + 1, &stop);
+
+	if(!found)
+		return reply(msg, stop.stopped() ? "Search took too long, no results." : "No results.", true);
+
+	if(found > max)
 		reply(msg, "Too many results, printing the first " + std::to_string(max) + ".");
-		groups.erase(std::next(groups.begin(), max));
-	}
-
-	str line, sep;
-	for(const str& key: groups)
-		{ line += sep + "'" + key + "'"; sep = ", "; }
+	else if(stop.stopped())
+		reply(msg, "Search took too long, printing what was found.");
 
 	reply(msg, line);
 
@@ -597,81 +741,169 @@ str_set get_topics_from_fact(const str& fact)
 	return topics;
 }
 
-bool FactoidIrcBotPlugin::fact(const message& msg, const str& key, const str_set& groups, const str& prefix)
+siz FactoidIrcBotPlugin::get_reply_max(const message& msg)
+{
+	// what a message can hold once the server has added
+	// its own ":source PRIVMSG <target> :" and "\r\n"
+	const siz target = std::max(msg.reply_to().size(), msg.get_nickname().size());
+	const siz overhead = IRC_SOURCE_MAX + str("PRIVMSG  :\r\n").size() + target;
+	const siz reply_max = bot.get(REPLY_MAX, REPLY_MAX_DEFAULT);
+	return reply_max > overhead ? reply_max - overhead : 0;
+}
+
+void FactoidIrcBotPlugin::send_lines(const message& msg, const ReplyBuilder& lines, const str& head)
+{
+	const uns max_lines = bot.get(MAX_LINES, MAX_LINES_DEFAULT);
+
+	// Max of 2 lines in channel, the rest go to PM
+	lines.send([&](const str& line){ bot.fc_reply(msg, line); }, 0, max_lines);
+
+	if(lines.size() > max_lines)
+	{
+		bot.fc_reply(msg, head + "...additional lines sent to PM.");
+		lines.send([&](const str& line){ bot.fc_reply_pm(msg, line); }, max_lines);
+	}
+}
+
+bool FactoidIrcBotPlugin::fact(const message& msg, const str_vec& keys, const str_set& groups, const str& prefix)
 {
 	BUG_COMMAND(msg);
 
-	const str_vec facts = fm.get_fact(key, groups);
+	const siz max = get_reply_max(msg);
+	const bool pack = bot.get(REPLY_PACK, REPLY_PACK_DEFAULT);
 
-	if(facts.empty())
+	const str head = prefix + IRC_BOLD + IRC_COLOR + IRC_Navy_Blue;
+
+	// everything the messages are built from
+	str id = head;
+	id += '\0';
+	id += std::to_string(max) + (pack ? "p" : "");
+	for(auto&& group: groups)
+		id += '\0' + group;
+	for(auto&& key: keys)
 	{
-		if(groups.empty())
-			return bot.cmd_error(msg, "No facts associated with key: " + key);
-		else
-			return bot.cmd_error(msg, "No facts associated with key: " + key + " for those groups.");
+		id += '\0';
+		id += key;
 	}
 
-	// !fact *[group1,group2] <key>
-	siz c = 0;
-	for(auto&& fact: facts)
+	// read first so any edit during the lookup makes the reply stale
+	const std::uint64_t generation = fm.get_generation();
+
+	ReplyCache::reply lines = replies.get(id, generation);
+
+	if(lines)
+		reply_hits.hit();
+	else
 	{
-		if(!fact.empty() && fact[0] == '=')
-		{
-			// follow a fact alias link: <fact2>: = <fact1>
-			str key;
-			sgl(siss(fact).ignore() >> std::ws, key);
-			this->fact(msg, key, groups, prefix);
-		}
-		else
+		reply_hits.miss();
+
+		const std::vector<fact_lines> facts = fm.get_facts(keys, groups);
+
+		str_vec missing;
+		for(siz i = 0; i < keys.size(); ++i)
+			if(facts[i].empty())
+				missing.push_back(keys[i]);
+
+		if(missing.size() == keys.size())
 		{
-			// Max of 2 lines in channel
-			uns max_lines = bot.get("factoid.max.lines", 2U);
-			if(c < max_lines)
-				bot.fc_reply(msg, prefix + IRC_BOLD + IRC_COLOR + IRC_Navy_Blue + fact);
-			else
+			if(keys.size() > 1)
+				return bot.cmd_error(msg, "No facts associated with any of those keys.");
+
+			const str& key = keys[0];
+
+			str text = "No facts associated with key: " + key;
+			if(!groups.empty())
+				text += " for those groups";
+
+			const str_vec similar = fm.suggest_fact(key, groups, bot.get(SUGGEST_COUNT, SUGGEST_COUNT_DEFAULT));
+
+			if(similar.empty())
+				return bot.cmd_error(msg, text + ".");
+
+			str sep = ". Did you mean: ";
+			for(auto&& k: similar)
 			{
-				if(c == max_lines)
-					bot.fc_reply(msg, prefix + IRC_BOLD + IRC_COLOR + IRC_Navy_Blue +
-						"...additional lines sent to PM.");
-				bot.fc_reply_pm(msg, prefix + IRC_BOLD + IRC_COLOR + IRC_Navy_Blue + fact);
+				text += sep + "'" + k + "'";
+				sep = ", ";
 			}
+
+			return bot.cmd_error(msg, text + "?");
 		}
-		++c;
+
+		auto built = std::make_shared<ReplyBuilder>(head, max, pack);
+
+		siz bytes = 0;
+		for(siz i = 0; i < keys.size(); ++i)
+			for(auto&& fact: facts[i])
+				bytes += head.size() + keys[i].size() + fact.size();
+		built->reserve(bytes);
+
+		// !fact *[group1,group2] <key>+
+		for(siz i = 0; i < keys.size(); ++i)
+		{
+			if(facts[i].empty())
+				continue;
+
+			auto fact = facts[i].begin();
+
+			// with several keys say whose facts follow
+			if(keys.size() > 1)
+				built->add("(" + keys[i] + ") " + fact++->to_string());
+
+			for(; fact != facts[i].end(); ++fact)
+				built->add(*fact);
+		}
+
+		if(!missing.empty())
+		{
+			str line = "No facts for:";
+			for(auto&& key: missing)
+				line += " " + key;
+			built->end();
+			built->add(line);
+		}
+
+		lines = built;
+		replies.put(id, generation, lines);
 	}
 
+	send_lines(msg, *lines, head);
+
 	return true;
 }
 
+/**
+ * The keys of !fact and !give, case folded so
+ * the reply cache has one entry per key.
+ */
+str_vec get_keys(const fact_command& cmd)
+{
+	str_vec keys;
+	for(auto&& key: cmd.keys)
+		keys.push_back(fold_key(key));
+	return keys;
+}
+
 bool FactoidIrcBotPlugin::fact(const message& msg)
 {
 	BUG_COMMAND(msg);
 
-	// !fact *([group1,group2]) <wildcard>"
+	// !fact *([group1,group2]) <key>+
 
-	siss iss(msg.get_user_params());
+	const str params = msg.get_user_params();
 
-	str_set groups;
-	if(iss.peek() == '[') // groups
-	{
-		iss.ignore();
-		str list; // groups
-		sgl(iss, list, ']');
-		siss iss(list);
-		str group;
-		while(sgl(iss, group, ','))
-		{
-			bug_var(group);
-			groups.insert(trim(group));
-		}
-	}
+	fact_command cmd;
+	if(!parse_command(params, command_syntax::keys, cmd))
+		return bot.cmd_error(msg, "Expected: !fact <key>+.");
 
-	str key;
-	sgl(iss, key);
+	const str_vec keys = get_keys(cmd);
+	const str_set groups = to_set(cmd.groups);
 
-	if(trim(key).empty())
-		return bot.cmd_error(msg, "Expected: !fact <key>.");
-	else
-		fact(msg, lower(key), groups, get_prefix(msg, IRC_Aqua_Light));
+	const uns max_keys = bot.get(MAX_KEYS, MAX_KEYS_DEFAULT);
+	if(keys.size() > max_keys)
+		return bot.cmd_error(msg, "At most " + std::to_string(max_keys) + " keys at once.");
+
+	fact(msg, keys, groups, get_prefix(msg, IRC_Aqua_Light));
 
 	return true;
 }
@@ -680,34 +912,62 @@ bool FactoidIrcBotPlugin::give(const message& msg)
 {
 	BUG_COMMAND(msg);
 
-	// !give <nick> *[group1, group2] <key>
+	// !give <nick> *[group1, group2] <key>+
+
+	const str params = msg.get_user_params();
+
+	fact_command cmd;
+	if(!parse_command(params, command_syntax::nick_keys, cmd))
+		return bot.cmd_error(msg, "Expected: !give <nick> *[group1, group2] <key>+.");
 
-	siss iss(msg.get_user_params());
+	const str nick = cmd.nick.to_string();
+	const str_vec keys = get_keys(cmd);
+	const str_set groups = to_set(cmd.groups);
 
-	str nick;
-	if(!(iss >> nick >> std::ws))
-		return bot.cmd_error(msg, "Expected: !give <nick> *[group1, group2] <key>.");
+	const uns max_keys = bot.get(MAX_KEYS, MAX_KEYS_DEFAULT);
+	if(keys.size() > max_keys)
+		return bot.cmd_error(msg, "At most " + std::to_string(max_keys) + " keys at once.");
 
-	str_set groups;
-	if(iss.peek() == '[') // groups
+	str names, sep;
+	for(auto&& key: keys)
 	{
-		iss.ignore();
-		str list; // groups
-		sgl(iss, list, ']');
-		siss iss(list);
-		str group;
-		while(sgl(iss, group, ','))
-		{
-			bug_var(group);
-			groups.insert(trim(group));
-		}
+		names += sep + key;
+		sep = " ";
+	}
+
+	fact(msg, keys, groups, nick + ": " + irc::IRC_BOLD + "(" + names + ") - " + irc::IRC_NORMAL);
+
+	return true;
+}
+
+bool FactoidIrcBotPlugin::factstats(const message& msg)
+{
+	BUG_COMMAND(msg);
+
+	// !factstats <wildcard>?
+
+	str wild;
+	if(!sgl(siss(msg.get_user_params()), wild) || trim(wild).empty())
+		wild = "*";
+
+	str_vec lines = fm.get_stats().report(wild);
+
+	if(lines.empty())
+		return reply(msg, "No results.", true);
+
+	const uns max_lines = bot.get(MAX_LINES, MAX_LINES_DEFAULT);
+
+	if(lines.size() <= max_lines)
+	{
+		for(auto&& line: lines)
+			reply(msg, line);
+		return true;
 	}
 
-	str key;
-	if(!sgl(iss >> std::ws, key) || trim(key).empty())
-		return bot.cmd_error(msg, "Expected: !give <nick> *[group1, group2] <key>.");
+	reply(msg, "Statistics sent to PM.");
 
-	fact(msg, lower(key), groups, nick + ": " + irc::IRC_BOLD + "(" + key + ") - " + irc::IRC_NORMAL);
+	for(auto&& line: lines)
+		bot.fc_reply_pm(msg, get_prefix(msg, IRC_Green) + " " + line);
 
 	return true;
 }
@@ -718,73 +978,174 @@ bool FactoidIrcBotPlugin::initialize()
 {
 	// {bug: #24} update store to ass user
 
+	// facts left in files for another number of shards would
+	// be lost from view, and edits would go to fresh files
+	if(!fm.check_files())
+	{
+		log("ERROR: " + fm.error);
+		return false;
+	}
+
+	fm.set_max_alias_depth(bot.get("factoid.max.alias.depth", fm.get_max_alias_depth()));
+	fm.set_max_suggest_distance(bot.get("factoid.suggest.distance", fm.get_max_suggest_distance()));
+
+	if(bot.get(JOURNAL, false))
+	{
+		if(!fm.open_journal(bot.getf(JOURNAL_FILE, JOURNAL_FILE_DEFAULT)
+			, std::chrono::milliseconds(bot.get(JOURNAL_SYNC, JOURNAL_SYNC_DEFAULT))
+			, std::chrono::seconds(bot.get(JOURNAL_COMPACT, JOURNAL_COMPACT_DEFAULT))))
+		{
+			log("ERROR: " + fm.error);
+			return false;
+		}
+	}
+
+	if(bot.get(WATCH, false) && !fm.watch_files())
+		log("ERROR: " + fm.error);
+
+	fm.set_history(bot.get(HISTORY, HISTORY_DEFAULT), get_history_age(bot));
+
+	{
+		std::lock_guard<std::mutex> lock(auth.mtx);
+		update_auth();
+	}
+
+	FactoidStats& stats = fm.get_stats();
+
+	stats.size("auth_cache_entries", [this]
+	{
+		std::lock_guard<std::mutex> lock(auth.mtx);
+		return auth.valid.size();
+	});
+
+	replies.set_capacity(bot.get(REPLY_CACHE, REPLY_CACHE_DEFAULT));
+	stats.size("reply_cache_entries", [this]{ return replies.size(); });
+
+	stats.start_dump(bot.getf(STATS_FILE, STATS_FILE_DEFAULT)
+		, std::chrono::seconds(bot.get(STATS_INTERVAL, STATS_INTERVAL_DEFAULT)));
+
+	// every command is timed under its own name
+	auto timed = [&](const str& cmd, std::function<void(const message&)> func)
+	{
+		LatencyHistogram& h = stats.latency(cmd);
+		return [&h, func](const message& msg){ LatencyTimer timer(h); func(msg); };
+	};
+
+	workers.start(bot.get(WORKERS, WORKERS_DEFAULT), bot.get(WORKERS_QUEUE, WORKERS_QUEUE_DEFAULT));
+	stats.size("worker_jobs", [this]{ return workers.size(); });
+
+	const std::chrono::milliseconds timeout(bot.get(WORKERS_TIMEOUT, WORKERS_TIMEOUT_DEFAULT));
+
+	// slow commands go to the workers so the bot carries on
+	// with other messages, and are cut short after timeout
+	auto pooled = [&](const str& cmd, std::function<void(const message&, const StopToken&)> func)
+	{
+		LatencyHistogram& h = stats.latency(cmd);
+		return [this, &h, func, timeout](const message& msg)
+		{
+			auto run = [&h, func, msg](const StopToken& stop){ LatencyTimer timer(h); func(msg, stop); };
+			if(!workers.submit(run, timeout))
+				bot.cmd_error(msg, "Too busy, try again later.");
+		};
+	};
+
 	add
 	({
 		"!addfact"
 		, "!addfact [group1,group2]? <key> \"<fact>\" - Display key fact."
-		, [&](const message& msg){ addfact(msg); }
+		, timed("!addfact", [&](const message& msg){ addfact(msg); })
 	});
 	add
 	({
 		"!delfact"
 		, "!delfact [<group1>(,<group2>)*]? <key> ?(#n) - Delete fact or single line from fact."
-		, [&](const message& msg){ delfact(msg); }
+		, timed("!delfact", [&](const message& msg){ delfact(msg); })
+	});
+	add
+	({
+		"!undofact"
+		, "!undofact <key> - Undo the last edit of key, again to undo the one before."
+		, timed("!undofact", [&](const message& msg){ undofact(msg); })
+	});
+	add
+	({
+		"!factat"
+		, "!factat [<group1>(,<group2>)*]? <n>(s|m|h|d) <key> - Display key fact as it was that long ago."
+		, timed("!factat", [&](const message& msg){ factat(msg); })
+	});
+	add
+	({
+		"!backupfacts"
+		, "!backupfacts - Write every fact to the backup file."
+		, pooled("!backupfacts", [&](const message& msg, const StopToken&){ backupfacts(msg); })
 	});
 	add
 	({
 		"!addgroup"
 		, "!addgroup <key> <group>(,<group>)* - Add key to groups."
-		, [&](const message& msg){ addgroup(msg); }
+		, timed("!addgroup", [&](const message& msg){ addgroup(msg); })
 	});
 	add
 	({
 		"!findfact"
 		, "!findfact [<group1>(,<group2>)*]? <wildcard> - Get a list of matching fact keys."
-		, [&](const message& msg){ findfact(msg); }
+		, pooled("!findfact", [&](const message& msg, const StopToken& stop){ findfact(msg, stop); })
 	});
 	add
 	({
 		"!ff"
 		, "!ff - alias for !findfact."
-		, [&](const message& msg){ findfact(msg); }
+		, pooled("!ff", [&](const message& msg, const StopToken& stop){ findfact(msg, stop); })
 	});
 	add
 	({
 		"!findgroup"
 		, "!findgroup <wildcard> - Get a list of matching groups."
-		, [&](const message& msg){ findgroup(msg); }
+		, pooled("!findgroup", [&](const message& msg, const StopToken& stop){ findgroup(msg, stop); })
 	});
 	add
 	({
 		"!fg"
 		, "!fg - alias for !findgroup."
-		, [&](const message& msg){ findgroup(msg); }
+		, pooled("!fg", [&](const message& msg, const StopToken& stop){ findgroup(msg, stop); })
+	});
+	add
+	({
+		"!searchfact"
+		, "!searchfact [<group1>(,<group2>)*]? <words> - Get the fact keys best matching the words."
+		, pooled("!searchfact", [&](const message& msg, const StopToken&){ searchfact(msg); })
 	});
 	add
 	({
 		"!fact"
-		, "!fact [<group1>(,<group2>)*]? <key> - Display key fact."
-		, [&](const message& msg){ fact(msg); }
+		, "!fact [<group1>(,<group2>)*]? <key>+ - Display key fact (or the facts of several keys)."
+		, timed("!fact", [&](const message& msg){ fact(msg); })
 	});
 	add
 	({
 		"!f"
 		, "!f - alias for !fact."
-		, [&](const message& msg){ fact(msg); }
+		, timed("!f", [&](const message& msg){ fact(msg); })
 	});
 	add
 	({
 		"!give"
-		, "!give <nick> <key> - Display fact highlighting <nick>."
-		, [&](const message& msg){ give(msg); }
+		, "!give <nick> <key>+ - Display fact highlighting <nick>."
+		, timed("!give", [&](const message& msg){ give(msg); })
 	});
 	add
 	({
 		"!reloadfacts"
 		, "!reloadfacts - Reload fact database."
-		, [&](const message& msg){ reloadfacts(msg); }
+		, timed("!reloadfacts", [&](const message& msg){ reloadfacts(msg); })
 //		, action::INVISIBLE
 	});
+	add
+	({
+		"!factstats"
+		, "!factstats <wildcard>? - Show command timings, cache hit rates and database sizes."
+		, timed("!factstats", [&](const message& msg){ factstats(msg); })
+	});
 //	bot.add_monitor(*this);
 	return true;
 }
@@ -798,6 +1159,16 @@ str FactoidIrcBotPlugin::get_version() const { return VERSION; }
 void FactoidIrcBotPlugin::exit()
 {
 //	bug_fun();
+	workers.stop();
+	fm.unwatch_files();
+	fm.sync();
+	if(!fm.save_snapshot())
+		log("ERROR: " + fm.error);
+
+	FactoidStats& stats = fm.get_stats();
+	stats.stop_dump();
+	if(bot.get(STATS_INTERVAL, STATS_INTERVAL_DEFAULT) && !stats.write(bot.getf(STATS_FILE, STATS_FILE_DEFAULT)))
+		log("ERROR: " + stats.error);
 }
 
 // INTERFACE: IrcBotMonitor
@@ -26,9 +26,1899 @@ http://www.gnu.org/licenses/gpl-2.0.html
 
 '-----------------------------------------------------------------*/
 
-#include <skivvy/plugin-factoid.h>
+#include <skivvy/factoid-reply.h>
+#include <skivvy/factoid-command.h>
+#include <skivvy/factoid-shards.h>
+#include <skivvy/factoid-manager.h>
 
-int main()
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <clocale>
+#include <sstream>
+#include <stdexcept>
+#include <iostream>
+#include <algorithm>
+
+#include <unistd.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+using namespace skivvy::factoid;
+
+// Stress test: hammer one FactoidManager with mixed edits and lookups
+// from several threads. Each writer owns its own keys and keeps a model
+// of what they should hold. Readers check every result they see is
+// well formed and the final state is checked against the models, both
+// in memory and after a reload from disk.
+
+const siz keys_per_writer = 16;
+const siz ops_per_writer = 2000;
+const siz ops_per_reader = 4000;
+
+std::atomic<siz> failures{0};
+
+#define CHECK(c) do{ if(!(c)) { ++failures; \
+	std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #c << '\n'; } }while(0)
+
+struct model
+{
+	std::map<str, str_vec> facts;
+	std::map<str, str_set> groups;
+};
+
+str key_name(siz w, siz k)
+{
+	return "w" + std::to_string(w) + "-" + std::to_string(k);
+}
+
+// lines are "<key>:<seq>" with seq always increasing
+void check_lines(const str& key, const str_vec& lines)
+{
+	siz last = 0;
+	for(auto&& line: lines)
+	{
+		CHECK(!line.compare(0, key.size() + 1, key + ":"));
+		siz seq = std::stoul(line.substr(key.size() + 1));
+		CHECK(seq > last);
+		last = seq;
+	}
+}
+
+void writer(FactoidManager& fm, siz w, model& m)
+{
+	std::mt19937 rng(w);
+	siz seq = 0;
+
+	for(siz op = 0; op < ops_per_writer; ++op)
+	{
+		const str key = key_name(w, rng() % keys_per_writer);
+		const str group = "g" + std::to_string(rng() % 3);
+
+		switch(rng() % 8)
+		{
+			case 0:
+			case 1:
+			case 2:
+			{
+				const str fact = key + ":" + std::to_string(++seq);
+				fm.add_fact(key, fact, {group});
+				m.facts[key].push_back(fact);
+				m.groups[key].insert(group);
+				break;
+			}
+			case 3:
+			{
+				str_vec& lines = m.facts[key];
+				uns line = lines.empty() ? 1 : uns(1 + rng() % lines.size());
+				bool ok = fm.del_fact(key, line);
+				CHECK(ok == !lines.empty());
+				if(ok)
+					lines.erase(lines.begin() + line - 1);
+				if(lines.empty())
+					m.groups.erase(key);
+				break;
+			}
+			case 4:
+			{
+				if(fm.del_fact(key))
+				{
+					m.facts[key].clear();
+					m.groups.erase(key);
+				}
+				break;
+			}
+			case 5:
+				fm.add_to_groups(key, {group});
+				m.groups[key].insert(group);
+				break;
+			case 6:
+				fm.del_from_groups(key, {group});
+				if(m.groups.count(key))
+				{
+					m.groups[key].erase(group);
+					if(m.groups[key].empty())
+						m.groups.erase(key);
+				}
+				break;
+			default:
+				check_lines(key, fm.get_fact(key, {}));
+		}
+	}
+}
+
+void reader(FactoidManager& fm, siz writers)
+{
+	std::mt19937 rng(std::random_device{}());
+
+	for(siz op = 0; op < ops_per_reader; ++op)
+	{
+		const siz w = rng() % writers;
+		const str key = key_name(w, rng() % keys_per_writer);
+
+		switch(rng() % 5)
+		{
+			case 0:
+				check_lines(key, fm.get_fact(key, {}));
+				break;
+			case 1:
+				check_lines(key, fm.get_fact(key, {"g0", "g1"}));
+				break;
+			case 2:
+			{
+				const str prefix = "w" + std::to_string(w) + "-";
+				for(auto&& k: fm.find_fact(prefix + "*", {"g2"}, 5))
+					CHECK(!k.compare(0, prefix.size(), prefix));
+				break;
+			}
+			case 3:
+				for(auto&& g: fm.find_group("g*"))
+					CHECK(g.size() == 2);
+				break;
+			default:
+			{
+				str_vec lines = fm.get_resolved_fact("alias-a", {});
+				CHECK(lines.size() == 1 && lines[0] == "the end");
+			}
+		}
+	}
+}
+
+void verify(FactoidManager& fm, const std::vector<model>& models)
+{
+	for(auto&& m: models)
+	{
+		for(auto&& f: m.facts)
+			CHECK(fm.get_fact(f.first, {}) == f.second);
+
+		for(auto&& f: m.facts)
+		{
+			if(f.second.empty())
+				continue;
+			for(auto&& g: {"g0", "g1", "g2"})
+				CHECK(fm.get_fact(f.first, {g}).empty() == !(m.groups.count(f.first) && m.groups.at(f.first).count(g)));
+		}
+	}
+}
+
+bool stress(const str& dir, siz writers, siz readers, bool journal)
+{
+	const str store = dir + "/store.txt";
+	const str index = dir + "/index.txt";
+	const str log = dir + "/journal.txt";
+
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+	::unlink(log.c_str());
+
+	const siz failed = failures;
+
+	std::vector<model> models(writers);
+
+	{
+		FactoidManager fm(store, index);
+
+		if(journal)
+			CHECK(fm.open_journal(log, std::chrono::milliseconds(5), std::chrono::seconds(1)));
+
+		// includes a loop back to the start
+		fm.add_fact("alias-a", "= alias-b");
+		fm.add_fact("alias-b", "= alias-c");
+		fm.add_fact("alias-c", "the end");
+		fm.add_fact("alias-c", "= alias-a");
+
+		std::vector<std::thread> threads;
+
+		for(siz w = 0; w < writers; ++w)
+			threads.emplace_back(writer, std::ref(fm), w, std::ref(models[w]));
+
+		for(siz r = 0; r < readers; ++r)
+			threads.emplace_back(reader, std::ref(fm), writers);
+
+		for(auto&& t: threads)
+			t.join();
+
+		verify(fm, models);
+
+		fm.reload();
+
+		verify(fm, models);
+	}
+
+	// and from scratch
+	{
+		FactoidManager fm(store, index);
+		if(journal)
+			CHECK(fm.open_journal(log, std::chrono::milliseconds(5), std::chrono::seconds(1)));
+		verify(fm, models);
+	}
+
+	std::cout << "stress: writers: " << writers << " readers: " << readers
+		<< " journal: " << std::boolalpha << journal
+		<< (failures == failed ? " PASS" : " FAIL") << '\n';
+
+	return failures == failed;
+}
+
+// percentiles are within a bucket (1/8) of the true value
+void histogram()
+{
+	LatencyHistogram h;
+
+	CHECK(!h.count());
+	CHECK(!h.percentile(0.5));
+
+	for(siz ns = 1; ns <= 10000; ++ns)
+		h.record(std::chrono::nanoseconds(ns));
+
+	CHECK(h.count() == 10000);
+	CHECK(h.max() == 10000);
+	CHECK(h.mean() > 5000 && h.mean() < 5001);
+
+	const auto p50 = h.percentile(0.50);
+	const auto p99 = h.percentile(0.99);
+	CHECK(p50 >= 5000 && p50 <= 5000 + 5000 / 8);
+	CHECK(p99 >= 9900 && p99 <= 10000);
+	CHECK(h.percentile(1.0) == 10000);
+
+	LatencyHistogram small;
+	for(siz ns = 0; ns < 16; ++ns)
+		small.record(std::chrono::nanoseconds(ns));
+	CHECK(small.percentile(0.5) == 7); // exact below 16ns
+}
+
+void text_search()
+{
+	TextSearch ts;
+
+	ts.set("apple", {"Apples are a \x03" "04,01red\x03 fruit", "= fruit"});
+	ts.set("banana", {"Bananas are a yellow fruit"});
+	ts.set("fruit", {"fruit fruit fruit"});
+	ts.set("car", {"A red car"});
+
+	str_vec words;
+	TextSearch::get_words("Apples, \x03" "04,01RED\x03 x2", words);
+	CHECK((words == str_vec{"apples", "red", "x2"}));
+
+	auto hits = ts.search("fruit");
+	CHECK(hits.size() == 3);
+	CHECK(!hits.empty() && hits[0].key == "fruit");
+
+	// both words beat one
+	hits = ts.search("red fruit");
+	CHECK(hits.size() == 4);
+	CHECK(!hits.empty() && hits[0].key == "apple");
+
+	hits = ts.search("red fruit", 1);
+	CHECK(hits.size() == 1 && hits[0].key == "apple");
+
+	hits = ts.search("red", 0, [](const str& key){ return key != "apple"; });
+	CHECK(hits.size() == 1 && hits[0].key == "car");
+
+	ts.set("car", {"A blue car"});
+	CHECK(ts.search("red").size() == 1);
+	ts.erase("apple");
+	CHECK(ts.search("red").empty());
+	CHECK(ts.search("apples").empty());
+	CHECK(ts.size() == 3);
+
+	// lots of replacing packs the document numbers
+	for(siz i = 0; i < 5000; ++i)
+		ts.set("banana", {"Bananas are a yellow fruit " + std::to_string(i)});
+	CHECK(ts.search("yellow").size() == 1);
+	CHECK(ts.search("4999").size() == 1);
+	CHECK(ts.search("4998").empty());
+	CHECK(ts.search("fruit", 2).size() == 2);
+}
+
+void key_suggest()
+{
+	CHECK(KeySuggest::distance("kitten", "sitting") == 3);
+	CHECK(KeySuggest::distance("", "abc") == 3);
+	CHECK(KeySuggest::distance("kitten", "sitting", 1) > 1);
+
+	KeySuggest ks;
+
+	for(auto&& k: {"apple", "apply", "ample", "maple", "banana", "bandana", "cabana", "orange", "kitten"})
+		ks.insert(k);
+
+	CHECK(ks.suggest("appel", 2, 3) == (str_vec{"apple", "apply"}));
+	CHECK(ks.suggest("aple", 1, 3) == (str_vec{"ample", "apple", "maple"}));
+	CHECK(ks.suggest("aple", 1, 2) == (str_vec{"ample", "apple"}));
+	CHECK(ks.suggest("banan", 1, 3) == str_vec{"banana"});
+	CHECK(ks.suggest("xxbanana", 2, 3) == str_vec{"banana"});
+	CHECK(ks.suggest("sitting", 2, 3).empty());
+	CHECK(ks.suggest("aple", 1, 3, [](const str& k){ return k != "apple"; }) == (str_vec{"ample", "maple"}));
+	CHECK(ks.suggest("orange", 0, 3) == str_vec{"orange"});
+
+	ks.erase("apple");
+	CHECK(ks.suggest("appel", 2, 1) == str_vec{"apply"});
+	CHECK(ks.size() == 8);
+
+	// enough edits to merge recent entries and rebuild
+	for(siz i = 0; i < 3000; ++i)
+		ks.insert("key" + std::to_string(i));
+	for(siz i = 0; i < 3000; ++i)
+		if(i != 1234)
+			ks.erase("key" + std::to_string(i));
+	CHECK(ks.suggest("key1243", 2, 3) == str_vec{"key1234"});
+	CHECK(ks.size() == 9);
+}
+
+void wild_pattern()
+{
+	const str_vec wilds =
+	{
+		"", "a", "abc", "a*", "*c", "a*c", "*b*", "**", "a**c", "?", "??", "a?c", "*?", "?*?"
+		, "[abc]", "[a-c]*", "[!a-c]*", "[^a-c]*", "[]]*", "[!]]*", "[]a]*", "[a-]*", "[-a]*"
+		, "[[:digit:]]*", "[![:alpha:]]*", "[[:upper:][:digit:]]*", "[[.-.]]*", "[[=a=]]*"
+		, "[a-c", "[", "]", "\\*", "\\?c", "a\\", "[\\]]*", "[a\\-c]*", "\\[a]"
+		, "*(ab)", "+(ab)c", "?(a)bc", "@(abc|xyz)", "!(abc)", "a*(b|x)c", "*+(b)*"
+		, "?\xc3\xa9", "caf?", "caf[\xc3]*", "*[\xa9]", "*\xc3\xa9", "[!a]*\xa9", "\xc3*"
+	};
+
+	const str_vec subjects =
+	{
+		"", "a", "b", "c", "ab", "abc", "abbc", "axc", "ac", "abcd", "xyz", "]", "]a", "-", "-a"
+		, "1", "1a", "A1", "*", "*c", "?c", "[a]", "a\\", "\\", "ababab", "ababc", "bc"
+		, "caf\xc3\xa9", "\xc3\xa9", "x\xc3\xa9", "caf\xc3"
+	};
+
+	auto check_all = [&](const char* locale)
+	{
+		for(auto&& wild: wilds)
+		{
+			WildPattern wp(wild);
+			for(auto&& subject: subjects)
+			{
+				const bool want = !fnmatch(wild.c_str(), subject.c_str(), FNM_EXTMATCH);
+				if(wp.match(subject) != want)
+				{
+					++failures;
+					std::cerr << __FILE__ << ":" << __LINE__ << ": WildPattern(\"" << wild
+						<< "\").match(\"" << subject << "\") != " << want << " in " << locale << '\n';
+				}
+			}
+		}
+	};
+
+	check_all("C");
+
+	// multibyte characters are one character to '?' and '[..]' here
+	if(std::setlocale(LC_CTYPE, "C.UTF-8"))
+	{
+		check_all("C.UTF-8");
+		std::setlocale(LC_CTYPE, "C");
+	}
+}
+
+/**
+ * The keys fnmatch() says match wild, the first max (0 = all) in key order.
+ */
+static str_set fn_find(const str_set& keys, const str& wild, siz max = 0)
+{
+	str_set found;
+	for(auto&& key: keys)
+	{
+		if(max && found.size() == max)
+			break;
+		if(!fnmatch(wild.c_str(), key.c_str(), FNM_EXTMATCH))
+			found.insert(key);
+	}
+	return found;
+}
+
+void key_search()
+{
+	str_set all = {"a", "ab", "abc", "apple", "apple pie", "applesauce", "apricot", "banana"
+		, "bandana", "cabana", "grape", "grapefruit", "pineapple", "x*y", "naïve", "café"};
+	for(siz i = 0; i < 600; ++i)
+		all.insert("key" + std::to_string(i));
+
+	KeySearch ks;
+	for(auto&& key: all)
+		ks.insert(key);
+
+	const str_vec wilds =
+	{
+		"app*", "key1*", "gr*fruit", "apple*e", // a long prefix walks its range
+		"ap*", "a*", // too short a prefix and no trigrams
+		"*ana*", "*apple*", "*ey59?", "b*ana", "*+(an)a", // trigrams
+		"*", "?", "??", "*?", "[ab]*", "*[!a-z]*", "*e", "?an*", // nothing to narrow with
+		"x\\*y", "*ï*", "caf?", "nope*", "*nope*",
+	};
+
+	for(auto&& wild: wilds)
+	{
+		CHECK(ks.find(wild) == fn_find(all, wild));
+		for(siz max: {1, 3, 50})
+			CHECK(ks.find(wild, max) == fn_find(all, wild, max));
+	}
+
+	auto not_apple = [](const str& key){ return key != "apple"; };
+	CHECK(ks.find("*apple*", 0, not_apple) == (str_set{"apple pie", "applesauce", "pineapple"}));
+	CHECK(ks.find("app*", 1, not_apple) == str_set{"apple pie"});
+
+	ks.erase("apple pie");
+	all.erase("apple pie");
+	CHECK(ks.find("*apple*") == (str_set{"apple", "applesauce", "pineapple"}));
+
+	// a walk told to stop gives up with part of the keys
+	for(auto&& wild: {"*", "*key*", "key*"})
+	{
+		StopToken late(StopToken::clock::now());
+		siz visited = 0;
+		const siz found = ks.visit(wild, [&](const str&){ ++visited; }, 0, {}, &late);
+		CHECK(late.stopped());
+		CHECK(found == visited && found < 600);
+
+		StopToken never;
+		CHECK(ks.visit(wild, [](const str&){}, 0, {}, &never) == fn_find(all, wild).size());
+		CHECK(!never.stopped());
+	}
+}
+
+void group_index()
+{
+	GroupIndex gi;
+
+	gi.set("a", {"g1", "g2"});
+	gi.set("b", {"g2"});
+	gi.set("c", {"g3"});
+
+	CHECK(gi.group_count() == 3);
+	CHECK(gi.key_count() == 3);
+	CHECK(gi.get("a") == (str_set{"g1", "g2"}));
+
+	auto in = gi.get_filter({"g2", "nope"});
+	CHECK(gi.in_groups("a", in));
+	CHECK(gi.in_groups("b", in));
+	CHECK(!gi.in_groups("c", in));
+	CHECK(!gi.in_groups("d", in));
+	CHECK(gi.get_filter({"nope"}).empty());
+
+	// g1 goes and its id is reused
+	gi.set("a", {"g2"});
+	CHECK(gi.group_count() == 2);
+	gi.set("a", {"g4"});
+	CHECK(gi.get("a") == str_set{"g4"});
+	CHECK(!gi.in_groups("a", gi.get_filter({"g1", "g2"})));
+	CHECK(gi.in_groups("a", gi.get_filter({"g4"})));
+
+	gi.set("b", {});
+	CHECK(gi.key_count() == 2);
+	CHECK(gi.get("b").empty());
+
+	// ids past the first word of the bitset
+	for(siz i = 0; i < 200; ++i)
+		gi.set("k" + std::to_string(i), {"grp" + std::to_string(i), "all"});
+	CHECK(gi.in_groups("k150", gi.get_filter({"grp150"})));
+	CHECK(!gi.in_groups("k150", gi.get_filter({"grp149"})));
+	CHECK(gi.in_groups("k3", gi.get_filter({"all"})));
+
+	str_vec keys;
+	for(auto&& k: gi)
+		keys.push_back(k.first);
+	CHECK(std::is_sorted(keys.begin(), keys.end()));
+	CHECK(keys.size() == gi.key_count());
+}
+
+void snapshot_arena()
+{
+	const std::map<str, std::pair<str_vec, str_set>> db =
+	{
+		{"a", {{"one", "two"}, {"g1"}}},
+		{"b", {{}, {"g1", "g2"}}},
+		{"c", {{"three"}, {}}},
+	};
+
+	auto d = db.begin();
+	auto next = [&](str& key, str_vec& facts, str_set& groups)
+	{
+		if(d == db.end())
+			return false;
+		key = d->first;
+		facts = d->second.first;
+		groups = (d++)->second.second;
+		return true;
+	};
+
+	FactoidSnapshot snap;
+	CHECK(snap.build({{1, 2, 3, 4}}, next));
+	CHECK(snap.size() == 3);
+	CHECK(snap.stamp() == (FactoidSnapshot::stamp_type{{1, 2, 3, 4}}));
+	CHECK(snap.find("b") == 1);
+	CHECK(snap.find("d") == FactoidSnapshot::npos);
+	CHECK(snap.get_facts(snap.find("a")) == (str_vec{"one", "two"}));
+	CHECK(snap.fact_count(snap.find("b")) == 0);
+	CHECK(snap.get_groups(snap.find("b")) == (str_set{"g1", "g2"}));
+	CHECK(snap.get_groups(snap.find("c")).empty());
+	CHECK(!snap.is_compressed());
+
+	// the same again with the facts compressed
+	d = db.begin();
+	FactoidSnapshot packed;
+	CHECK(packed.build({{1, 2, 3, 4}}, next, true));
+	CHECK(packed.is_compressed());
+	CHECK(packed.get_facts(packed.find("a")) == (str_vec{"one", "two"}));
+	CHECK(packed.get_facts(packed.find("b")).empty());
+	CHECK(packed.get_groups(packed.find("b")) == (str_set{"g1", "g2"}));
+
+	HitCounter hits;
+	packed.set_cache(1, &hits);
+
+	std::vector<str_view> views;
+	auto block = packed.get_facts(packed.find("c"), views);
+	CHECK(block && views.size() == 1 && views[0] == "three");
+	views.clear();
+	packed.get_facts(packed.find("c"), views);
+	packed.get_facts(packed.find("a"), views); // pushes c out
+	packed.get_facts(packed.find("c"), views);
+	CHECK(hits.get_hits() == 1 && hits.get_misses() == 3);
+	CHECK(views.size() == 4 && views[3] == "three");
+}
+
+void snapshot_file(const str& dir)
 {
+	const str file = dir + "/snapshot.bin";
+	const str store = dir + "/snapshot-store.txt";
+	const str index = dir + "/snapshot-index.txt";
+
+	for(auto&& f: {file, store, index})
+		::unlink(f.c_str());
+
+	const std::map<str, std::pair<str_vec, str_set>> db =
+	{
+		{"a", {{"one", "two"}, {"g1"}}},
+		{"b", {{}, {"g1", "g2"}}},
+		{"c", {{"three"}, {}}},
+	};
+
+	auto d = db.begin();
+	auto next = [&](str& key, str_vec& facts, str_set& groups)
+	{
+		if(d == db.end())
+			return false;
+		key = d->first;
+		facts = d->second.first;
+		groups = (d++)->second.second;
+		return true;
+	};
+
+	str error;
+	CHECK(FactoidSnapshot::write(file, {{1, 2, 3, 4}}, next, error));
+
+	{
+		FactoidSnapshot snap;
+		CHECK(snap.open(file));
+		CHECK(!snap.is_compressed());
+		CHECK(snap.size() == 3);
+		CHECK(snap.stamp() == (FactoidSnapshot::stamp_type{{1, 2, 3, 4}}));
+		CHECK(snap.find("d") == FactoidSnapshot::npos);
+		CHECK(snap.get_facts(snap.find("a")) == (str_vec{"one", "two"}));
+		CHECK(snap.get_facts(snap.find("c")) == str_vec{"three"});
+		CHECK(snap.get_groups(snap.find("b")) == (str_set{"g1", "g2"}));
+	}
+
+	struct stat st;
+	CHECK(!::stat(file.c_str(), &st));
+	const auto size = st.st_size;
+
+	// cut short, first in the tables then in the header
+	CHECK(!::truncate(file.c_str(), size - 1));
+	{
+		FactoidSnapshot snap;
+		CHECK(!snap.open(file) && snap.error == "corrupt snapshot: " + file);
+	}
+
+	CHECK(!::truncate(file.c_str(), sizeof(FactoidSnapshot::header) - 1));
+	{
+		FactoidSnapshot snap;
+		CHECK(!snap.open(file) && snap.error == "bad snapshot: " + file);
+	}
+
+	// from another version
+	d = db.begin();
+	CHECK(FactoidSnapshot::write(file, {{1, 2, 3, 4}}, next, error));
+	{
+		std::fstream fs(file, std::ios::in | std::ios::out | std::ios::binary);
+		const std::uint32_t version = FactoidSnapshot::version + 1;
+		fs.seekp(offsetof(FactoidSnapshot::header, version));
+		fs.write((const char*)&version, sizeof(version));
+	}
+	{
+		FactoidSnapshot snap;
+		CHECK(!snap.open(file) && snap.error.find("wrong snapshot version") == 0);
+	}
+
+	// the manager only trusts a snapshot while the store is unchanged
+	::unlink(file.c_str());
+
+	auto inode = [&]
+	{
+		struct stat st;
+		return ::stat(file.c_str(), &st) ? ino_t(0) : st.st_ino;
+	};
+
+	{
+		FactoidManager fm(store, index, file);
+		fm.add_fact("a", "one", {"g"});
+		fm.add_fact("b", "two");
+		CHECK(fm.save_snapshot());
+	}
+
+	const auto saved = inode();
+	CHECK(saved);
+
+	{
+		FactoidManager fm(store, index, file);
+		CHECK(inode() == saved); // used as it is
+		CHECK(fm.get_fact("a", {"g"}) == str_vec{"one"});
+		CHECK(fm.get_fact("b", {}) == str_vec{"two"});
+	}
+
+	{
+		FactoidManager other(store, index);
+		other.add_fact("b", "three");
+	}
+
+	{
+		FactoidSnapshot snap;
+		CHECK(snap.open(file));
+		CHECK(snap.stamp() != FactoidSnapshot::get_stamp(store, index));
+	}
+
+	{
+		FactoidManager fm(store, index, file);
+		CHECK(inode() != saved); // rebuilt from the store
+		CHECK(fm.get_fact("b", {}) == (str_vec{"two", "three"}));
+
+		FactoidSnapshot snap;
+		CHECK(snap.open(file));
+		CHECK(snap.stamp() == FactoidSnapshot::get_stamp(store, index));
+	}
+
+	for(auto&& f: {file, store, index})
+		::unlink(f.c_str());
+}
+
+void fact_codec()
+{
+	str_vec texts;
+	std::mt19937 rng(7);
+	const str_vec words = {"see also ", "https://example.org/wiki/", "the ", "bot ", "!fact "};
+	for(siz i = 0; i < 2000; ++i)
+	{
+		str t;
+		for(siz w = rng() % 12; w; --w)
+			t += rng() % 4 ? words[rng() % words.size()] : str(1, char('a' + rng() % 26));
+		texts.push_back(t);
+	}
+	texts.push_back("");
+	texts.push_back(str(300, 'x'));
+
+	const std::vector<str_view> samples(texts.begin(), texts.end());
+	const FactCodec codec(FactCodec::train(samples));
+	CHECK(!codec.dictionary().empty());
+	CHECK(codec.dictionary().size() <= FactCodec::max_dict);
+
+	siz raw = 0;
+	siz packed = 0;
+	bool same = true;
+
+	for(auto&& t: texts)
+	{
+		str data;
+		codec.compress(t, data);
+		str back = "prefix";
+		same = same && codec.decompress(data, back) && back == "prefix" + t;
+		raw += t.size();
+		packed += data.size();
+	}
+
+	CHECK(same);
+	CHECK(packed * 2 < raw);
+
+	// without a dictionary too
+	const FactCodec plain;
+	str data;
+	plain.compress(texts.back(), data);
+	str back;
+	CHECK(plain.decompress(data, back) && back == texts.back());
+	CHECK(data.size() < 20);
+
+	// corrupt data is refused and leaves out as it was
+	data[data.size() / 2] = '\xff';
+	data.pop_back();
+	back = "x";
+	CHECK(!plain.decompress(data, back) && back == "x");
+}
+
+void command_parser()
+{
+	auto views = [](const view_list& l)
+	{
+		str_vec v;
+		for(auto&& s: l)
+			v.push_back(s.to_string());
+		return v;
+	};
+
+	fact_command cmd;
+	CHECK(parse_command(" [ g1 ,, g2] key  some  fact ", command_syntax::key_text, cmd));
+	CHECK(views(cmd.groups) == (str_vec{"g1", "g2"}));
+	CHECK(cmd.keys[0] == "key");
+	CHECK(cmd.text == "some  fact");
+
+	cmd = {};
+	CHECK(!parse_command("key", command_syntax::key_text, cmd));
+	cmd = {};
+	CHECK(!parse_command("[g1 key fact", command_syntax::key_text, cmd));
+
+	cmd = {};
+	CHECK(parse_command("key a, b ,c", command_syntax::key_groups, cmd));
+	CHECK(cmd.keys[0] == "key");
+	CHECK(views(cmd.groups) == (str_vec{"a", "b", "c"}));
+	cmd = {};
+	CHECK(!parse_command("key", command_syntax::key_groups, cmd));
+
+	cmd = {};
+	CHECK(parse_command("[g] key #3", command_syntax::key_line, cmd));
+	CHECK(cmd.keys[0] == "key" && cmd.line == 3);
+	cmd = {};
+	CHECK(parse_command("key", command_syntax::key_line, cmd));
+	CHECK(cmd.line == fact_command::noline);
+	for(auto&& bad: {"key 3", "key #0", "key #x", "key #", "key #99999999999"})
+	{
+		cmd = {};
+		CHECK(!parse_command(bad, command_syntax::key_line, cmd));
+		CHECK(!cmd.text.empty());
+	}
+
+	cmd = {};
+	CHECK(parse_command("[g] *wild card* ", command_syntax::text, cmd));
+	CHECK(cmd.text == "*wild card*" && cmd.groups.size() == 1);
+	cmd = {};
+	CHECK(parse_command("[g*]", command_syntax::bare_text, cmd));
+	CHECK(cmd.text == "[g*]");
+	cmd = {};
+	CHECK(!parse_command("  ", command_syntax::text, cmd));
+
+	cmd = {};
+	CHECK(parse_command("nick [a,b] k1 k2\tk3", command_syntax::nick_keys, cmd));
+	CHECK(cmd.nick == "nick");
+	CHECK(views(cmd.keys) == (str_vec{"k1", "k2", "k3"}));
+	cmd = {};
+	CHECK(!parse_command("nick", command_syntax::nick_keys, cmd));
+
+	// past the room kept in place
+	str list = "[";
+	str_vec many;
+	for(siz i = 0; i < 20; ++i)
+	{
+		many.push_back("g" + std::to_string(i));
+		list += many.back() + ",";
+	}
+	list += "] key"; // the views point into it
+	cmd = {};
+	CHECK(parse_command(list, command_syntax::keys, cmd));
+	CHECK(views(cmd.groups) == many);
+	CHECK(to_set(cmd.groups).size() == 20);
+}
+
+void shared_map()
+{
+	SharedMap<int> map;
+	for(int i = 0; i < 200; ++i)
+		map.set("k" + std::to_string(i), i);
+	CHECK(map.size() == 200);
+
+	// a copy keeps what the map had when it was made
+	const SharedMap<int> copy = map;
+	map.set("k1", -1);
+	map.set("new", 7);
+	map.erase("k2");
+	map.erase("nokey");
+	CHECK(map.size() == 200);
+	CHECK(*map.find("k1") == -1 && *map.find("new") == 7 && !map.find("k2"));
+	CHECK(copy.size() == 200);
+	CHECK(*copy.find("k1") == 1 && !copy.find("new") && *copy.find("k2") == 2);
+
+	const auto sorted = copy.sorted();
+	CHECK(sorted.size() == 200);
+	CHECK(std::is_sorted(sorted.begin(), sorted.end(), [](const SharedMap<int>::value_type* a
+		, const SharedMap<int>::value_type* b){ return a->first < b->first; }));
+	CHECK(sorted.front()->first == "k0" && sorted.back()->first == "k99");
+
+	map.clear();
+	CHECK(!map.size() && map.sorted().empty() && copy.size() == 200);
+}
+
+void reply_builder()
+{
+	auto messages = [](const ReplyBuilder& r)
+	{
+		str_vec msgs;
+		r.send([&](const str& m){ msgs.push_back(m); });
+		return msgs;
+	};
+
+	// short lines share a message up to max
+	ReplyBuilder packed("> ", 40);
+	packed.add("one");
+	packed.add("two");
+	packed.add("three");
+	CHECK(messages(packed) == str_vec{"> one | two | three"});
+
+	const str ten(10, 'x');
+	ReplyBuilder full("> ", 40);
+	for(siz i = 0; i < 4; ++i)
+		full.add(ten);
+	CHECK(messages(full) == (str_vec{"> " + ten + " | " + ten + " | " + ten, "> " + ten}));
+	CHECK(full.get(0).size() == 38);
+
+	full.end();
+	full.add("y");
+	CHECK(full.size() == 3 && full.get(2) == "> y");
+
+	ReplyBuilder unpacked("> ", 40, false);
+	unpacked.add("one");
+	unpacked.add("two");
+	CHECK(messages(unpacked) == (str_vec{"> one", "> two"}));
+
+	// long lines split between words, losing the space
+	ReplyBuilder words("> ", 40);
+	words.add("aaaa bbbb cccc dddd eeee ffff gggg hhhh iiii jjjj");
+	CHECK(messages(words) == (str_vec{"> aaaa bbbb cccc dddd eeee ffff gggg", "> hhhh iiii jjjj"}));
+
+	ReplyBuilder spaces("> ", 40);
+	spaces.add(str(36, 'a') + "   b");
+	CHECK(messages(spaces) == (str_vec{"> " + str(36, 'a'), "> b"}));
+
+	// with no space to split at no UTF-8 sequence is cut
+	str wide = "x";
+	for(siz i = 0; i < 40; ++i)
+		wide += "\xc3\xa9"; // e acute
+	ReplyBuilder utf8("> ", 40);
+	utf8.add(wide);
+	str joined;
+	for(auto&& m: messages(utf8))
+	{
+		CHECK(m.size() <= 40 && !m.compare(0, 2, "> "));
+		CHECK(m.size() > 2 && (m[2] & 0xC0) != 0x80);
+		CHECK((m.back() & 0xC0) != 0xC0);
+		joined += m.substr(2);
+	}
+	CHECK(utf8.size() == 3 && joined == wide);
+
+	// send() passes on just the messages asked for
+	ReplyBuilder five("> ", 40, false);
+	for(auto&& line: {"0", "1", "2", "3", "4"})
+		five.add(line);
+
+	str_vec sent;
+	auto send = [&](const str& m){ sent.push_back(m); };
+	CHECK(five.send(send, 1, 3) == 2 && sent == (str_vec{"> 1", "> 2"}));
+	sent.clear();
+	CHECK(five.send(send, 3) == 2 && sent == (str_vec{"> 3", "> 4"}));
+	sent.clear();
+	CHECK(five.send(send, 4, 100) == 1 && sent == str_vec{"> 4"});
+	sent.clear();
+	CHECK(five.send(send, 5) == 0 && five.send(send, 3, 1) == 0 && sent.empty());
+}
+
+void reply_cache(const str& dir)
+{
+	const str store = dir + "/reply-store.txt";
+	const str index = dir + "/reply-index.txt";
+
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+
+	FactoidManager fm(store, index);
+	ReplyCache cache(2);
+
+	auto reply = [](const str& line)
+	{
+		auto r = std::make_shared<ReplyBuilder>("> ", 100);
+		r->add(line);
+		return ReplyCache::reply(r);
+	};
+
+	auto g = fm.get_generation();
+	cache.put("a", g, reply("one"));
+	cache.put("b", g, reply("two"));
+	CHECK(cache.get("a", g));
+	cache.put("c", g, reply("three")); // b is least recently used
+	CHECK(!cache.get("b", g));
+	CHECK(cache.get("a", g) && cache.get("a", g)->get(0) == "> one");
+	CHECK(cache.size() == 2);
+
+	// any edit makes every reply stale
+	fm.add_fact("x", "four");
+	CHECK(fm.get_generation() > g);
+	CHECK(!cache.get("a", fm.get_generation()));
+	CHECK(cache.size() == 0);
+
+	// replies built before the edit are not kept
+	cache.put("a", g, reply("one"));
+	CHECK(cache.size() == 0);
+
+	g = fm.get_generation();
+	fm.add_to_groups("x", {"g"});
+	CHECK(fm.get_generation() > g);
+	g = fm.get_generation();
+	fm.get_fact("x", {});
+	CHECK(fm.get_generation() == g);
+
+	cache.set_capacity(0);
+	cache.put("a", g, reply("one"));
+	CHECK(!cache.get("a", g));
+
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+}
+
+void command_pool(const str& dir)
+{
+	using namespace std::chrono;
+
+	CommandPool pool;
+	pool.start(1, 2);
+
+	// hold the only worker until told to go
+	std::atomic<bool> go{false};
+	std::atomic<siz> ran{0};
+	auto wait = [&](const StopToken&)
+	{
+		++ran;
+		while(!go)
+			std::this_thread::sleep_for(milliseconds(1));
+	};
+
+	CHECK(pool.submit(wait, seconds(10)));
+	while(!ran)
+		std::this_thread::sleep_for(milliseconds(1));
+
+	// one running and two waiting is all it takes
+	CHECK(pool.submit(wait, seconds(10)));
+	CHECK(pool.submit(wait, seconds(10)));
+	CHECK(!pool.submit(wait, seconds(10)));
+	CHECK(pool.size() == 3);
+
+	go = true;
+	for(siz i = 0; i < 500 && pool.size(); ++i)
+		std::this_thread::sleep_for(milliseconds(2));
+	CHECK(!pool.size());
+	CHECK(ran == 3);
+
+	// a job past its deadline is told to stop
+	std::atomic<bool> stopped{false};
+	CHECK(pool.submit([&](const StopToken& stop)
+	{
+		while(!stop.should_stop())
+			std::this_thread::sleep_for(milliseconds(1));
+		stopped = stop.stopped();
+	}, milliseconds(20)));
+	for(siz i = 0; i < 500 && !stopped; ++i)
+		std::this_thread::sleep_for(milliseconds(2));
+	CHECK(stopped);
+
+	// a job that throws leaves the worker to carry on
+	CHECK(pool.submit([](const StopToken&){ throw std::runtime_error("bad job"); }, seconds(1)));
+	std::atomic<bool> after{false};
+	CHECK(pool.submit([&](const StopToken&){ after = true; }, seconds(1)));
+	for(siz i = 0; i < 500 && !after; ++i)
+		std::this_thread::sleep_for(milliseconds(2));
+	CHECK(after);
+	for(siz i = 0; i < 500 && pool.size(); ++i)
+		std::this_thread::sleep_for(milliseconds(2));
+	CHECK(!pool.size());
+
+	// and so is one still running when the pool
+	// stops, even with no time limit
+	std::atomic<bool> started{false};
+	std::atomic<bool> early{false};
+	CHECK(pool.submit([&](const StopToken& stop)
+	{
+		early = stop.should_stop();
+		started = true;
+		while(!stop.should_stop())
+			std::this_thread::sleep_for(milliseconds(1));
+	}));
+	while(!started)
+		std::this_thread::sleep_for(milliseconds(1));
+	std::this_thread::sleep_for(milliseconds(20));
+	pool.stop();
+	CHECK(!early);
+	CHECK(!pool.size());
+
+	// with no threads jobs run straight away
+	pool.start(0, 0);
+	siz inline_runs = 0;
+	CHECK(pool.submit([&](const StopToken&){ ++inline_runs; }, seconds(1)));
+	CHECK(inline_runs == 1);
+
+	// a search given no time stops with part of the keys
+	const str store = dir + "/pool-store.txt";
+	const str index = dir + "/pool-index.txt";
+
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+
+	FactoidManager fm(store, index);
+
+	const siz n = 2000;
+	for(siz i = 0; i < n; ++i)
+		fm.add_fact("key" + std::to_string(i), "fact");
+
+	StopToken late(StopToken::clock::now());
+	siz found = fm.visit_facts("*", [](const str&){}, {}, 0, &late);
+	CHECK(late.stopped());
+	CHECK(found < n);
+
+	StopToken never;
+	CHECK(fm.visit_facts("*", [](const str&){}, {}, 0, &never) == n);
+	CHECK(!never.stopped());
+
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+}
+
+void batch_lookup(const str& dir)
+{
+	const str store = dir + "/batch-store.txt";
+	const str index = dir + "/batch-index.txt";
+
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+
+	FactoidManager fm(store, index);
+
+	fm.add_fact("b", "bee");
+	fm.add_fact("a", "one", {"g"});
+	fm.add_fact("a", "= b");
+	fm.add_fact("c", "sea", {"g"});
+
+	auto got = fm.get_facts({"c", "missing", "a", "c"}, {});
+	CHECK(got.size() == 4);
+	CHECK(got[0].to_vec() == str_vec{"sea"});
+	CHECK(got[1].empty());
+	CHECK(got[2].to_vec() == (str_vec{"one", "bee"}));
+	CHECK(got[3].to_vec() == str_vec{"sea"});
+
+	// b is not in g so the alias gives nothing
+	got = fm.get_facts({"a", "b"}, {"g"});
+	CHECK(got[0].to_vec() == str_vec{"one"});
+	CHECK(got[1].empty());
+
+	got = fm.get_facts({"a"}, {}, false);
+	CHECK(got[0].to_vec() == (str_vec{"one", "= b"}));
+
+	CHECK(fm.get_facts({}, {}).empty());
+
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+}
+
+void alias_chain(const str& dir)
+{
+	const str store = dir + "/chain-store.txt";
+	const str index = dir + "/chain-index.txt";
+
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+
+	FactoidManager fm(store, index);
+	HitCounter& alias_cache = fm.get_stats().cache("fm.alias_cache");
+
+	fm.add_fact("a", "= b");
+	fm.add_fact("b", "= c");
+	fm.add_fact("c", "old");
+
+	CHECK(fm.get_resolved_fact("a", {}) == str_vec{"old"});
+	const auto hits = alias_cache.get_hits();
+	CHECK(fm.get_resolved_fact("a", {}) == str_vec{"old"});
+	CHECK(alias_cache.get_hits() == hits + 1);
+
+	// an edit at the end of the chain drops the cached a
+	fm.add_fact("c", "new");
+	CHECK(fm.get_resolved_fact("a", {}) == (str_vec{"old", "new"}));
+
+	CHECK(fm.del_fact("c", 1));
+	CHECK(fm.get_resolved_fact("a", {}) == str_vec{"new"});
+
+	// and so does one in the middle
+	CHECK(fm.del_fact("b"));
+	CHECK(fm.get_resolved_fact("a", {}).empty());
+
+	fm.add_fact("b", "= c");
+	CHECK(fm.get_resolved_fact("a", {}) == str_vec{"new"});
+
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+}
+
+void shards(const str& dir)
+{
+	const str store = dir + "/shard-store.txt";
+	const str index = dir + "/shard-index.txt";
+	const siz count = 4;
+
+	auto unlink = [&]
+	{
+		for(siz i = 0; i < count; ++i)
+		{
+			::unlink((store + "." + std::to_string(i)).c_str());
+			::unlink((index + "." + std::to_string(i)).c_str());
+		}
+	};
+
+	unlink();
+
+	{
+		FactoidShards fs(store, index, "", count);
+		CHECK(fs.size() == count);
+
+		str_set used;
+		for(siz i = 0; i < 40; ++i)
+		{
+			const str key = "key" + std::to_string(i);
+			fs.add_fact(key, "fact " + key, {i % 2 ? "odd" : "even"});
+			used.insert(std::to_string(fs.get_shard(key)));
+		}
+		CHECK(used.size() > 1);
+
+		// the stats are of every shard
+		FactoidStats& stats = fs.get_stats();
+		CHECK(stats.latency("fm.add_fact").count() == 40);
+		CHECK(stats.get_size("fm.keys") == 40);
+		siz keys = 0;
+		for(siz i = 0; i < count; ++i)
+			keys += stats.get_size("shard." + std::to_string(i) + ".fm.keys");
+		CHECK(keys == 40);
+
+		CHECK(fs.find_fact("key*").size() == 40);
+		CHECK(fs.find_fact("key*", {"odd"}).size() == 20);
+		CHECK(fs.find_fact("key*", {}, 5) == (str_set{"key0", "key1", "key10", "key11", "key12"}));
+		CHECK(fs.find_group("*") == (str_set{"even", "odd"}));
+		CHECK(fs.get_fact("key7", {}) == str_vec{"fact key7"});
+		CHECK(fs.get_fact("key7", {"even"}).empty());
+
+		// aliases reach keys in other shards
+		str other = "alias";
+		for(siz i = 0; fs.get_shard(other) == fs.get_shard("key3"); ++i)
+			other = "alias" + std::to_string(i);
+		fs.add_fact(other, "first");
+		fs.add_fact(other, "= key3");
+		CHECK(fs.get_resolved_fact(other, {}) == (str_vec{"first", "fact key3"}));
+		CHECK(fs.get_resolved_fact(other, {"even"}).empty());
+
+		auto got = fs.get_facts({other, "key9", "nokey", "key2"}, {});
+		CHECK(got[0].to_vec() == (str_vec{"first", "fact key3"}));
+		CHECK(got[1].to_vec() == str_vec{"fact key9"});
+		CHECK(got[2].empty());
+		CHECK(got[3].to_vec() == str_vec{"fact key2"});
+
+		// a chain across shards is cached until any key in it changes
+		str middle = "middle";
+		for(siz i = 0; fs.get_shard(middle) == fs.get_shard(other); ++i)
+			middle = "middle" + std::to_string(i);
+		fs.add_fact(other, "= " + middle);
+		fs.add_fact(middle, "= key4");
+		const str_vec chain = {"first", "fact key3", "fact key4"};
+		HitCounter& alias_cache = stats.cache("fm.alias_cache");
+		CHECK(fs.get_resolved_fact(other, {}) == chain);
+		const auto hit = alias_cache.get_hits();
+		CHECK(fs.get_resolved_fact(other, {}) == chain);
+		CHECK(fs.get_facts({other}, {})[0].to_vec() == chain);
+		CHECK(alias_cache.get_hits() == hit + 2);
+		CHECK(stats.get_size("fm.alias_cache_entries") == 1);
+
+		fs.add_fact("key4", "more key4");
+		CHECK(fs.get_resolved_fact(other, {}) == (str_vec{"first", "fact key3", "fact key4", "more key4"}));
+		fs.del_fact(middle);
+		CHECK(fs.get_resolved_fact(other, {}) == (str_vec{"first", "fact key3"}));
+		CHECK(fs.reload(fs.get_shard("key3")));
+		CHECK(fs.get_resolved_fact(other, {}) == (str_vec{"first", "fact key3"}));
+		CHECK(fs.get_resolved_fact(other, {"odd"}).empty());
+		fs.add_to_groups(other, {"odd"});
+		CHECK(fs.get_resolved_fact(other, {"odd"}) == (str_vec{"first", "fact key3"}));
+		CHECK(fs.get_resolved_fact(other, {"even"}).empty());
+
+		auto hits = fs.search_fact("key12", {}, 3);
+		CHECK(!hits.empty() && hits[0].key == "key12");
+
+		const str_vec near = fs.suggest_fact("kex12", {}, 2);
+		CHECK(!near.empty() && near[0] == "key12");
+
+		CHECK(fs.del_fact("key5"));
+		CHECK(!fs.del_fact("key6", 2));
+		CHECK(!fs.error.empty());
+
+		fs.sync();
+	}
+
+	{
+		// each shard has its own files
+		FactoidShards fs(store, index, "", count);
+		CHECK(fs.check_files());
+		CHECK(fs.find_fact("key*").size() == 39);
+		CHECK(fs.reload(fs.get_shard("key3")));
+		CHECK(fs.get_fact("key3", {"odd"}) == str_vec{"fact key3"});
+	}
+
+	// the facts are in files for a different number of shards
+	{
+		FactoidShards fewer(store, index, "", count - 1);
+		CHECK(!fewer.check_files());
+		CHECK(fewer.error.find(store + "." + std::to_string(count - 1)) != str::npos);
+	}
+
+	{
+		FactoidShards one(store, index, "", 1);
+		CHECK(!one.check_files());
+	}
+
+	unlink();
+	::unlink((store + "." + std::to_string(count)).c_str());
+	::unlink((index + "." + std::to_string(count)).c_str());
+
+	{
+		BackupStore s(store);
+		s.add("key", "fact");
+	}
+
+	{
+		FactoidShards more(store, index, "", 2);
+		CHECK(!more.check_files());
+		CHECK(more.get_fact("key", {}).empty());
+	}
+
+	// moved to more shards by exporting and importing again
+	std::stringstream moved;
+	{
+		FactoidShards one(store, index, "", 1);
+		CHECK(one.check_files());
+		CHECK(one.get_fact("key", {}) == str_vec{"fact"});
+		one.add_fact("Other", "other fact", {"g"});
+		CHECK(one.export_facts(moved, bulk_format::jsonl));
+	}
+
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+
+	{
+		FactoidShards fs(store, index, "", count);
+		siz added = 0;
+		CHECK(fs.import_facts(moved, bulk_format::jsonl, added) && added == 2);
+		CHECK(fs.shard_of("other").get_fact("other", {"g"}) == str_vec{"other fact"});
+		CHECK(fs.shard_of("key").get_fact("key", {}) == str_vec{"fact"});
+		CHECK(fs.find_fact("*").size() == 2);
+
+		// nothing goes in if any of it is bad
+		std::istringstream bad("new\tfact\nbad key\tfact\n");
+		CHECK(!fs.import_facts(bad, bulk_format::tsv, added));
+		CHECK(fs.get_fact("new", {}).empty());
+
+		std::stringstream out;
+		CHECK(fs.export_facts(out, bulk_format::tsv));
+		CHECK(out.str().find("key\tfact\n") != str::npos && out.str().find("other\tother fact\tg\n") != str::npos);
+	}
+
+	{
+		FactoidShards fs(store, index, "", count);
+		CHECK(fs.check_files());
+		CHECK(fs.get_fact("other", {"g"}) == str_vec{"other fact"});
+	}
+
+	unlink();
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+}
+
+void hot_reload(const str& dir)
+{
+	const str store = dir + "/hot-store.txt";
+	const str index = dir + "/hot-index.txt";
+
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+
+	FactoidManager fm(store, index);
+
+	fm.add_fact("a", "one");
+	fm.add_fact("b", "two", {"g"});
+	CHECK(fm.reload());
+	CHECK(fm.get_fact("a", {}) == str_vec{"one"});
+
+	// someone else edits the files
+	auto edit = [&](std::function<void(FactoidManager&)> func)
+	{
+		// so the change shows in the file times
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		FactoidManager other(store, index);
+		func(other);
+	};
+
+	edit([](FactoidManager& other)
+	{
+		other.add_fact("c", "three");
+		other.del_fact("a");
+		other.add_to_groups("b", {"h"});
+	});
+
+	CHECK(fm.get_fact("c", {}).empty());
+	CHECK(fm.reload());
+	CHECK(fm.get_fact("a", {}).empty());
+	CHECK(fm.get_fact("c", {}) == str_vec{"three"});
+	CHECK(fm.get_fact("b", {"h"}) == str_vec{"two"});
+	CHECK(fm.find_fact("*") == (str_set{"b", "c"}));
+	CHECK(fm.search_fact("three").size() == 1);
+
+	// and the watcher notices by itself
+	CHECK(fm.watch_files(std::chrono::milliseconds(20)));
+
+	edit([](FactoidManager& other){ other.add_fact("d", "four"); });
+
+	for(siz i = 0; i < 200 && fm.get_fact("d", {}).empty(); ++i)
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	CHECK(fm.get_fact("d", {}) == str_vec{"four"});
+
+	fm.unwatch_files();
+
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+}
+
+void bulk(const str& dir)
+{
+	// the same records both ways, out of order and split
+	std::istringstream tsv(
+		"# comment\n"
+		"b\tsecond b\n"
+		"a\tan a\\twith a tab\tg1, g2\n"
+		"\n"
+		"b\tthird b\tg2\n"
+		"c\t\tg3\n");
+	std::istringstream jsonl(
+		"{\"key\": \"b\", \"fact\": \"second b\"}\n"
+		"{\"key\": \"a\", \"facts\": [\"an a\\twith a tab\"], \"groups\": [\"g1\", \"g2\"], \"x\": {\"y\": [1, true]}}\n"
+		"{\"key\": \"b\", \"facts\": [\"third b\"], \"groups\": [\"g2\"]}\n"
+		"{\"key\": \"c\", \"groups\": [\"g3\"]}\n");
+
+	for(auto&& in: {std::make_pair(&tsv, bulk_format::tsv), std::make_pair(&jsonl, bulk_format::jsonl)})
+	{
+		BulkReader reader(*in.first, in.second);
+		BulkSorter sorter(dir + "/sort", 2); // spills runs
+
+		bulk_record rec;
+		while(reader.next(rec))
+			CHECK(sorter.add(std::move(rec)));
+		CHECK(reader.error.empty());
+
+		std::vector<bulk_record> got;
+		CHECK(sorter.merge([&](const bulk_record& rec){ got.push_back(rec); return true; }));
+
+		CHECK(got.size() == 3);
+		if(got.size() != 3)
+			continue;
+		CHECK(got[0].key == "a" && got[0].facts == str_vec{"an a\twith a tab"} && got[0].groups == (str_set{"g1", "g2"}));
+		CHECK(got[1].key == "b" && got[1].facts == (str_vec{"second b", "third b"}) && got[1].groups == str_set{"g2"});
+		CHECK(got[2].key == "c" && got[2].facts.empty() && got[2].groups == str_set{"g3"});
+	}
+
+	std::istringstream unicode("{\"key\": \"caf\\u00e9\", \"fact\": \"\\ud83d\\ude00\"}\n");
+	bulk_record rec;
+	CHECK(BulkReader(unicode, bulk_format::jsonl).next(rec));
+	CHECK(rec.key == "caf\xc3\xa9" && rec.facts == str_vec{"\xf0\x9f\x98\x80"});
+
+	// what is written reads back the same
+	for(auto&& format: {bulk_format::tsv, bulk_format::jsonl})
+	{
+		const str_vec facts = {"tab\there", "back\\slash \"quoted\"", "new\nline"};
+
+		std::stringstream ss;
+		BulkWriter(ss, format).write("k", facts, {"g1", "g2"});
+
+		BulkReader reader(ss, format);
+		str_vec got;
+		str_set groups;
+		while(reader.next(rec))
+		{
+			CHECK(rec.key == "k");
+			got.insert(got.end(), rec.facts.begin(), rec.facts.end());
+			groups.insert(rec.groups.begin(), rec.groups.end());
+		}
+		CHECK(reader.error.empty());
+		CHECK(got == facts);
+		CHECK(groups == (str_set{"g1", "g2"}));
+	}
+
+	std::istringstream bad_key("two words\tfact\n");
+	CHECK(!BulkReader(bad_key, bulk_format::tsv).next(rec));
+
+	std::istringstream bad_json("{\"key\": \"k\", \"facts\": [\"x\"\n");
+	BulkReader bad(bad_json, bulk_format::jsonl);
+	CHECK(!bad.next(rec) && !bad.error.empty());
+
+	// through the FactoidManager and back out
+	{
+		FactoidManager fm(dir + "/bulk-store.txt", dir + "/bulk-index.txt");
+		fm.add_fact("b", "first b");
+
+		tsv.clear();
+		tsv.seekg(0);
+		siz added = 0;
+		CHECK(fm.import_facts(tsv, bulk_format::tsv, added));
+		CHECK(added == 3);
+		CHECK(fm.get_fact("b", {}) == (str_vec{"first b", "second b", "third b"}));
+		CHECK(fm.find_fact("*", {"g3"}).empty()); // c has no facts
+
+		std::ostringstream out;
+		CHECK(fm.export_facts(out, bulk_format::tsv));
+		CHECK(out.str() ==
+			"a\tan a\\twith a tab\tg1,g2\n"
+			"b\tfirst b\tg2\n"
+			"b\tsecond b\n"
+			"b\tthird b\n"
+			"c\t\tg3\n");
+
+		std::istringstream broken("d\tfact\nbad key\tfact\n");
+		CHECK(!fm.import_facts(broken, bulk_format::tsv, added));
+		CHECK(fm.get_fact("d", {}).empty());
+	}
+
+	for(auto&& f: {"bulk-store.txt", "bulk-index.txt"})
+		::unlink((dir + "/" + f).c_str());
+}
+
+void compressed_facts(const str& dir)
+{
+	const str store = dir + "/packed-store.txt";
+	const str index = dir + "/packed-index.txt";
+	const str snap = dir + "/packed-snapshot.bin";
+
+	auto unlink = [&]
+	{
+		for(auto&& f: {store, index, snap})
+			::unlink(f.c_str());
+	};
+
+	unlink();
+
+	{
+		FactoidManager fm(store, index, snap, true, 2);
+		for(siz i = 0; i < 50; ++i)
+			fm.add_fact("key" + std::to_string(i), "see also https://example.org/wiki/page" + std::to_string(i)
+				, {"g" + std::to_string(i % 3)});
+		fm.add_fact("key1", "= key2");
+		CHECK(fm.save_snapshot());
+	}
+
+	FactoidManager fm(store, index, snap, true, 2);
+
+	CHECK(fm.get_fact("key7", {}) == str_vec{"see also https://example.org/wiki/page7"});
+	CHECK(fm.get_fact("key7", {"g1"}) == str_vec{"see also https://example.org/wiki/page7"});
+	CHECK(fm.get_fact("key7", {"g2"}).empty());
+	CHECK(fm.get_resolved_fact("key1", {}) == (str_vec{"see also https://example.org/wiki/page1"
+		, "see also https://example.org/wiki/page2"}));
+	CHECK(fm.search_fact("page9").size() == 1);
+
+	// a view outlives the cache entry it came from
+	const fact_lines lines = fm.get_fact_lines("key3", {});
+	for(siz i = 10; i < 20; ++i)
+		fm.get_fact("key" + std::to_string(i), {});
+	CHECK(lines.size() == 1 && lines[0] == "see also https://example.org/wiki/page3");
+
+	fm.add_fact("key3", "edited");
+	CHECK(fm.get_fact("key3", {}).size() == 2);
+
+	unlink();
+}
+
+void key_folding(const str& dir)
+{
+	CHECK(fold_key("HeLLo World") == "hello world");
+	CHECK(fold_key("ÀÉÎÕÜ Ÿ × Ł") == "àéîõü ÿ × ł");
+	CHECK(fold_key("ΣΟΦΊΑ") == "σοφία");
+	CHECK(fold_key("ΆΡΗΣ") == fold_key("άρης") && fold_key("άρης") == "άρησ");
+	CHECK(fold_key("ΪΫ ΌΎΏ ϴϐϑϕϖϰϱϵ Ϙ Ϲ Ͻ") == "ϊϋ όύώ θβθφπκρε ϙ ϲ ͻ");
+	CHECK(fold_key("ἈΘΉΝΑΙ ᾯ ᾼ Ῥ") == "ἀθήναι ᾧ ᾳ ῥ");
+	CHECK(key_hash("ΆΡΗΣ") == key_hash("άρης"));
+	CHECK(!is_folded("άρης"));
+	CHECK(fold_key("\u00b5s") == fold_key("\u039cS") && fold_key("\u00b5s") == "\u03bcs"); // micro sign
+	CHECK(fold_key("\u1e9b") == "\u1e61" && key_hash("\u1e9b") == key_hash("\u1e60"));
+	CHECK(fold_key("\u017f \u1e9e") == "\u017f \u1e9e"); // these fold to fewer bytes
+	CHECK(fold_key("ПРИВЕТ Ёж") == "привет ёж");
+	CHECK(fold_key("ＡＢＣ") == "ａｂｃ");
+	CHECK(fold_key("\xff\xc3Z") == "\xff\xc3z"); // not UTF-8
+
+	// long enough for 16 bytes at once, with a letter past them
+	CHECK(fold_key("THE QUICK BROWN FOX JUMPS OVER Ä") == "the quick brown fox jumps over ä");
+	CHECK(is_folded("the quick brown fox jumps over ä"));
+	CHECK(!is_folded("the quick brown fox jumps over Ä"));
+	CHECK(!is_folded("the quick brown fox jumps overX"));
+	CHECK(!is_folded("The quick brown fox"));
+
+	str key = "abc";
+	CHECK(!fold_key_in_place(key));
+	key = "ABC";
+	CHECK(fold_key_in_place(key) && key == "abc");
+
+	// folding a copy leaves the key as it is
+	key = "XYZ";
+	const str copy = fold_key(key);
+	CHECK(copy == "xyz" && key == "XYZ");
+
+	CHECK(key_hash("MiXeD Ключ") == key_hash("mixed ключ"));
+	CHECK(key_hash("a") != key_hash("b"));
+
+	const str store = dir + "/fold-store.txt";
+	const str index = dir + "/fold-index.txt";
+
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+
+	// files from before keys were folded
+	{
+		BackupStore s(store);
+		BackupStore i(index);
+		s.add("foo", "lower");
+		s.add("Foo", "upper");
+		s.add("FOO", "shout");
+		s.add("Bar", "bar");
+		i.set_from("Foo", str_set{"g"});
+		i.set_from("foo", str_set{"h"});
+	}
+
+	{
+		FactoidManager fm(store, index);
+
+		CHECK(fm.get_fact("foo", {}) == (str_vec{"lower", "shout", "upper"}));
+		CHECK(fm.get_fact("fOo", {"g"}) == (str_vec{"lower", "shout", "upper"}));
+		CHECK(fm.get_fact("FOO", {"h"}).size() == 3);
+		CHECK(fm.find_fact("*") == (str_set{"bar", "foo"}));
+		CHECK(fm.find_fact("B*") == str_set{"bar"});
+
+		fm.add_fact("BAR", "more");
+		CHECK(fm.get_fact("bar", {}) == (str_vec{"bar", "more"}));
+
+		fm.add_fact("x", "= FOO");
+		CHECK(fm.get_resolved_fact("X", {}).size() == 3);
+
+		auto got = fm.get_facts({"Bar", "bar"}, {});
+		CHECK(got[0].to_vec() == got[1].to_vec());
+
+		CHECK(fm.del_fact("BaR"));
+		CHECK(fm.get_fact("bar", {}).empty());
+	}
+
+	// the files were merged for good
+	{
+		BackupStore s(store);
+		CHECK(s.get_keys() == (str_vec{"foo", "x"}));
+	}
+
+	::unlink(store.c_str());
+	::unlink(index.c_str());
+
+	// a merged key moves to the shard its folded key hashes to
+	const str moved = "MovedKey";
+	const siz home = key_hash(moved) % 2;
+	const str away = store + "." + std::to_string(1 - home);
+
+	{
+		BackupStore s(away);
+		s.add(moved, "here");
+	}
+
+	{
+		FactoidShards fs(store, index, "", 2);
+		CHECK(fs.get_fact("movedkey", {}) == str_vec{"here"});
+		CHECK(fs.shard(home).get_fact("movedkey", {}) == str_vec{"here"});
+		CHECK(fs.shard(1 - home).get_fact("movedkey", {}).empty());
+	}
+
+	for(siz i = 0; i < 2; ++i)
+	{
+		::unlink((store + "." + std::to_string(i)).c_str());
+		::unlink((index + "." + std::to_string(i)).c_str());
+	}
+}
+
+void edit_history(const str& dir)
+{
+	using clock = FactHistory::clock;
+
+	FactHistory h;
+	const auto t0 = clock::now();
+	const auto one = std::make_shared<const str_vec>(str_vec{"one"});
+	h.record("a", nullptr, {}, t0 + std::chrono::seconds(1));
+	h.record("a", one, {"g"}, t0 + std::chrono::seconds(2));
+	h.record("b", nullptr, {}, t0 + std::chrono::seconds(3));
+
+	CHECK(h.find_after("a", t0)->facts == nullptr);
+	CHECK(h.find_after("a", t0 + std::chrono::seconds(1))->facts == one);
+	CHECK(!h.find_after("a", t0 + std::chrono::seconds(2)));
+
+	FactHistory::entry e;
+	CHECK(h.undo("a", nullptr, {}, e, t0 + std::chrono::seconds(4)) && e.facts == one);
+	CHECK(h.undo("a", one, {"g"}, e, t0 + std::chrono::seconds(5)) && !e.facts);
+	CHECK(!h.undo("a", nullptr, {}, e, t0 + std::chrono::seconds(6)));
+	CHECK(h.size() == 5);
+
+	// the clock put back leaves the stamps out of order
+	FactHistory back;
+	back.record("j", nullptr, {}, t0 + std::chrono::seconds(10));
+	back.record("j", nullptr, {}, t0 + std::chrono::seconds(11));
+	back.record("k", one, {}, t0 + std::chrono::seconds(5));
+	CHECK(back.find_after("k", t0)->facts == one);
+	CHECK(!back.find_after("k", t0 + std::chrono::seconds(7)));
+	CHECK(back.find_after("j", t0 + std::chrono::seconds(10))->when == t0 + std::chrono::seconds(11));
+
+	h.set_limits(2, std::chrono::hours(1));
+	CHECK(h.size() == 2 && h.get_since() == t0 + std::chrono::seconds(3));
+
+	const str store = dir + "/history-store.txt";
+	const str index = dir + "/history-index.txt";
+	const str backup = dir + "/history-backup.jsonl";
+
+	FactoidManager fm(store, index);
+
+	const auto before = clock::now();
+	std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+	fm.add_fact("key", "first", {"g"});
+	fm.add_fact("key", "second");
+	const auto between = clock::now();
+	std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	CHECK(fm.del_fact("key"));
+
+	str_vec lines;
+	CHECK(!fm.get_fact_at("key", before, lines));
+	CHECK(fm.get_fact_at("key", between, lines) && lines == (str_vec{"first", "second"}));
+	lines.clear();
+	CHECK(fm.get_fact_at("key", between, lines, {"g"}));
+	CHECK(!fm.get_fact_at("key", between, lines, {"h"}));
+	CHECK(!fm.get_fact_at("key", clock::now(), lines));
+	CHECK(!fm.get_fact_at("key", before - std::chrono::hours(1), lines));
+
+	// undone one edit at a time, groups too
+	CHECK(fm.undo_fact("KEY"));
+	CHECK(fm.get_fact("key", {"g"}) == (str_vec{"first", "second"}));
+	CHECK(fm.undo_fact("key"));
+	CHECK(fm.get_fact("key", {"g"}) == str_vec{"first"});
+	CHECK(fm.undo_fact("key"));
+	CHECK(fm.get_fact("key", {}).empty() && fm.find_group("g").empty());
+	CHECK(!fm.undo_fact("key"));
+
+	// the undos are history too
+	lines.clear();
+	CHECK(fm.get_fact_at("key", between, lines) && lines == (str_vec{"first", "second"}));
+
+	// and on file
+	{
+		FactoidManager again(store, index);
+		CHECK(again.get_fact("key", {}).empty());
+	}
+
+	fm.add_fact("kept", "fact", {"g"});
+	fm.add_to_groups("grouped", {"h"});
+	CHECK(fm.backup_facts(backup));
+
+	// the backup is of the moment it started
+	fm.add_fact("later", "fact");
+
+	std::ifstream ifs(backup);
+	std::stringstream ss;
+	ss << ifs.rdbuf();
+	CHECK(ss.str().find("\"kept\"") != str::npos);
+	CHECK(ss.str().find("\"grouped\"") != str::npos);
+	CHECK(ss.str().find("\"later\"") == str::npos);
+	CHECK(ss.str().find(": \"key\"") == str::npos);
+
+	std::ostringstream all;
+	CHECK(fm.export_facts(all, bulk_format::tsv));
+	CHECK(all.str() == "grouped\t\th\nkept\tfact\tg\nlater\tfact\n");
+
+	// from the snapshot with the edits since laid over it
+	{
+		FactoidManager loaded(store, index);
+		CHECK(loaded.del_fact("kept"));
+		loaded.add_to_groups("later", {"g"});
+
+		std::ostringstream os;
+		CHECK(loaded.export_facts(os, bulk_format::tsv));
+		CHECK(os.str() == "grouped\t\th\nlater\tfact\tg\n");
+	}
+
+	// aliases are followed to the facts they had at the time
+	fm.add_fact("target", "old");
+	fm.add_fact("alias", "= Target");
+	const auto then = clock::now();
+	std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	CHECK(fm.del_fact("target"));
+	fm.add_fact("target", "new");
+
+	CHECK(fm.get_fact_at("alias", then, lines) && lines == str_vec{"old"});
+	CHECK(fm.get_fact_at("alias", then, lines, {}, false) && lines == str_vec{"= Target"});
+	CHECK(fm.get_fact_at("alias", clock::now(), lines) && lines == str_vec{"new"});
+
+	// and across shards
+	{
+		const str s_store = dir + "/history-shard-store.txt";
+		const str s_index = dir + "/history-shard-index.txt";
+
+		FactoidShards fs(s_store, s_index, "", 2);
+		for(siz i = 0; i < 8; ++i)
+			fs.add_fact("t" + std::to_string(i), "old " + std::to_string(i));
+		fs.add_fact("a", "= t0");
+		fs.add_fact("a", "= t1");
+		const auto before_edit = clock::now();
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		CHECK(fs.del_fact("t0"));
+		CHECK(fs.del_fact("t1", 1));
+		fs.add_fact("t1", "new 1");
+
+		CHECK(fs.get_fact_at("a", before_edit, lines) && lines == (str_vec{"old 0", "old 1"}));
+		CHECK(fs.get_fact_at("a", clock::now(), lines) && lines == str_vec{"new 1"});
+
+		for(siz i = 0; i < 2; ++i)
+		{
+			::unlink((s_store + "." + std::to_string(i)).c_str());
+			::unlink((s_index + "." + std::to_string(i)).c_str());
+		}
+	}
+
+	for(auto&& f: {store, index, backup})
+		::unlink(f.c_str());
+}
+
+void journal(const str& dir)
+{
+	using key_values = FactoidJournal::key_values;
+
+	const str file = dir + "/journal-log.txt";
+	const str store = dir + "/journal-store.txt";
+	const str index = dir + "/journal-index.txt";
+
+	for(auto&& f: {file, store, index})
+		::unlink(f.c_str());
+
+	auto read_log = [&]
+	{
+		std::ifstream ifs(file);
+		std::ostringstream oss;
+		oss << ifs.rdbuf();
+		return oss.str();
+	};
+
+	// the log is only truncated once the compactor succeeds
+	{
+		bool fail = true;
+		key_values compacted;
+
+		FactoidJournal j(file, std::chrono::milliseconds(1), std::chrono::seconds(3600)
+			, [&](const key_values& facts, const key_values&)
+		{
+			if(fail)
+				return false;
+			for(auto&& f: facts)
+				compacted[f.first] = f.second;
+			return true;
+		});
+
+		CHECK(j.open([](char, const str&, const str_vec&){}));
+
+		j.set_facts("a", {"one"});
+		j.set_facts("b", {"two"});
+		j.sync();
+		CHECK(compacted.empty());
+		CHECK(read_log() == "F\ta\tone\nF\tb\ttwo\n");
+
+		// the kept edits are retried but newer ones win
+		fail = false;
+		j.set_facts("a", {"uno"});
+		j.sync();
+		CHECK(compacted == (key_values{{"a", {"uno"}}, {"b", {"two"}}}));
+		CHECK(read_log().empty());
+	}
+
+	// a crash after the append but before the compaction leaves
+	// records to replay and one part way through an append leaves
+	// a torn record that is dropped
+	{
+		std::ofstream ofs(file);
+		ofs << "F\ta\tone\ttwo\n" << "G\ta\tg\n" << "F\tb\tthr";
+	}
+
+	{
+		FactoidManager fm(store, index);
+		CHECK(fm.open_journal(file, std::chrono::milliseconds(1), std::chrono::seconds(3600)));
+		CHECK(fm.get_fact("a", {"g"}) == (str_vec{"one", "two"}));
+		CHECK(fm.get_fact("b", {}).empty());
+		CHECK(read_log() == "F\ta\tone\ttwo\nG\ta\tg\n");
+
+		fm.sync();
+		CHECK(read_log().empty());
+	}
+
+	{
+		FactoidManager fm(store, index);
+		CHECK(fm.get_fact("a", {"g"}) == (str_vec{"one", "two"}));
+		CHECK(fm.get_fact("b", {}).empty());
+	}
+
+	for(auto&& f: {file, store, index})
+		::unlink(f.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+	const siz threads = argc > 1 ? std::stoul(argv[1]) : 8;
+
+	char tmp[] = "/tmp/skivvy-factoid-test-XXXXXX";
+	if(!::mkdtemp(tmp))
+	{
+		std::cerr << "can not make temp dir" << '\n';
+		return EXIT_FAILURE;
+	}
+
+	histogram();
+	text_search();
+	key_suggest();
+	wild_pattern();
+	key_search();
+	group_index();
+	snapshot_arena();
+	snapshot_file(tmp);
+	fact_codec();
+	bulk(tmp);
+	command_parser();
+	shared_map();
+	reply_builder();
+	reply_cache(tmp);
+	command_pool(tmp);
+	batch_lookup(tmp);
+	alias_chain(tmp);
+	shards(tmp);
+	key_folding(tmp);
+	compressed_facts(tmp);
+	edit_history(tmp);
+	journal(tmp);
+	hot_reload(tmp);
+
+	stress(tmp, threads / 2 + 1, threads / 2 + 1, false);
+	stress(tmp, threads / 2 + 1, threads / 2 + 1, true);
+
+	for(auto&& f: {"store.txt", "index.txt", "journal.txt"})
+		::unlink((str(tmp) + "/" + f).c_str());
+	::rmdir(tmp);
 
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
 }